@@ -0,0 +1,102 @@
+//----------------------------------------------------------------------
+// FILE: alloc_bench.cpp
+// DATE: CPSC 326, Spring 2023
+// AUTH: Cameron Chetcuti
+// DESC: Measures struct allocation throughput of the VM
+//----------------------------------------------------------------------
+
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <vm.h>
+
+using namespace std;
+
+
+// builds the program: for (i = 0; i < count; ++i) {n = new Node; ...}
+// where Node has the given number of fields, and if keep is true each
+// node is linked to the previous one (so every node survives)
+void build(VM& vm, int count, int fields, bool keep)
+{
+  vector<string> names;
+  for (int i = 0; i < fields; ++i)
+    names.push_back("f" + to_string(i));
+  vm.add_struct("Node", names);
+
+  // locals: 0 = i, 1 = new node, 2 = previous node
+  VMFrameInfo main {"main", 0};
+  vector<VMInstr>& code = main.instructions;
+  code.push_back(VMInstr::PUSH(0));
+  code.push_back(VMInstr::STORE(0));
+  int loop = code.size();
+  code.push_back(VMInstr::LOAD(0));
+  code.push_back(VMInstr::PUSH(count));
+  code.push_back(VMInstr::CMPLT());
+  int exit = code.size();
+  code.push_back(VMInstr::JMPF(-1));
+  code.push_back(VMInstr::ALLOCS("Node"));
+  code.push_back(VMInstr::STORE(1));
+  if (keep and fields > 0) {
+    code.push_back(VMInstr::LOAD(1));
+    code.push_back(VMInstr::LOAD(2));
+    code.push_back(VMInstr::SETF(names[0], 0));
+    code.push_back(VMInstr::LOAD(1));
+    code.push_back(VMInstr::STORE(2));
+  }
+  code.push_back(VMInstr::LOAD(0));
+  code.push_back(VMInstr::PUSH(1));
+  code.push_back(VMInstr::ADD());
+  code.push_back(VMInstr::STORE(0));
+  code.push_back(VMInstr::JMP(loop));
+  code[exit].set_operand(int(code.size()));
+  vm.add(main);
+}
+
+
+int main(int argc, char* argv[])
+{
+  int count = 1000000;
+  int fields = 2;
+  int repeat = 3;
+  bool keep = false;
+  bool stats = false;
+  for (int i = 1; i < argc; ++i) {
+    string arg(argv[i]);
+    if (arg == "--count" and i + 1 < argc)
+      count = stoi(argv[++i]);
+    else if (arg == "--fields" and i + 1 < argc)
+      fields = stoi(argv[++i]);
+    else if (arg == "--repeat" and i + 1 < argc)
+      repeat = stoi(argv[++i]);
+    else if (arg == "--keep")
+      keep = true;
+    else if (arg == "--gc-stats")
+      stats = true;
+    else {
+      cerr << "Usage: ./alloc_bench [--count n] [--fields n] [--repeat n] "
+           << "[--keep] [--gc-stats]" << endl;
+      return 1;
+    }
+  }
+
+  double best = 0;
+  string gc_stats;
+  for (int i = 0; i < repeat; ++i) {
+    VM vm;
+    build(vm, count, fields, keep);
+    auto start = chrono::steady_clock::now();
+    vm.run();
+    auto stop = chrono::steady_clock::now();
+    double secs = chrono::duration<double>(stop - start).count();
+    if (i == 0 or secs < best) {
+      best = secs;
+      gc_stats = vm.gc_stats();
+    }
+  }
+  cout << count << " structs of " << fields << " fields"
+       << (keep ? " (kept)" : "") << ": " << best << " s, "
+       << (count / best / 1e6) << " M allocs/s" << endl;
+  if (stats)
+    cout << gc_stats;
+}
@@ -0,0 +1,107 @@
+//----------------------------------------------------------------------
+// FILE: convert_bench.cpp
+// DATE: CPSC 326, Spring 2023
+// AUTH: Cameron Chetcuti
+// DESC: Measures the VM's to_int, to_double, and to_string conversions
+//----------------------------------------------------------------------
+
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <vm.h>
+
+using namespace std;
+
+
+// builds the program: for (i = 0; i < count; ++i) {push x; convert},
+// where the value converted is the loop counter if x is null, and
+// no conversion (just the loop) if op is NOP
+void build(VM& vm, int count, const VMValue& x, OpCode op)
+{
+  // locals: 0 = i
+  VMFrameInfo main {"main", 0};
+  vector<VMInstr>& code = main.instructions;
+  code.push_back(VMInstr::PUSH(0));
+  code.push_back(VMInstr::STORE(0));
+  int loop = code.size();
+  code.push_back(VMInstr::LOAD(0));
+  code.push_back(VMInstr::PUSH(count));
+  code.push_back(VMInstr::CMPLT());
+  int exit = code.size();
+  code.push_back(VMInstr::JMPF(-1));
+  if (op != OpCode::NOP) {
+    code.push_back(x.is_null() ? VMInstr::LOAD(0) : VMInstr::PUSH(x));
+    if (op == OpCode::TOINT)
+      code.push_back(VMInstr::TOINT());
+    else if (op == OpCode::TODBL)
+      code.push_back(VMInstr::TODBL());
+    else
+      code.push_back(VMInstr::TOSTR());
+    code.push_back(VMInstr::POP());
+  }
+  code.push_back(VMInstr::LOAD(0));
+  code.push_back(VMInstr::PUSH(1));
+  code.push_back(VMInstr::ADD());
+  code.push_back(VMInstr::STORE(0));
+  code.push_back(VMInstr::JMP(loop));
+  code[exit].set_operand(int(code.size()));
+  vm.add(main);
+}
+
+
+// best time of repeat runs of the program
+double best_time(int count, int repeat, const VMValue& x, OpCode op)
+{
+  double best = 0;
+  for (int i = 0; i < repeat; ++i) {
+    VM vm;
+    build(vm, count, x, op);
+    auto start = chrono::steady_clock::now();
+    vm.run();
+    auto stop = chrono::steady_clock::now();
+    double secs = chrono::duration<double>(stop - start).count();
+    if (i == 0 or secs < best)
+      best = secs;
+  }
+  return best;
+}
+
+
+int main(int argc, char* argv[])
+{
+  int count = 1000000;
+  int repeat = 3;
+  for (int i = 1; i < argc; ++i) {
+    string arg(argv[i]);
+    if (arg == "--count" and i + 1 < argc)
+      count = stoi(argv[++i]);
+    else if (arg == "--repeat" and i + 1 < argc)
+      repeat = stoi(argv[++i]);
+    else {
+      cerr << "Usage: ./convert_bench [--count n] [--repeat n]" << endl;
+      return 1;
+    }
+  }
+
+  struct Conversion {
+    string name;
+    VMValue x;
+    OpCode op;
+  };
+  vector<Conversion> conversions = {
+    {"to_int(string)", "123456", OpCode::TOINT},
+    {"to_int(double)", 12345.678, OpCode::TOINT},
+    {"to_double(int)", nullptr, OpCode::TODBL},
+    {"to_double(string)", "3.14159", OpCode::TODBL},
+    {"to_string(int)", nullptr, OpCode::TOSTR},
+    {"to_string(double)", 12345.678, OpCode::TOSTR},
+  };
+
+  // the time of the loop itself is subtracted from each conversion
+  double loop = best_time(count, repeat, nullptr, OpCode::NOP);
+  for (const Conversion& c : conversions) {
+    double secs = best_time(count, repeat, c.x, c.op) - loop;
+    cout << c.name << ": " << (secs / count * 1e9) << " ns" << endl;
+  }
+}
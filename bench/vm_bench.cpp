@@ -0,0 +1,119 @@
+//----------------------------------------------------------------------
+// FILE: vm_bench.cpp
+// DATE: CPSC 326, Spring 2023
+// AUTH: Cameron Chetcuti
+// DESC: Times MyPL programs on the VM and reports instructions/second
+//----------------------------------------------------------------------
+
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <lexer.h>
+#include <ast_parser.h>
+#include <semantic_checker.h>
+#include <mypl_exception.h>
+#include <vm.h>
+#include <code_generator.h>
+#include <register_code_generator.h>
+
+using namespace std;
+
+
+// discards everything written to it (so printing isn't timed)
+class NullBuffer : public streambuf
+{
+protected:
+  int overflow(int c) { return c; }
+  streamsize xsputn(const char* s, streamsize n) { return n; }
+};
+
+
+// generate register-based instead of stack code
+bool use_registers = false;
+
+// jit threshold (negative disables the jit)
+int jit_threshold = -1;
+
+
+// compile and run the given file once, returns seconds taken
+double run_once(const string& filename, unsigned long long& count,
+                int& compiled)
+{
+  ifstream in_file(filename);
+  if (!in_file)
+    throw runtime_error("unable to open file '" + filename + "'");
+  Lexer lexer(in_file);
+  ASTParser parser(lexer);
+  Program p = parser.parse();
+  SemanticChecker checker;
+  p.accept(checker);
+  VM vm;
+  if (use_registers) {
+    RegisterCodeGenerator g(vm);
+    p.accept(g);
+  }
+  else {
+    CodeGenerator g(vm);
+    p.accept(g);
+  }
+  vm.set_jit_threshold(jit_threshold);
+  auto start = chrono::steady_clock::now();
+  vm.run();
+  auto stop = chrono::steady_clock::now();
+  count = vm.instruction_count();
+  compiled = vm.jit_compiled_count();
+  return chrono::duration<double>(stop - start).count();
+}
+
+
+int main(int argc, char* argv[])
+{
+  int repeat = 3;
+  vector<string> files;
+  for (int i = 1; i < argc; ++i) {
+    string arg(argv[i]);
+    if (arg == "--repeat" and i + 1 < argc)
+      repeat = stoi(argv[++i]);
+    else if (arg == "--registers")
+      use_registers = true;
+    else if (arg.rfind("--jit=", 0) == 0)
+      jit_threshold = stoi(arg.substr(6));
+    else
+      files.push_back(arg);
+  }
+  if (files.empty()) {
+    cerr << "Usage: ./vm_bench [--repeat n] [--registers] [--jit=calls] "
+         << "script-file ..."
+         << endl;
+    return 1;
+  }
+
+  NullBuffer null_buffer;
+  streambuf* out_buffer = cout.rdbuf();
+  for (const string& filename : files) {
+    double best = 0;
+    unsigned long long count = 0;
+    int compiled = 0;
+    try {
+      cout.rdbuf(&null_buffer);
+      for (int i = 0; i < repeat; ++i) {
+        double secs = run_once(filename, count, compiled);
+        if (i == 0 or secs < best)
+          best = secs;
+      }
+      cout.rdbuf(out_buffer);
+    } catch (exception& ex) {
+      cout.rdbuf(out_buffer);
+      cerr << filename << ": " << ex.what() << endl;
+      continue;
+    }
+    cout << filename << ": " << count << " instrs, " << best << " s, "
+         << (count / best / 1e6) << " M instrs/s";
+    if (jit_threshold >= 0)
+      cout << ", " << compiled << " jit compiled";
+    cout << endl;
+  }
+}
@@ -156,6 +156,9 @@ public:
   std::shared_ptr<ExprTerm> first = nullptr;
   std::optional<Token> op = std::nullopt;
   std::shared_ptr<Expr> rest = nullptr;
+  // the type of both operands of op when they have the same (non-array)
+  // type, set by the semantic checker for the code generator
+  std::string op_type;
   void accept(Visitor& v) { v.visit(*this); }  
   Token first_token() {return first->first_token();}
 };
@@ -202,6 +205,9 @@ class VarRef
 public:
   Token var_name;
   std::optional<Expr> array_expr = std::nullopt; 
+  // slot of the field in its struct (set by the semantic checker, -1
+  // for a variable)
+  int field_slot = -1;
 };
 
 
@@ -5,6 +5,7 @@
 // DESC: Code generator for myPl
 //----------------------------------------------------------------------
 
+#include <algorithm>
 #include <iostream>             // for debugging
 #include "code_generator.h"
 
@@ -25,12 +26,20 @@ CodeGenerator::CodeGenerator(VM& vm)
 }
 
 
+void CodeGenerator::add_var(const string& name)
+{
+  var_table.add(name);
+  next_var_index = max(next_var_index, var_table.get(name) + 1);
+}
+
+
 void CodeGenerator::visit(Program& p)
 {
   for (auto& struct_def : p.struct_defs)
     struct_def.accept(*this);
   for (auto& fun_def : p.fun_defs)
     fun_def.accept(*this);
+  vm.link();
 }
 
 
@@ -41,33 +50,55 @@ void CodeGenerator::visit(FunDef& f)
   var_table.push_environment();
   curr_frame.function_name = f.fun_name.lexeme();
   curr_frame.arg_count = f.params.size();
+  next_var_index = 0;
   // Generates store instructions for params
   for (int i = 0; i < curr_frame.arg_count; i++){
-    var_table.add(f.params[i].var_name.lexeme());
+    add_var(f.params[i].var_name.lexeme());
     curr_frame.instructions.push_back(VMInstr::STORE(var_table.get(f.params[i].var_name.lexeme())));
   }
   // Visits the statements
   for (int i = 0; i < f.stmts.size(); i++){
     f.stmts[i] -> accept(*this);
   }
-  // Ensures return statment
-  if (curr_frame.instructions.size() == 0){
-    curr_frame.instructions.push_back(VMInstr::PUSH(nullptr));
-    curr_frame.instructions.push_back(VMInstr::RET());
-  }
-  else if(curr_frame.instructions[-1].opcode() != OpCode::RET){
-    curr_frame.instructions.push_back(VMInstr::PUSH(nullptr));
-    curr_frame.instructions.push_back(VMInstr::RET());
-  }
-  // Pops var_table and adds frame
+  // Ensures return statment (always added, since a jump past the last
+  // instruction, e.g. out of a trailing if, must still return)
+  curr_frame.instructions.push_back(VMInstr::PUSH(nullptr));
+  curr_frame.instructions.push_back(VMInstr::RET());
+  // Pops var_table and adds frame (with room for every local slot)
   var_table.pop_environment();
+  curr_frame.local_count = next_var_index;
+  peephole.optimize(curr_frame);
   vm.add(curr_frame);
 }
 
 
+string CodeGenerator::fusion_report() const
+{
+  return peephole.report();
+}
+
+
+int CodeGenerator::branch_false(Expr& condition)
+{
+  condition.accept(*this);
+  curr_frame.instructions.push_back(VMInstr::JMPF(-1));
+  return curr_frame.instructions.size() - 1;
+}
+
+
+void CodeGenerator::patch_jump(int index, int target)
+{
+  curr_frame.instructions[index].set_operand(target);
+}
+
+
 void CodeGenerator::visit(StructDef& s)
 { 
   struct_defs[s.struct_name.lexeme()] = s;
+  vector<string> fields;
+  for (const VarDef& field : s.fields)
+    fields.push_back(field.var_name.lexeme());
+  vm.add_struct(s.struct_name.lexeme(), fields);
 }
 
 
@@ -84,11 +115,8 @@ void CodeGenerator::visit(WhileStmt& s)
   var_table.push_environment();
   // start loop has index of first conditional instruction
   int start_loop = curr_frame.instructions.size();
-  // evaluates condtion
-  s.condition.accept(*this);
-  // jumps to end of loop
-  curr_frame.instructions.push_back(VMInstr::JMPF(-1));
-  int loop_end_jmp = curr_frame.instructions.size() - 1;
+  // evaluates condtion and jumps to end of loop
+  int loop_end_jmp = branch_false(s.condition);
   // handles statements
   for (int i = 0; i < s.stmts.size(); i++){
     s.stmts[i] -> accept(*this);
@@ -97,7 +125,7 @@ void CodeGenerator::visit(WhileStmt& s)
   curr_frame.instructions.push_back(VMInstr::JMP(start_loop));
   curr_frame.instructions.push_back(VMInstr::NOP());
   // changes the jmpf command to have the correct instruction
-  curr_frame.instructions[loop_end_jmp] = VMInstr::JMPF(curr_frame.instructions.size() - 1);
+  patch_jump(loop_end_jmp, curr_frame.instructions.size() - 1);
   var_table.pop_environment();
 }
 
@@ -110,9 +138,7 @@ void CodeGenerator::visit(ForStmt& s)
   s.var_decl.accept(*this);
   int condition = curr_frame.instructions.size();
   // i < 5
-  s.condition.accept(*this);
-  int end_loop = curr_frame.instructions.size();
-  curr_frame.instructions.push_back(VMInstr::JMPF(-1));
+  int end_loop = branch_false(s.condition);
   var_table.push_environment();
   for (int i = 0; i < s.stmts.size(); i++){
       s.stmts[i] -> accept(*this);
@@ -121,7 +147,7 @@ void CodeGenerator::visit(ForStmt& s)
   s.assign_stmt.accept(*this);
   curr_frame.instructions.push_back(VMInstr::JMP(condition));
   curr_frame.instructions.push_back(VMInstr::NOP());
-  curr_frame.instructions[end_loop] = VMInstr::JMPF(curr_frame.instructions.size() - 1);
+  patch_jump(end_loop, curr_frame.instructions.size() - 1);
   var_table.pop_environment();
 }
 
@@ -131,9 +157,7 @@ void CodeGenerator::visit(IfStmt& s)
   std::vector<int> false_jmps_loc;
   std::vector<int> end_jmp_loc;
   // if
-  s.if_part.condition.accept(*this);
-  curr_frame.instructions.push_back(VMInstr::JMPF(-1));
-  false_jmps_loc.push_back(curr_frame.instructions.size() - 1); // first at 0
+  false_jmps_loc.push_back(branch_false(s.if_part.condition)); // first at 0
   // stmts
   var_table.push_environment();
   for (int i =0; i < s.if_part.stmts.size(); i++){
@@ -145,15 +169,13 @@ void CodeGenerator::visit(IfStmt& s)
   curr_frame.instructions.push_back(VMInstr::JMP(-1)); // JMP to end of if stmt 
   end_jmp_loc.push_back(curr_frame.instructions.size() -1);
   curr_frame.instructions.push_back(VMInstr::NOP());
-  curr_frame.instructions[false_jmps_loc[0]] = VMInstr::JMPF(curr_frame.instructions.size() -1);
+  patch_jump(false_jmps_loc[0], curr_frame.instructions.size() -1);
 
   // else ifs
   var_table.push_environment();
   for (int i = 0; i < s.else_ifs.size(); i++){
     // saving index of start of if stmt
-    s.else_ifs[i].condition.accept(*this);
-    curr_frame.instructions.push_back(VMInstr::JMPF(-1));
-    false_jmps_loc.push_back(curr_frame.instructions.size() -1); // second at 1 ...
+    false_jmps_loc.push_back(branch_false(s.else_ifs[i].condition)); // second at 1 ...
     // stmts within else ifs
     for (int j = 0; j < s.if_part.stmts.size(); j++){
       s.else_ifs[i].stmts[j] -> accept(*this);
@@ -163,7 +185,7 @@ void CodeGenerator::visit(IfStmt& s)
     curr_frame.instructions.push_back(VMInstr::JMP(-1)); // JMP to end of if stmt 
     end_jmp_loc.push_back(curr_frame.instructions.size() -1);
     curr_frame.instructions.push_back(VMInstr::NOP());
-    curr_frame.instructions[false_jmps_loc[i+1]] = VMInstr::JMPF(curr_frame.instructions.size() -1);
+    patch_jump(false_jmps_loc[i+1], curr_frame.instructions.size() -1);
   }
   var_table.pop_environment();
   
@@ -176,14 +198,14 @@ void CodeGenerator::visit(IfStmt& s)
   var_table.pop_environment();
   curr_frame.instructions.push_back(VMInstr::NOP());
   for (int i = 0; i < end_jmp_loc.size(); i++){
-    curr_frame.instructions[end_jmp_loc[i]] = VMInstr::JMP(curr_frame.instructions.size() - 1);
+    patch_jump(end_jmp_loc[i], curr_frame.instructions.size() - 1);
   }
 }
 
 
 void CodeGenerator::visit(VarDeclStmt& s)
 {
-  var_table.add(s.var_def.var_name.lexeme());
+  add_var(s.var_def.var_name.lexeme());
   s.expr.accept(*this);
   curr_frame.instructions.push_back(VMInstr::STORE(var_table.get(s.var_def.var_name.lexeme())));
 }
@@ -220,7 +242,7 @@ void CodeGenerator::visit(AssignStmt& s)
           curr_frame.instructions.push_back(VMInstr::GETI());
         }
         else{
-          curr_frame.instructions.push_back(VMInstr::GETF(s.lvalue[i].var_name.lexeme()));
+          curr_frame.instructions.push_back(VMInstr::GETF(s.lvalue[i].var_name.lexeme(), s.lvalue[i].field_slot));
         }
       }
       if(s.lvalue[s.lvalue.size() - 2].array_expr != nullopt){
@@ -229,8 +251,8 @@ void CodeGenerator::visit(AssignStmt& s)
       }
 
       s.expr.accept(*this);
-      string name = s.lvalue[s.lvalue.size() - 1].var_name.lexeme();
-      curr_frame.instructions.push_back(VMInstr::SETF(name));
+      const VarRef& field = s.lvalue[s.lvalue.size() - 1];
+      curr_frame.instructions.push_back(VMInstr::SETF(field.var_name.lexeme(), field.field_slot));
     }
     // setting array vals
     else{
@@ -242,7 +264,7 @@ void CodeGenerator::visit(AssignStmt& s)
           }
         }
         else{
-          curr_frame.instructions.push_back(VMInstr::GETF(s.lvalue[i + 1].var_name.lexeme()));
+          curr_frame.instructions.push_back(VMInstr::GETF(s.lvalue[i + 1].var_name.lexeme(), s.lvalue[i + 1].field_slot));
         }
       }
       // value
@@ -274,6 +296,9 @@ void CodeGenerator::visit(CallExpr& e)
   else if (e.fun_name.lexeme() == "input"){
     curr_frame.instructions.push_back(VMInstr::READ());
   }
+  else if (e.fun_name.lexeme() == "heap_dump"){
+    curr_frame.instructions.push_back(VMInstr::HDUMP());
+  }
   else if (e.fun_name.lexeme() == "concat"){
     curr_frame.instructions.push_back(VMInstr::CONCAT());
   }
@@ -288,9 +313,7 @@ void CodeGenerator::visit(CallExpr& e)
   }
   // LIST FUNCS
   else if (e.fun_name.lexeme() == "list_add"){
-    curr_frame.instructions.push_back(VMInstr::DUP());
-    curr_frame.instructions.push_back(VMInstr::ADDLI());
-    curr_frame.instructions.push_back(VMInstr::SETLE());
+    curr_frame.instructions.push_back(VMInstr::ADDLE());
   }
   else if (e.fun_name.lexeme() == "list_numi"){
     curr_frame.instructions.push_back(VMInstr::LNUMI());
@@ -341,19 +364,22 @@ void CodeGenerator::visit(Expr& e)
     if(e.rest != nullptr){
       e.rest -> accept(*this);
     }
-    // push instructions relating to ops type
+    // push instructions relating to ops type (typed versions when the
+    // semantic checker found both operands to be ints or doubles)
     string op = e.op -> lexeme();
+    bool ints = e.op_type == "int";
+    bool doubles = e.op_type == "double";
     if(op == "+"){
-      curr_frame.instructions.push_back(VMInstr::ADD());
+      curr_frame.instructions.push_back(ints ? VMInstr::ADDI() : doubles ? VMInstr::ADDD() : VMInstr::ADD());
     }
     else if(op == "-"){
-      curr_frame.instructions.push_back(VMInstr::SUB());
+      curr_frame.instructions.push_back(ints ? VMInstr::SUBI() : doubles ? VMInstr::SUBD() : VMInstr::SUB());
     }
     else if(op == "/"){
-      curr_frame.instructions.push_back(VMInstr::DIV());
+      curr_frame.instructions.push_back(ints ? VMInstr::DIVI() : doubles ? VMInstr::DIVD() : VMInstr::DIV());
     }
     else if(op == "*"){
-      curr_frame.instructions.push_back(VMInstr::MUL());
+      curr_frame.instructions.push_back(ints ? VMInstr::MULI() : doubles ? VMInstr::MULD() : VMInstr::MUL());
     }
     else if(op == "=="){
       curr_frame.instructions.push_back(VMInstr::CMPEQ());
@@ -362,16 +388,16 @@ void CodeGenerator::visit(Expr& e)
       curr_frame.instructions.push_back(VMInstr::CMPNE());
     }
     else if(op == "<="){
-      curr_frame.instructions.push_back(VMInstr::CMPLE());
+      curr_frame.instructions.push_back(ints ? VMInstr::CMPLEI() : doubles ? VMInstr::CMPLED() : VMInstr::CMPLE());
     }
     else if(op == ">="){
-      curr_frame.instructions.push_back(VMInstr::CMPGE());
+      curr_frame.instructions.push_back(ints ? VMInstr::CMPGEI() : doubles ? VMInstr::CMPGED() : VMInstr::CMPGE());
     }
     else if(op == ">"){
-      curr_frame.instructions.push_back(VMInstr::CMPGT());
+      curr_frame.instructions.push_back(ints ? VMInstr::CMPGTI() : doubles ? VMInstr::CMPGTD() : VMInstr::CMPGT());
     }
     else if(op == "<"){
-      curr_frame.instructions.push_back(VMInstr::CMPLT());
+      curr_frame.instructions.push_back(ints ? VMInstr::CMPLTI() : doubles ? VMInstr::CMPLTD() : VMInstr::CMPLT());
     }
     else if(op == "and"){
       curr_frame.instructions.push_back(VMInstr::AND());
@@ -399,36 +425,30 @@ void CodeGenerator::visit(ComplexTerm& t)
 
 
 void CodeGenerator::visit(SimpleRValue& v)
+{
+  curr_frame.instructions.push_back(VMInstr::PUSH(literal_value(v)));
+}
+
+
+VMValue CodeGenerator::literal_value(SimpleRValue& v)
 {
   if (v.value.type() == TokenType::INT_VAL){
-    curr_frame.instructions.push_back(VMInstr::PUSH(stoi(v.value.lexeme())));
+    return stoi(v.value.lexeme());
   }
   else if (v.value.type() == TokenType::DOUBLE_VAL){
-    curr_frame.instructions.push_back(VMInstr::PUSH(stod(v.value.lexeme())));  
+    return stod(v.value.lexeme());
   }  
-  else if (v.value.type() == TokenType::CHAR_VAL){
-    string s = v.value.lexeme();
-    replace_all(s, "\\n", "\n");
-    replace_all(s, "\\t", "\t");
-    curr_frame.instructions.push_back(VMInstr::PUSH(s));   
-  }
-  else if (v.value.type() == TokenType::STRING_VAL){
+  else if (v.value.type() == TokenType::CHAR_VAL ||
+           v.value.type() == TokenType::STRING_VAL){
     string s = v.value.lexeme();
     replace_all(s, "\\n", "\n");
     replace_all(s, "\\t", "\t");
-    curr_frame.instructions.push_back(VMInstr::PUSH(s));    
+    return s;
   }
   else if (v.value.type() == TokenType::BOOL_VAL){
-    if (v.value.lexeme() == "true"){
-      curr_frame.instructions.push_back(VMInstr::PUSH(true));  
-    }
-    else if (v.value.lexeme() == "false"){
-      curr_frame.instructions.push_back(VMInstr::PUSH(false));  
-    }
-  }
-  else if (v.value.type() == TokenType::NULL_VAL){
-    curr_frame.instructions.push_back(VMInstr::PUSH(nullptr));  
+    return v.value.lexeme() == "true";
   }
+  return nullptr;
 }
 
 
@@ -436,17 +456,9 @@ void CodeGenerator::visit(NewRValue& v)
 { 
   // STRUCT ALLOCATION
   if (struct_defs.count(v.type.lexeme()) == 1){
-    StructDef s = struct_defs[v.type.lexeme()];
     if (v.array_expr == nullopt){
-      curr_frame.instructions.push_back(VMInstr::ALLOCS());
-      // struct fields
-      for (int i = 0; i < s.fields.size(); i++){
-        curr_frame.instructions.push_back(VMInstr::DUP());
-        curr_frame.instructions.push_back(VMInstr::ADDF(s.fields[i].var_name.lexeme()));
-        curr_frame.instructions.push_back(VMInstr::DUP());
-        curr_frame.instructions.push_back(VMInstr::PUSH(nullptr));
-        curr_frame.instructions.push_back(VMInstr::SETF(s.fields[i].var_name.lexeme()));
-      }
+      // struct fields (all null) are laid out by the struct's shape
+      curr_frame.instructions.push_back(VMInstr::ALLOCS(v.type.lexeme()));
     }
     else {
       // handles arrays of structs
@@ -473,13 +485,13 @@ void CodeGenerator::visit(VarRValue& v)
   for (int i = 0; i < v.path.size(); i++){
     if(v.path[i].array_expr != nullopt){
       if(v.path.size() > 1  && i != 0){
-        curr_frame.instructions.push_back(VMInstr::GETF(v.path[i].var_name.lexeme()));
+        curr_frame.instructions.push_back(VMInstr::GETF(v.path[i].var_name.lexeme(), v.path[i].field_slot));
       }
       v.path[i].array_expr -> accept(*this);
       curr_frame.instructions.push_back(VMInstr::GETI());
     }
     else if (i > 0){
-      curr_frame.instructions.push_back(VMInstr::GETF(v.path[i].var_name.lexeme()));
+      curr_frame.instructions.push_back(VMInstr::GETF(v.path[i].var_name.lexeme(), v.path[i].field_slot));
     }
   }   
 }
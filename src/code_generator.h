@@ -14,6 +14,7 @@
 #include "ast.h"
 #include "var_table.h"
 #include "vm.h"
+#include "peephole.h"
 
 
 class CodeGenerator : public Visitor {
@@ -36,13 +37,32 @@ public:
   void visit(NewRValue& v);
   void visit(VarRValue& v);    
 
-private:
+  // summary of the superinstructions created by the peephole pass
+  std::string fusion_report() const;
+
+protected:
 
   VM& vm;
   VMFrameInfo curr_frame;
+  // one past the largest variable slot used by the current function
   int next_var_index = 0;  
   VarTable var_table;
   std::unordered_map<std::string,StructDef> struct_defs;
+  // fuses each function's instructions before it is added to the vm
+  Peephole peephole;
+
+  // adds a variable to the var table (tracking the slots used)
+  void add_var(const std::string& name);
+
+  // generates the condition followed by a jump taken when it is false,
+  // returns the index of the jump instruction (target set to -1)
+  virtual int branch_false(Expr& condition);
+
+  // sets the target of the jump instruction at the given index
+  void patch_jump(int index, int target);
+
+  // the value of a literal
+  VMValue literal_value(SimpleRValue& v);
 
 };
 
@@ -0,0 +1,291 @@
+//----------------------------------------------------------------------
+// FILE: heap_analysis.cpp
+// DATE: CPSC 326, Spring 2023
+// AUTH: Cameron Chetcuti
+// DESC: Dominator tree, retained sizes, and reference chains of a heap
+//       snapshot (used by the mypl-heap analyzer)
+//----------------------------------------------------------------------
+
+#include "heap_analysis.h"
+
+using namespace std;
+
+
+//----------------------------------------------------------------------
+// HeapIndex
+//----------------------------------------------------------------------
+
+HeapIndex::HeapIndex(const HeapSnapshotReader& snapshot)
+  : snapshot(snapshot)
+{
+  // count the objects (and find the largest oid) first, so the arrays
+  // are allocated once
+  size_t count = 0;
+  uint32_t max_oid = 0;
+  vector<uint32_t> root_oids;
+  size_t offset = snapshot.begin();
+  while (snapshot.tag(offset) != heap_snapshot::end_tag) {
+    char tag = snapshot.tag(offset);
+    if (tag == heap_snapshot::type_tag) {
+      uint32_t id = snapshot.type_id(offset);
+      if (id >= type_names.size())
+        type_names.resize(id + 1, "?");
+      type_names[id] = snapshot.type_name(offset);
+    }
+    else if (tag == heap_snapshot::root_tag)
+      root_oids.push_back(snapshot.root_oid(offset));
+    else if (tag == heap_snapshot::object_tag) {
+      max_oid = max(max_oid, snapshot.object_oid(offset));
+      ++count;
+    }
+    offset = snapshot.next(offset);
+  }
+
+  offsets = MappedArray<uint64_t>(count);
+  number = MappedArray<uint32_t>(count ? size_t(max_oid) + 1 : 0);
+  uint32_t i = 0;
+  for (offset = snapshot.begin();
+       snapshot.tag(offset) != heap_snapshot::end_tag;
+       offset = snapshot.next(offset)) {
+    if (snapshot.tag(offset) == heap_snapshot::object_tag) {
+      number[snapshot.object_oid(offset)] = i + 1;
+      offsets[i++] = offset;
+    }
+  }
+  for (uint32_t oid : root_oids) {
+    if (oid < number.size() and number[oid] != 0)
+      roots.push_back(number[oid] - 1);
+  }
+}
+
+
+//----------------------------------------------------------------------
+// Dominators
+//----------------------------------------------------------------------
+
+Dominators::Dominators(const HeapIndex& heap)
+{
+  const uint32_t n = heap.size();
+  const uint32_t none = UINT32_MAX;
+
+  // predecessors of each object: pred_start[i + 1] is first the count,
+  // then (placing them) the end of i's predecessors, then shifted to
+  // be the start of i + 1's
+  MappedArray<uint64_t> pred_start(n + 1);
+  for (uint32_t i = 0; i < n; ++i)
+    heap.for_each_ref(i, [&](uint32_t j) {pred_start[j + 1]++;});
+  for (uint32_t i = 0; i < n; ++i)
+    pred_start[i + 1] += pred_start[i];
+  MappedArray<uint32_t> preds(pred_start[n]);
+  for (uint32_t i = 0; i < n; ++i)
+    heap.for_each_ref(i, [&](uint32_t j) {preds[pred_start[j]++] = i;});
+  for (uint32_t i = n; i > 0; --i)
+    pred_start[i] = pred_start[i - 1];
+  pred_start[0] = 0;
+
+  // number the objects in postorder by a depth-first search from the
+  // recorded roots, then from the unvisited objects nothing refers to,
+  // then from any still unvisited
+  MappedArray<uint32_t> post(n + 1);
+  order = MappedArray<uint32_t>(n + 1);
+  uint32_t numbered = 0;
+  vector<bool> visited(n, false);
+  MappedArray<pair<uint32_t, uint32_t>> stack(n);
+  auto search = [&](uint32_t start) {
+    visited[start] = true;
+    size_t depth = 0;
+    stack[depth++] = {start, 0};
+    while (depth > 0) {
+      auto& [i, k] = stack[depth - 1];
+      uint32_t child = none;
+      uint32_t count = heap.ref_count(i);
+      while (k < count and child == none) {
+        uint32_t j = heap.ref(i, k++);
+        if (j != none and !visited[j])
+          child = j;
+      }
+      if (child == none) {
+        post[i] = numbered;
+        order[numbered++] = i;
+        --depth;
+      }
+      else {
+        visited[child] = true;
+        stack[depth++] = {child, 0};
+      }
+    }
+  };
+  root.assign(n, false);
+  for (uint32_t i : heap.roots) {
+    root[i] = true;
+    if (!visited[i])
+      search(i);
+  }
+  for (int pass = 0; pass < 2; ++pass) {
+    for (uint32_t i = 0; i < n; ++i) {
+      if (!visited[i] and (pass == 1 or pred_start[i] == pred_start[i + 1])) {
+        root[i] = true;
+        search(i);
+      }
+    }
+  }
+  post[n] = n;
+  order[n] = n;
+
+  // Cooper, Harvey and Kennedy's iterative algorithm (on postorder
+  // numbers, so a dominator has a larger number than the objects it
+  // dominates)
+  idom = MappedArray<uint32_t>(n + 1, none);
+  idom[n] = n;
+  auto intersect = [&](uint32_t a, uint32_t b) {
+    while (a != b) {
+      while (a < b)
+        a = idom[a];
+      while (b < a)
+        b = idom[b];
+    }
+    return a;
+  };
+  bool changed = true;
+  while (changed) {
+    changed = false;
+    for (uint32_t p = n; p-- > 0; ) {
+      uint32_t i = order[p];
+      uint32_t dom = root[i] ? n : none;
+      for (uint64_t k = pred_start[i]; k < pred_start[i + 1]; ++k) {
+        uint32_t q = post[preds[k]];
+        if (idom[q] != none)
+          dom = dom == none ? q : intersect(q, dom);
+      }
+      if (idom[p] != dom) {
+        idom[p] = dom;
+        changed = true;
+      }
+    }
+  }
+
+  retained = MappedArray<uint64_t>(n + 1);
+  for (uint32_t p = 0; p < n; ++p) {
+    retained[p] += heap.bytes(order[p]);
+    retained[idom[p]] += retained[p];
+  }
+}
+
+
+//----------------------------------------------------------------------
+// Reports
+//----------------------------------------------------------------------
+
+vector<TypeSummary> summarize_types(const HeapIndex& heap,
+                                    const Dominators& doms)
+{
+  const uint32_t n = heap.size();
+  vector<TypeSummary> types(heap.type_names.size());
+  for (uint32_t t = 0; t < types.size(); ++t)
+    types[t].type = t;
+  auto summary = [&](uint32_t t) -> TypeSummary& {
+    if (t >= types.size()) {
+      uint32_t old = types.size();
+      types.resize(t + 1);
+      for (uint32_t u = old; u <= t; ++u)
+        types[u].type = u;
+    }
+    return types[t];
+  };
+  for (uint32_t i = 0; i < n; ++i) {
+    TypeSummary& s = summary(heap.type(i));
+    s.objects++;
+    s.bytes += heap.bytes(i);
+  }
+
+  // walk the dominator tree counting the objects of each type on the
+  // path from the root (children are placed like the predecessors in
+  // Dominators)
+  MappedArray<uint32_t> child_start(n + 2);
+  for (uint32_t p = 0; p < n; ++p)
+    child_start[doms.idom[p] + 1]++;
+  for (uint32_t p = 0; p <= n; ++p)
+    child_start[p + 1] += child_start[p];
+  MappedArray<uint32_t> children(n);
+  for (uint32_t p = 0; p < n; ++p)
+    children[child_start[doms.idom[p]]++] = p;
+  for (uint32_t p = n + 1; p > 0; --p)
+    child_start[p] = child_start[p - 1];
+  child_start[0] = 0;
+  vector<uint32_t> on_path(types.size(), 0);
+  MappedArray<pair<uint32_t, uint32_t>> stack(n + 1);
+  size_t depth = 0;
+  stack[depth++] = {n, child_start[n]};
+  while (depth > 0) {
+    auto& [p, k] = stack[depth - 1];
+    if (k < child_start[p + 1]) {
+      uint32_t c = children[k++];
+      uint32_t t = heap.type(doms.order[c]);
+      if (on_path[t]++ == 0)
+        types[t].retained += doms.retained[c];
+      stack[depth++] = {c, child_start[c]};
+    }
+    else {
+      if (p != n)
+        on_path[heap.type(doms.order[p])]--;
+      --depth;
+    }
+  }
+
+  types.erase(remove_if(types.begin(), types.end(),
+                        [](const TypeSummary& s) {return s.objects == 0;}),
+              types.end());
+  sort(types.begin(), types.end(),
+       [](const TypeSummary& a, const TypeSummary& b) {
+         return a.retained > b.retained;
+       });
+  return types;
+}
+
+
+vector<vector<pair<uint32_t, uint64_t>>>
+longest_chains(const HeapIndex& heap, const Dominators& doms, int count)
+{
+  const uint32_t n = heap.size();
+  const uint32_t none = UINT32_MAX;
+  MappedArray<uint32_t> depth(n, none);
+  MappedArray<uint32_t> parent(n, none);
+  MappedArray<uint32_t> queue(n);
+  size_t queued = 0;
+  for (uint32_t i = 0; i < n; ++i) {
+    if (doms.root[i]) {
+      depth[i] = 1;
+      queue[queued++] = i;
+    }
+  }
+  for (size_t q = 0; q < queued; ++q) {
+    uint32_t i = queue[q];
+    heap.for_each_ref(i, [&](uint32_t j) {
+      if (depth[j] == none) {
+        depth[j] = depth[i] + 1;
+        parent[j] = i;
+        queue[queued++] = j;
+      }
+    });
+  }
+
+  // the deepest objects not already on a reported chain (queue is in
+  // order of depth)
+  vector<vector<pair<uint32_t, uint64_t>>> chains;
+  vector<bool> reported(n, false);
+  for (size_t q = queued; q-- > 0 and chains.size() < count; ) {
+    if (reported[queue[q]])
+      continue;
+    vector<pair<uint32_t, uint64_t>> runs;
+    for (uint32_t i = queue[q]; i != none; i = parent[i]) {
+      reported[i] = true;
+      uint32_t t = heap.type(i);
+      if (runs.empty() or runs.back().first != t)
+        runs.push_back({t, 0});
+      runs.back().second++;
+    }
+    reverse(runs.begin(), runs.end());
+    chains.push_back(runs);
+  }
+  return chains;
+}
@@ -0,0 +1,199 @@
+//----------------------------------------------------------------------
+// FILE: heap_analysis.h
+// DATE: CPSC 326, Spring 2023
+// AUTH: Cameron Chetcuti
+// DESC: Dominator tree, retained sizes, and reference chains of a heap
+//       snapshot (used by the mypl-heap analyzer)
+//----------------------------------------------------------------------
+
+#ifndef HEAP_ANALYSIS_H
+#define HEAP_ANALYSIS_H
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+#include <sys/mman.h>
+#include <unistd.h>
+#include "heap_snapshot.h"
+
+
+// An array of n values (initially zero) in a temporary file mapped into
+// memory. Every array with an entry per object (or reference) is one,
+// so the analysis of a large snapshot is paged to disk instead of
+// needing that much memory.
+template<typename T>
+class MappedArray
+{
+public:
+
+  MappedArray() = default;
+
+  MappedArray(std::size_t n) : n(n)
+  {
+    file = std::tmpfile();
+    if (!file or ftruncate(fileno(file), bytes()) != 0)
+      throw std::runtime_error("unable to create a temporary file");
+    void* mapped = mmap(nullptr, bytes(), PROT_READ | PROT_WRITE,
+                        MAP_SHARED, fileno(file), 0);
+    if (mapped == MAP_FAILED)
+      throw std::runtime_error("unable to map a temporary file");
+    data = static_cast<T*>(mapped);
+  }
+
+  MappedArray(std::size_t n, const T& value) : MappedArray(n)
+  {
+    std::fill(data, data + n, value);
+  }
+
+  ~MappedArray()
+  {
+    if (data)
+      munmap(data, bytes());
+    if (file)
+      std::fclose(file);
+  }
+
+  MappedArray(const MappedArray&) = delete;
+  MappedArray& operator=(const MappedArray&) = delete;
+
+  MappedArray(MappedArray&& other) noexcept { swap(other); }
+  MappedArray& operator=(MappedArray&& other) noexcept
+  {
+    swap(other);
+    return *this;
+  }
+
+  std::size_t size() const { return n; }
+
+  T& operator[](std::size_t i) { return data[i]; }
+  const T& operator[](std::size_t i) const { return data[i]; }
+
+private:
+
+  std::size_t n = 0;
+  std::FILE* file = nullptr;
+  T* data = nullptr;
+
+  std::size_t bytes() const
+  {
+    return std::max<std::size_t>(n, 1) * sizeof(T);
+  }
+
+  void swap(MappedArray& other)
+  {
+    std::swap(n, other.n);
+    std::swap(file, other.file);
+    std::swap(data, other.data);
+  }
+
+};
+
+
+// The objects of a snapshot, numbered in the order they appear. Only
+// the offset of each object's record is kept, its type, size and
+// references are read from the (mapped) snapshot when needed.
+class HeapIndex
+{
+public:
+
+  HeapIndex(const HeapSnapshotReader& snapshot);
+
+  const HeapSnapshotReader& snapshot;
+
+  std::vector<std::string> type_names;
+  MappedArray<uint64_t> offsets;
+  std::vector<uint32_t> roots;
+
+  std::size_t size() const { return offsets.size(); }
+
+  uint32_t type(uint32_t i) const { return snapshot.object_type(offsets[i]); }
+  uint64_t bytes(uint32_t i) const { return snapshot.object_bytes(offsets[i]); }
+
+  // the number of references of object i, and the number of the object
+  // its k-th reference refers to (UINT32_MAX if it isn't in the snapshot)
+  uint32_t ref_count(uint32_t i) const
+  {
+    return snapshot.ref_count(offsets[i]);
+  }
+  uint32_t ref(uint32_t i, uint32_t k) const
+  {
+    uint32_t oid = snapshot.ref(offsets[i], k);
+    return oid < number.size() ? number[oid] - 1 : UINT32_MAX;
+  }
+
+  // calls visit with the number of each object i refers to
+  template<typename Visit>
+  void for_each_ref(uint32_t i, Visit visit) const
+  {
+    uint32_t count = ref_count(i);
+    for (uint32_t k = 0; k < count; ++k) {
+      uint32_t j = ref(i, k);
+      if (j != UINT32_MAX)
+        visit(j);
+    }
+  }
+
+  const std::string& type_name(uint32_t type) const
+  {
+    static const std::string unknown = "?";
+    return type < type_names.size() ? type_names[type] : unknown;
+  }
+
+private:
+
+  // the number (plus one) of the object with each oid, 0 if none
+  MappedArray<uint32_t> number;
+
+};
+
+
+// The dominator tree of the objects: an object dominates another if
+// every path from a root to the other goes through it, and retains the
+// objects it dominates. Objects not reachable from a recorded root
+// (e.g., garbage) hang off objects nothing refers to, and remaining
+// cycles off an arbitrary member.
+class Dominators
+{
+public:
+
+  Dominators(const HeapIndex& heap);
+
+  // objects in postorder (children before parents), the virtual root
+  // is last (number heap.size())
+  MappedArray<uint32_t> order;
+
+  // immediate dominator and retained bytes (by postorder number)
+  MappedArray<uint32_t> idom;
+  MappedArray<uint64_t> retained;
+
+  // true for the objects the virtual root refers to
+  std::vector<bool> root;
+
+};
+
+
+// Objects, shallow bytes and retained bytes of each type. The retained
+// bytes of a type are those of its objects not dominated by another
+// object of the type (so they aren't counted twice).
+struct TypeSummary {
+  uint32_t type = 0;
+  uint64_t objects = 0;
+  uint64_t bytes = 0;
+  uint64_t retained = 0;
+};
+
+// the summary of each type with objects, by decreasing retained bytes
+std::vector<TypeSummary> summarize_types(const HeapIndex& heap,
+                                         const Dominators& doms);
+
+// The longest reference chains (by shortest path from the roots), each
+// given from the root as runs of objects of the same type
+std::vector<std::vector<std::pair<uint32_t, uint64_t>>>
+longest_chains(const HeapIndex& heap, const Dominators& doms, int count);
+
+
+#endif
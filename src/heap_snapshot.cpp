@@ -0,0 +1,155 @@
+//----------------------------------------------------------------------
+// FILE: heap_snapshot.cpp
+// DATE: CPSC 326, Spring 2023
+// AUTH: Cameron Chetcuti
+// DESC: Binary heap snapshots written by the VM (see VM::dump_heap)
+//       and read by the mypl-heap analyzer
+//----------------------------------------------------------------------
+
+#include <cstring>
+#include <stdexcept>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "heap_snapshot.h"
+
+using namespace std;
+using namespace heap_snapshot;
+
+
+//----------------------------------------------------------------------
+// HeapSnapshotWriter
+//----------------------------------------------------------------------
+
+HeapSnapshotWriter::HeapSnapshotWriter(const string& path)
+  : out(path, ios::binary | ios::trunc)
+{
+  out.write(magic, sizeof(magic));
+  put(version);
+}
+
+
+void HeapSnapshotWriter::put(uint32_t x)
+{
+  out.write(reinterpret_cast<const char*>(&x), sizeof(x));
+}
+
+
+void HeapSnapshotWriter::put(uint64_t x)
+{
+  out.write(reinterpret_cast<const char*>(&x), sizeof(x));
+}
+
+
+void HeapSnapshotWriter::type(uint32_t id, const string& name)
+{
+  out.put(type_tag);
+  put(id);
+  put(uint32_t(name.size()));
+  out.write(name.data(), name.size());
+}
+
+
+void HeapSnapshotWriter::root(uint32_t oid)
+{
+  out.put(root_tag);
+  put(oid);
+}
+
+
+void HeapSnapshotWriter::object(uint32_t oid, uint32_t type, uint64_t bytes,
+                                const vector<uint32_t>& refs)
+{
+  out.put(object_tag);
+  put(oid);
+  put(type);
+  put(bytes);
+  put(uint32_t(refs.size()));
+  out.write(reinterpret_cast<const char*>(refs.data()),
+            refs.size() * sizeof(uint32_t));
+}
+
+
+bool HeapSnapshotWriter::finish()
+{
+  out.put(end_tag);
+  out.close();
+  return ok();
+}
+
+
+//----------------------------------------------------------------------
+// HeapSnapshotReader
+//----------------------------------------------------------------------
+
+HeapSnapshotReader::HeapSnapshotReader(const string& path)
+{
+  int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0)
+    throw runtime_error("unable to open " + path);
+  struct stat info;
+  if (fstat(fd, &info) == 0 and info.st_size >= off_t(header_size)) {
+    size = info.st_size;
+    void* mapped = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (mapped != MAP_FAILED)
+      data = static_cast<const char*>(mapped);
+  }
+  close(fd);
+  if (!data or memcmp(data, magic, sizeof(magic)) != 0 or
+      u32(sizeof(magic)) != version) {
+    if (data)
+      munmap(const_cast<char*>(data), size);
+    throw runtime_error(path + " is not a heap snapshot");
+  }
+}
+
+
+HeapSnapshotReader::~HeapSnapshotReader()
+{
+  munmap(const_cast<char*>(data), size);
+}
+
+
+uint32_t HeapSnapshotReader::u32(size_t offset) const
+{
+  uint32_t x = 0;
+  if (offset + sizeof(x) <= size)
+    memcpy(&x, data + offset, sizeof(x));
+  return x;
+}
+
+
+uint64_t HeapSnapshotReader::object_bytes(size_t offset) const
+{
+  uint64_t x = 0;
+  if (offset + 9 + sizeof(x) <= size)
+    memcpy(&x, data + offset + 9, sizeof(x));
+  return x;
+}
+
+
+char HeapSnapshotReader::tag(size_t offset) const
+{
+  return offset < size ? data[offset] : end_tag;
+}
+
+
+size_t HeapSnapshotReader::next(size_t offset) const
+{
+  switch (tag(offset)) {
+    case type_tag: return offset + 9 + u32(offset + 5);
+    case root_tag: return offset + 5;
+    case object_tag: return offset + 21 + 4 * size_t(ref_count(offset));
+    default: return size;
+  }
+}
+
+
+string HeapSnapshotReader::type_name(size_t offset) const
+{
+  size_t length = u32(offset + 5);
+  if (offset + 9 + length > size)
+    return "";
+  return string(data + offset + 9, length);
+}
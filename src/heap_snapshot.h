@@ -0,0 +1,125 @@
+//----------------------------------------------------------------------
+// FILE: heap_snapshot.h
+// DATE: CPSC 326, Spring 2023
+// AUTH: Cameron Chetcuti
+// DESC: Binary heap snapshots written by the VM (see VM::dump_heap)
+//       and read by the mypl-heap analyzer
+//----------------------------------------------------------------------
+
+#ifndef HEAP_SNAPSHOT_H
+#define HEAP_SNAPSHOT_H
+
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+
+// A snapshot is the 8 byte magic "MYPLHEAP" and a 4 byte version
+// followed by records, each starting with a one byte tag (integers are
+// in the host's byte order):
+//
+//   'T' type:   u32 id, u32 name length, name
+//   'R' root:   u32 oid (an object referenced by the value stack)
+//   'O' object: u32 oid, u32 type id, u64 bytes, u32 reference count,
+//               u32 oid of each reference
+//   'E' end
+//
+// Type records come before the objects of that type.
+
+namespace heap_snapshot {
+
+const char magic[8] = {'M', 'Y', 'P', 'L', 'H', 'E', 'A', 'P'};
+const uint32_t version = 1;
+
+const char type_tag = 'T';
+const char root_tag = 'R';
+const char object_tag = 'O';
+const char end_tag = 'E';
+
+}
+
+
+class HeapSnapshotWriter
+{
+public:
+
+  // starts a snapshot in the given file (see ok)
+  HeapSnapshotWriter(const std::string& path);
+
+  // true if nothing has failed so far
+  bool ok() const { return bool(out); }
+
+  void type(uint32_t id, const std::string& name);
+  void root(uint32_t oid);
+  void object(uint32_t oid, uint32_t type, uint64_t bytes,
+              const std::vector<uint32_t>& refs);
+
+  // writes the end record and closes the file, returns ok()
+  bool finish();
+
+private:
+
+  std::ofstream out;
+
+  void put(uint32_t x);
+  void put(uint64_t x);
+
+};
+
+
+// Reads a snapshot by mapping the file into memory, so only the parts
+// being read need to be in memory.
+class HeapSnapshotReader
+{
+public:
+
+  // maps the file, throws a std::runtime_error if it isn't a snapshot
+  HeapSnapshotReader(const std::string& path);
+  ~HeapSnapshotReader();
+
+  HeapSnapshotReader(const HeapSnapshotReader&) = delete;
+  HeapSnapshotReader& operator=(const HeapSnapshotReader&) = delete;
+
+  // the offset of the first record
+  std::size_t begin() const { return header_size; }
+
+  // the tag of the record at the offset ('E' past the end)
+  char tag(std::size_t offset) const;
+
+  // the offset of the record after the one at the offset
+  std::size_t next(std::size_t offset) const;
+
+  // the fields of a type record
+  uint32_t type_id(std::size_t offset) const { return u32(offset + 1); }
+  std::string type_name(std::size_t offset) const;
+
+  // the oid of a root record
+  uint32_t root_oid(std::size_t offset) const { return u32(offset + 1); }
+
+  // the fields of an object record
+  uint32_t object_oid(std::size_t offset) const { return u32(offset + 1); }
+  uint32_t object_type(std::size_t offset) const { return u32(offset + 5); }
+  uint64_t object_bytes(std::size_t offset) const;
+  uint32_t ref_count(std::size_t offset) const { return u32(offset + 17); }
+  uint32_t ref(std::size_t offset, uint32_t i) const
+  {
+    return u32(offset + 21 + 4 * std::size_t(i));
+  }
+
+  std::size_t file_size() const { return size; }
+
+private:
+
+  static const std::size_t header_size = 12;
+
+  const char* data = nullptr;
+  std::size_t size = 0;
+
+  uint32_t u32(std::size_t offset) const;
+
+};
+
+
+#endif
@@ -40,7 +40,7 @@ void Lexer::error(const string& msg, int line, int column) const
 Token Lexer::next_token()
 {
   // Stores first characters value
-  char first_char;
+  char first_char = ' ';
   // Variable for the current character
   char input_char;
   // Variable for the next character
@@ -5,8 +5,12 @@
 // DESC: Basic functions for MyPL assignment 1.
 //----------------------------------------------------------------------
 
+#include <charconv>
+#include <climits>
 #include <iostream>
 #include <fstream>
+#include <vector>
+#include <unistd.h>
 #include <token.h>
 #include <lexer.h>
 #include <simple_parser.h>
@@ -17,14 +21,85 @@
 #include <semantic_checker.h>
 #include <vm.h>
 #include <code_generator.h>
+#include <register_code_generator.h>
 
 using namespace std;
 
 void printHelpMenu();
 bool checkFileName(string);
+bool parseCount(const string& str, long long max, long long& count);
+void generateCode(Program& p, VM& vm);
+void dumpHeap(const VM& vm);
+void runCode(VM& vm);
+
+// options for code generation and running the vm
+bool useRegisters = false;
+bool fusionReport = false;
+bool gcStats = false;
+bool memStats = false;
+long long maxHeap = 0;
+string heapDump = "";
+int jitThreshold = -1;
+long long outputBuffer = 65536;
+bool outputLines = false;
 
 int main(int argc, char* argv[])
 {
+  // removes the vm options (which can be given with any mode)
+  vector<char*> args;
+  for (int i = 0; i < argc; ++i){
+    string arg(argv[i]);
+    if (arg == "--registers"){
+      useRegisters = true;
+    }
+    else if (arg == "--fusion-report"){
+      fusionReport = true;
+    }
+    else if (arg == "--gc-stats"){
+      gcStats = true;
+    }
+    else if (arg == "--mem-stats"){
+      memStats = true;
+    }
+    else if (arg.rfind("--max-heap=", 0) == 0){
+      if (!parseCount(arg.substr(11), LLONG_MAX, maxHeap)){
+        cerr << "invalid option " << arg << endl;
+        printHelpMenu();
+        return 1;
+      }
+    }
+    else if (arg.rfind("--heap-dump=", 0) == 0){
+      heapDump = arg.substr(12);
+    }
+    else if (arg == "--output-buffer=line"){
+      outputLines = true;
+    }
+    else if (arg.rfind("--output-buffer=", 0) == 0){
+      if (!parseCount(arg.substr(16), LLONG_MAX, outputBuffer)){
+        cerr << "invalid option " << arg << endl;
+        printHelpMenu();
+        return 1;
+      }
+    }
+    else if (arg == "--jit"){
+      jitThreshold = 100;
+    }
+    else if (arg.rfind("--jit=", 0) == 0){
+      long long calls;
+      if (!parseCount(arg.substr(6), INT_MAX, calls)){
+        cerr << "invalid option " << arg << endl;
+        printHelpMenu();
+        return 1;
+      }
+      jitThreshold = calls;
+    }
+    else {
+      args.push_back(argv[i]);
+    }
+  }
+  argc = args.size();
+  argv = args.data();
+
   // checking for correct number of arguments
 int x = argc;
   if (x > 3){
@@ -40,9 +115,8 @@ int x = argc;
       SemanticChecker t;
       p.accept(t);
       VM vm;
-      CodeGenerator g(vm);
-      p.accept(g);
-      vm.run();
+      generateCode(p, vm);
+      runCode(vm);
     } catch (MyPLException& ex){
       cerr << ex.what() << endl;
     }
@@ -211,8 +285,7 @@ int x = argc;
           SemanticChecker t;
           p.accept(t);
           VM vm;
-          CodeGenerator g(vm);
-          p.accept(g);
+          generateCode(p, vm);
           cout << to_string(vm) << endl;
         } catch (MyPLException& ex){
           cerr << ex.what() << endl;
@@ -234,8 +307,7 @@ int x = argc;
             SemanticChecker t;
             p.accept(t);
             VM vm;
-            CodeGenerator g(vm);
-            p.accept(g);
+            generateCode(p, vm);
             cout << to_string(vm) << endl;
           } catch (MyPLException& ex){
             cerr << ex.what() << endl;
@@ -261,9 +333,8 @@ int x = argc;
             SemanticChecker t;
             p.accept(t);
             VM vm;
-            CodeGenerator g(vm);
-            p.accept(g);
-            vm.run();
+            generateCode(p, vm);
+            runCode(vm);
           } catch (MyPLException& ex){
             cerr << ex.what() << endl;
           } 
@@ -279,6 +350,81 @@ int x = argc;
   
 
 
+/*
+  Function generates the program's code into the vm (using the code
+  generator selected by the options) and configures the vm's jit.
+*/
+void generateCode(Program& p, VM& vm){
+  vm.set_jit_threshold(jitThreshold);
+  if (useRegisters){
+    RegisterCodeGenerator g(vm);
+    p.accept(g);
+    if (fusionReport){
+      cerr << g.fusion_report();
+    }
+  }
+  else {
+    CodeGenerator g(vm);
+    p.accept(g);
+    if (fusionReport){
+      cerr << g.fusion_report();
+    }
+  }
+}
+
+
+/*
+  Function writes the vm's heap snapshot if one was asked for.
+*/
+void dumpHeap(const VM& vm){
+  if (heapDump != "" && !vm.dump_heap(heapDump)){
+    cerr << "unable to write heap snapshot " << heapDump << endl;
+  }
+}
+
+
+/*
+  Function runs the vm with the heap limit and output buffer given
+  (output is flushed at each newline when it goes to a terminal),
+  printing its garbage collection and memory statistics and writing a
+  heap snapshot if they were asked for (also when the program fails,
+  e.g., by running out of memory).
+*/
+void runCode(VM& vm){
+  vm.set_max_heap(max(maxHeap, 0LL));
+  vm.set_output_buffer(max(outputBuffer, 0LL),
+                       outputLines || isatty(STDOUT_FILENO));
+  try {
+    vm.run();
+  } catch (MyPLException& ex){
+    if (memStats){
+      cerr << vm.memory_stats();
+    }
+    dumpHeap(vm);
+    throw;
+  }
+  if (gcStats){
+    cerr << vm.gc_stats();
+  }
+  if (memStats){
+    cerr << vm.memory_stats();
+  }
+  dumpHeap(vm);
+}
+
+
+/*
+  Function parses an option's whole number from 0 to max into count
+  (returning false if str is anything else).
+*/
+bool parseCount(const string& str, long long max, long long& count){
+  const char* end = str.data() + str.size();
+  from_chars_result parsed = from_chars(str.data(), end, count);
+  return parsed.ec == errc() and parsed.ptr == end and count >= 0 and
+    count <= max;
+}
+
+
 /*
   Function prints the help menu message with correct formatting.
 */
@@ -291,5 +437,20 @@ void printHelpMenu(){
   cout << " --print     pretty prints program" << endl;
   cout << " --check     statically checks program" << endl;
   cout << " --ir        print intermediate (code) representation" << endl;
+  cout << "VM options (used with the --ir and normal modes):" << endl;
+  cout << " --registers generate register-based instead of stack code" << endl;
+  cout << " --fusion-report prints the superinstructions created (to stderr)" << endl;
+  cout << " --jit[=calls] compiles functions called more than calls times" << endl;
+  cout << "             (default 100) to native code" << endl;
+  cout << " --gc-stats  prints garbage collection statistics (to stderr)" << endl;
+  cout << " --mem-stats prints heap memory statistics (to stderr)" << endl;
+  cout << " --max-heap=bytes stops the program with an error once its heap" << endl;
+  cout << "             objects and strings use more than bytes (the" << endl;
+  cout << "             default 0 sets no limit)" << endl;
+  cout << " --heap-dump=file writes a heap snapshot to file when the program" << endl;
+  cout << "             ends (see mypl-heap)" << endl;
+  cout << " --output-buffer=bytes|line buffers up to bytes of output (default" << endl;
+  cout << "             65536, 0 writes right away) or flushes each line" << endl;
+  cout << "             (the default when writing to a terminal)" << endl;
 }
 
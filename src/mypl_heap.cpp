@@ -0,0 +1,86 @@
+//----------------------------------------------------------------------
+// FILE: mypl_heap.cpp
+// DATE: CPSC 326, Spring 2023
+// AUTH: Cameron Chetcuti
+// DESC: Reports the retained size by type and the longest reference
+//       chains of a MyPL heap snapshot (see heap_snapshot.h)
+//----------------------------------------------------------------------
+
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "heap_analysis.h"
+#include "heap_snapshot.h"
+
+using namespace std;
+
+
+void usage()
+{
+  cerr << "Usage: ./mypl-heap snapshot-file [--top n] [--chains n]" << endl;
+}
+
+
+int main(int argc, char* argv[])
+{
+  string path;
+  int top = 10;
+  int chain_count = 3;
+  for (int i = 1; i < argc; ++i) {
+    string arg(argv[i]);
+    if (arg == "--top" and i + 1 < argc)
+      top = stoi(argv[++i]);
+    else if (arg == "--chains" and i + 1 < argc)
+      chain_count = stoi(argv[++i]);
+    else if (path.empty() and arg.rfind("--", 0) != 0)
+      path = arg;
+    else {
+      usage();
+      return 1;
+    }
+  }
+  if (path.empty()) {
+    usage();
+    return 1;
+  }
+
+  try {
+    HeapSnapshotReader snapshot(path);
+    HeapIndex heap(snapshot);
+    Dominators doms(heap);
+    uint64_t total = doms.retained[heap.size()];
+    cout << path << ": " << heap.size() << " objects, " << total
+         << " bytes, " << heap.roots.size() << " roots" << endl;
+
+    cout << endl << "Retained size by type:" << endl;
+    cout << "  " << left << setw(24) << "type" << right << setw(12)
+         << "objects" << setw(16) << "bytes" << setw(16)
+         << "retained bytes" << endl;
+    vector<TypeSummary> types = summarize_types(heap, doms);
+    for (int i = 0; i < types.size() and i < top; ++i) {
+      const TypeSummary& s = types[i];
+      cout << "  " << left << setw(24) << heap.type_name(s.type) << right
+           << setw(12) << s.objects << setw(16) << s.bytes << setw(16)
+           << s.retained << endl;
+    }
+
+    cout << endl << "Longest reference chains:" << endl;
+    int rank = 1;
+    for (const auto& runs : longest_chains(heap, doms, chain_count)) {
+      uint64_t length = 0;
+      string chain;
+      for (const auto& [type, count] : runs) {
+        length += count;
+        chain += (chain.empty() ? "" : " -> ") + heap.type_name(type);
+        if (count > 1)
+          chain += " x" + to_string(count);
+      }
+      cout << "  " << rank++ << ". " << length << " objects: " << chain
+           << endl;
+    }
+  } catch (exception& ex) {
+    cerr << ex.what() << endl;
+    return 1;
+  }
+}
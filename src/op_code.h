@@ -55,7 +55,7 @@ enum class OpCode {
   CONCAT,       // pop x, pop y, push y + x (string concat)
     
   // heap
-  ALLOCS,       // allocate struct obj, push oid x
+  ALLOCS,       // allocate struct obj (with the fields of struct v if given), push oid x
   ALLOCA,       // pop x, pop y, allocate array obj with y x values, push oid
   
   ALLOCL,       // allocate list obj, push oid x
@@ -74,14 +74,70 @@ enum class OpCode {
   LRETRIEVE,    // pop x, pop y, push obj(y)[x]
   
   ADDF,         // [operand] pop x, add field named v to obj(x)
-  SETF,         // [operand] pop x and y, set obj(y).v = x
-  GETF,         // [operand] pop x, push value of obj(x).v 
+  SETF,         // [operand] pop x and y, set obj(y).v = x (v in slot r1 if given)
+  GETF,         // [operand] pop x, push value of obj(x).v (v in slot r1 if given)
   SETI,         // pop x, y, and z, set array obj(z)[y] = x
   GETI,         // pop x and y, push array obj(y)[x] value
     
   // special
   DUP,          // pop x, push x, push x
-  NOP           // has no effect (for jumping over code segments)
+  NOP,          // has no effect (for jumping over code segments)
+
+  // registers (r1, r2, and r3 are local variable slots)
+  MOVR,         // [r1, r2] set r1 = r2
+  MOVK,         // [operand, r1] set r1 = v
+  ADDR,         // [r1, r2, r3] set r1 = (r2 + r3)
+  SUBR,         // [r1, r2, r3] set r1 = (r2 - r3)
+  MULR,         // [r1, r2, r3] set r1 = (r2 * r3)
+  DIVR,         // [r1, r2, r3] set r1 = (r2 / r3)
+  ANDR,         // [r1, r2, r3] set r1 = (r2 and r3)
+  ORR,          // [r1, r2, r3] set r1 = (r2 or r3)
+  NOTR,         // [r1, r2] set r1 = (not r2)
+  CMPLTR,       // [r1, r2, r3] set r1 = (r2 < r3)
+  CMPLER,       // [r1, r2, r3] set r1 = (r2 <= r3)
+  CMPGTR,       // [r1, r2, r3] set r1 = (r2 > r3)
+  CMPGER,       // [r1, r2, r3] set r1 = (r2 >= r3)
+  CMPEQR,       // [r1, r2, r3] set r1 = (r2 == r3)
+  CMPNER,       // [r1, r2, r3] set r1 = (r2 != r3)
+  JMPFR,        // [operand, r1] if r1 is false jump to instruction v
+
+  // superinstructions (created by the peephole pass)
+  CMPLTKJF,     // [operand, r1, r2] if not (r1 < v) jump to instruction r2
+  CMPLEKJF,     // [operand, r1, r2] if not (r1 <= v) jump to instruction r2
+  CMPGTKJF,     // [operand, r1, r2] if not (r1 > v) jump to instruction r2
+  CMPGEKJF,     // [operand, r1, r2] if not (r1 >= v) jump to instruction r2
+  CMPEQKJF,     // [operand, r1, r2] if not (r1 == v) jump to instruction r2
+  CMPNEKJF,     // [operand, r1, r2] if not (r1 != v) jump to instruction r2
+  ADDK,         // [operand, r1, r2] set r1 = (r2 + v)
+  SUBK,         // [operand, r1, r2] set r1 = (r2 - v)
+  SETFN,        // [operand] set obj(x).v = null, x is the top of the stack
+
+  // typed operations (operands known to be int or double)
+  ADDI,         // push(int(y) + int(x))
+  ADDD,         // push(double(y) + double(x))
+  SUBI,         // push(int(y) - int(x))
+  SUBD,         // push(double(y) - double(x))
+  MULI,         // push(int(y) * int(x))
+  MULD,         // push(double(y) * double(x))
+  DIVI,         // push(int(y) / int(x))
+  DIVD,         // push(double(y) / double(x))
+  CMPLTI,       // push(int(y) < int(x))
+  CMPLTD,       // push(double(y) < double(x))
+  CMPLEI,       // push(int(y) <= int(x))
+  CMPLED,       // push(double(y) <= double(x))
+  CMPGTI,       // push(int(y) > int(x))
+  CMPGTD,       // push(double(y) > double(x))
+  CMPGEI,       // push(int(y) >= int(x))
+  CMPGED,       // push(double(y) >= double(x))
+
+  // fused list operations
+  ADDLE,        // pop x, pop y, append y to obj(x)
+
+  // built-ins
+  HDUMP,        // pop x, write a heap snapshot to the file named x
+
+  // constants (created when the program is linked)
+  PUSHK         // [operand] push constant v of the frame's constant pool
 
 };
 
@@ -0,0 +1,221 @@
+//----------------------------------------------------------------------
+// FILE: peephole.cpp
+// DATE: CPSC 326, Spring 2023
+// AUTH: Cameron Chetcuti
+// DESC: Peephole superinstruction fusion pass
+//----------------------------------------------------------------------
+
+#include "peephole.h"
+
+using namespace std;
+
+
+namespace {
+
+  // true if the instruction is a jump with a target (and returns it)
+  bool jump_target(const VMInstr& instr, int& target)
+  {
+    OpCode op = instr.opcode();
+    if (op == OpCode::JMP or op == OpCode::JMPF or op == OpCode::JMPFR) {
+      target = instr.operand().value().as_int();
+      return true;
+    }
+    if (op >= OpCode::CMPLTKJF and op <= OpCode::CMPNEKJF) {
+      target = instr.reg(1);
+      return true;
+    }
+    return false;
+  }
+
+
+  void set_jump_target(VMInstr& instr, int target)
+  {
+    if (instr.opcode() == OpCode::JMP or instr.opcode() == OpCode::JMPF or
+        instr.opcode() == OpCode::JMPFR)
+      instr.set_operand(target);
+    else
+      instr.set_reg(1, target);
+  }
+
+
+  // the instruction's opcode name
+  string name(const VMInstr& instr)
+  {
+    string s = to_string(instr);
+    return s.substr(0, s.find('('));
+  }
+
+
+  // the untyped version of a typed operation (e.g., ADD for ADDI); fusion
+  // takes precedence over the typed operations, dropping the type, since
+  // a fused form saves more dispatches than the typed fast path does
+  OpCode untyped(OpCode op)
+  {
+    switch (op) {
+      case OpCode::ADDI: case OpCode::ADDD: return OpCode::ADD;
+      case OpCode::SUBI: case OpCode::SUBD: return OpCode::SUB;
+      case OpCode::MULI: case OpCode::MULD: return OpCode::MUL;
+      case OpCode::DIVI: case OpCode::DIVD: return OpCode::DIV;
+      case OpCode::CMPLTI: case OpCode::CMPLTD: return OpCode::CMPLT;
+      case OpCode::CMPLEI: case OpCode::CMPLED: return OpCode::CMPLE;
+      case OpCode::CMPGTI: case OpCode::CMPGTD: return OpCode::CMPGT;
+      case OpCode::CMPGEI: case OpCode::CMPGED: return OpCode::CMPGE;
+      default: return op;
+    }
+  }
+
+
+  // the compare and jump superinstruction for a comparison
+  optional<OpCode> compare_jump(OpCode cmp)
+  {
+    switch (cmp) {
+      case OpCode::CMPLT: return OpCode::CMPLTKJF;
+      case OpCode::CMPLE: return OpCode::CMPLEKJF;
+      case OpCode::CMPGT: return OpCode::CMPGTKJF;
+      case OpCode::CMPGE: return OpCode::CMPGEKJF;
+      case OpCode::CMPEQ: return OpCode::CMPEQKJF;
+      case OpCode::CMPNE: return OpCode::CMPNEKJF;
+      default: return nullopt;
+    }
+  }
+
+}
+
+
+void Peephole::optimize(VMFrameInfo& frame)
+{
+  const vector<VMInstr>& code = frame.instructions;
+  int n = code.size();
+
+  // mark jump targets (a fused sequence can only be entered at its start)
+  vector<bool> targets(n + 1, false);
+  for (const VMInstr& instr : code) {
+    int target;
+    if (jump_target(instr, target) and target >= 0 and target <= n)
+      targets[target] = true;
+  }
+
+  // fuse, tracking where each original instruction ended up
+  vector<VMInstr> out;
+  vector<int> new_index(n + 1);
+  int i = 0;
+  while (i < n) {
+    int start = out.size();
+    int len = fuse(code, i, targets, out);
+    if (len == 0) {
+      out.push_back(code[i]);
+      len = 1;
+    }
+    for (int j = i; j < i + len; ++j)
+      new_index[j] = start;
+    i += len;
+  }
+  new_index[n] = out.size();
+
+  // renumber the jump targets
+  for (VMInstr& instr : out) {
+    int target;
+    if (jump_target(instr, target) and target >= 0 and target <= n)
+      set_jump_target(instr, new_index[target]);
+  }
+  frame.instructions = out;
+}
+
+
+int Peephole::fuse(const vector<VMInstr>& code, int i,
+                   const vector<bool>& targets, vector<VMInstr>& out)
+{
+  // the (untyped) opcode at offset k from i (or NOP past the end)
+  auto op = [&](int k) {
+    return i + k < code.size() ? untyped(code[i + k].opcode()) : OpCode::NOP;
+  };
+  // true if no instruction in the first len is entered by a jump
+  auto straight = [&](int len) {
+    for (int k = 1; k < len; ++k)
+      if (targets[i + k])
+        return false;
+    return true;
+  };
+  auto reg = [&](int k) { return code[i + k].operand().value().as_int(); };
+  auto val = [&](int k) { return code[i + k].operand().value(); };
+
+  // LOAD x; PUSH k; CMPxx; JMPF L (ordering a null is an error, so only
+  // == and != are fused with a null constant)
+  if (op(0) == OpCode::LOAD and op(1) == OpCode::PUSH and
+      compare_jump(op(2)) and op(3) == OpCode::JMPF and straight(4) and
+      (!val(1).is_null() or op(2) == OpCode::CMPEQ or
+       op(2) == OpCode::CMPNE)) {
+    OpCode fused = compare_jump(op(2)).value();
+    out.push_back(VMInstr::CMPKJF(fused, reg(0), val(1), reg(3)));
+    count("LOAD PUSH " + name(code[i + 2]) + " JMPF");
+    return 4;
+  }
+
+  // LOAD x; PUSH k; ADD/SUB; STORE y
+  if (op(0) == OpCode::LOAD and op(1) == OpCode::PUSH and
+      (op(2) == OpCode::ADD or op(2) == OpCode::SUB) and
+      op(3) == OpCode::STORE and straight(4) and !val(1).is_null()) {
+    if (op(2) == OpCode::ADD)
+      out.push_back(VMInstr::ADDK(reg(3), reg(0), val(1)));
+    else
+      out.push_back(VMInstr::SUBK(reg(3), reg(0), val(1)));
+    count("LOAD PUSH " + name(code[i + 2]) + " STORE");
+    return 4;
+  }
+
+  // LOAD x; LOAD z; ADD/SUB/MUL/DIV; STORE y
+  if (op(0) == OpCode::LOAD and op(1) == OpCode::LOAD and
+      op(3) == OpCode::STORE and straight(4)) {
+    int y = reg(3), x = reg(0), z = reg(1);
+    switch (op(2)) {
+      case OpCode::ADD: out.push_back(VMInstr::ADDR(y, x, z)); break;
+      case OpCode::SUB: out.push_back(VMInstr::SUBR(y, x, z)); break;
+      case OpCode::MUL: out.push_back(VMInstr::MULR(y, x, z)); break;
+      case OpCode::DIV: out.push_back(VMInstr::DIVR(y, x, z)); break;
+      default: return 0;
+    }
+    count("LOAD LOAD " + name(code[i + 2]) + " STORE");
+    return 4;
+  }
+
+  // PUSH k; STORE y
+  if (op(0) == OpCode::PUSH and op(1) == OpCode::STORE and straight(2)) {
+    out.push_back(VMInstr::MOVK(reg(1), val(0)));
+    count("PUSH STORE");
+    return 2;
+  }
+
+  // DUP; PUSH null; SETF f
+  if (op(0) == OpCode::DUP and op(1) == OpCode::PUSH and
+      op(2) == OpCode::SETF and straight(3) and val(1).is_null()) {
+    out.push_back(VMInstr::SETFN(string(val(2).as_string()),
+                                 code[i + 2].reg(0)));
+    count("DUP PUSH SETF");
+    return 3;
+  }
+
+  return 0;
+}
+
+
+void Peephole::count(const string& fusion)
+{
+  for (auto& [name, times] : fired) {
+    if (name == fusion) {
+      ++times;
+      return;
+    }
+  }
+  fired.push_back({fusion, 1});
+}
+
+
+string Peephole::report() const
+{
+  string s = "Fusions:\n";
+  if (fired.empty())
+    s += "  none\n";
+  for (const auto& [name, times] : fired)
+    s += "  " + name + ": " + std::to_string(times) + "\n";
+  return s;
+}
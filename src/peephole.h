@@ -0,0 +1,57 @@
+//----------------------------------------------------------------------
+// FILE: peephole.h
+// DATE: CPSC 326, Spring 2023
+// AUTH: Cameron Chetcuti
+// DESC: Interface for the peephole superinstruction fusion pass.
+//----------------------------------------------------------------------
+
+
+#ifndef PEEPHOLE_H
+#define PEEPHOLE_H
+
+#include <string>
+#include <utility>
+#include <vector>
+#include "vm_frame.h"
+
+
+// Replaces common instruction sequences of a (fully generated) function
+// with a single superinstruction:
+//
+//   LOAD x; PUSH k; CMPxx; JMPF L   =>  CMPxxKJF(x, k, L)
+//   LOAD x; PUSH k; ADD/SUB; STORE y =>  ADDK/SUBK(y, x, k)
+//   LOAD x; LOAD z; op; STORE y      =>  opR(y, x, z) for +, -, *, /
+//   PUSH k; STORE y                  =>  MOVK(y, k)
+//   DUP; PUSH null; SETF f           =>  SETFN(f)
+//
+// Typed operations (e.g., ADDI, CMPLTD) are fused like their untyped
+// versions. A sequence is only fused if none of its instructions (other
+// than the first) is a jump target. Jump targets are renumbered
+// afterwards.
+class Peephole
+{
+public:
+
+  // fuse the instruction sequences of the given function
+  void optimize(VMFrameInfo& frame);
+
+  // a summary of the fusions performed (across all functions)
+  std::string report() const;
+
+private:
+
+  // number of times each fusion fired (in order of first use)
+  std::vector<std::pair<std::string,int>> fired;
+
+  // records that the given fusion fired
+  void count(const std::string& fusion);
+
+  // attempts to fuse the sequence starting at index i, on success adds
+  // the superinstruction to out and returns the number of instructions
+  // it replaces (returns 0 if nothing was fused)
+  int fuse(const std::vector<VMInstr>& code, int i,
+           const std::vector<bool>& targets, std::vector<VMInstr>& out);
+
+};
+
+#endif
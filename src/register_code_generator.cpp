@@ -0,0 +1,168 @@
+//----------------------------------------------------------------------
+// FILE: register_code_generator.cpp
+// DATE: CPSC 326, Spring 2023
+// AUTH: Cameron Chetcuti
+// DESC: Register-based code generator for MyPL
+//----------------------------------------------------------------------
+
+#include <algorithm>
+#include "register_code_generator.h"
+
+using namespace std;
+
+
+RegisterCodeGenerator::RegisterCodeGenerator(VM& vm)
+  : CodeGenerator(vm)
+{
+}
+
+
+void RegisterCodeGenerator::begin_stmt()
+{
+  next_temp = var_table.size();
+}
+
+
+int RegisterCodeGenerator::new_temp()
+{
+  // never hand out a slot that is in use by a variable
+  int temp = max(next_temp, var_table.size());
+  next_temp = temp + 1;
+  next_var_index = max(next_var_index, next_temp);
+  return temp;
+}
+
+
+int RegisterCodeGenerator::var_slot(ExprTerm& t)
+{
+  SimpleTerm* term = dynamic_cast<SimpleTerm*>(&t);
+  if (!term)
+    return -1;
+  VarRValue* var = dynamic_cast<VarRValue*>(term->rvalue.get());
+  if (!var or var->path.size() != 1 or var->path[0].array_expr)
+    return -1;
+  return var_table.get(var->path[0].var_name.lexeme());
+}
+
+
+void RegisterCodeGenerator::term_into(ExprTerm& t, int dst)
+{
+  int slot = var_slot(t);
+  if (slot != -1) {
+    if (slot != dst)
+      curr_frame.instructions.push_back(VMInstr::MOVR(dst, slot));
+    return;
+  }
+  if (ComplexTerm* term = dynamic_cast<ComplexTerm*>(&t)) {
+    expr_into(term->expr, dst);
+    return;
+  }
+  SimpleTerm* term = dynamic_cast<SimpleTerm*>(&t);
+  if (SimpleRValue* val = dynamic_cast<SimpleRValue*>(term->rvalue.get())) {
+    curr_frame.instructions.push_back(VMInstr::MOVK(dst, literal_value(*val)));
+    return;
+  }
+  // no register form, so compute on the stack
+  t.accept(*this);
+  curr_frame.instructions.push_back(VMInstr::STORE(dst));
+}
+
+
+int RegisterCodeGenerator::term_reg(ExprTerm& t)
+{
+  int slot = var_slot(t);
+  if (slot != -1)
+    return slot;
+  int temp = new_temp();
+  term_into(t, temp);
+  return temp;
+}
+
+
+void RegisterCodeGenerator::expr_into(Expr& e, int dst)
+{
+  if (e.op == nullopt)
+    term_into(*e.first, dst);
+  else {
+    int lhs = term_reg(*e.first);
+    int rhs = expr_reg(*e.rest);
+    string op = e.op->lexeme();
+    if (op == "+")
+      curr_frame.instructions.push_back(VMInstr::ADDR(dst, lhs, rhs));
+    else if (op == "-")
+      curr_frame.instructions.push_back(VMInstr::SUBR(dst, lhs, rhs));
+    else if (op == "/")
+      curr_frame.instructions.push_back(VMInstr::DIVR(dst, lhs, rhs));
+    else if (op == "*")
+      curr_frame.instructions.push_back(VMInstr::MULR(dst, lhs, rhs));
+    else if (op == "==")
+      curr_frame.instructions.push_back(VMInstr::CMPEQR(dst, lhs, rhs));
+    else if (op == "!=")
+      curr_frame.instructions.push_back(VMInstr::CMPNER(dst, lhs, rhs));
+    else if (op == "<=")
+      curr_frame.instructions.push_back(VMInstr::CMPLER(dst, lhs, rhs));
+    else if (op == ">=")
+      curr_frame.instructions.push_back(VMInstr::CMPGER(dst, lhs, rhs));
+    else if (op == ">")
+      curr_frame.instructions.push_back(VMInstr::CMPGTR(dst, lhs, rhs));
+    else if (op == "<")
+      curr_frame.instructions.push_back(VMInstr::CMPLTR(dst, lhs, rhs));
+    else if (op == "and")
+      curr_frame.instructions.push_back(VMInstr::ANDR(dst, lhs, rhs));
+    else if (op == "or")
+      curr_frame.instructions.push_back(VMInstr::ORR(dst, lhs, rhs));
+  }
+  if (e.negated)
+    curr_frame.instructions.push_back(VMInstr::NOTR(dst, dst));
+}
+
+
+int RegisterCodeGenerator::expr_reg(Expr& e)
+{
+  if (e.op == nullopt and !e.negated)
+    return term_reg(*e.first);
+  int temp = new_temp();
+  expr_into(e, temp);
+  return temp;
+}
+
+
+void RegisterCodeGenerator::visit(VarDeclStmt& s)
+{
+  add_var(s.var_def.var_name.lexeme());
+  begin_stmt();
+  expr_into(s.expr, var_table.get(s.var_def.var_name.lexeme()));
+}
+
+
+void RegisterCodeGenerator::visit(AssignStmt& s)
+{
+  // only plain variables are registers
+  if (s.lvalue.size() != 1 or s.lvalue[0].array_expr) {
+    CodeGenerator::visit(s);
+    return;
+  }
+  begin_stmt();
+  expr_into(s.expr, var_table.get(s.lvalue[0].var_name.lexeme()));
+}
+
+
+void RegisterCodeGenerator::visit(Expr& e)
+{
+  // value needed on the stack (e.g., an argument or return value), only
+  // worth using registers if there is an operator to compute
+  if (e.op == nullopt) {
+    CodeGenerator::visit(e);
+    return;
+  }
+  curr_frame.instructions.push_back(VMInstr::LOAD(expr_reg(e)));
+}
+
+
+int RegisterCodeGenerator::branch_false(Expr& condition)
+{
+  begin_stmt();
+  int reg = expr_reg(condition);
+  curr_frame.instructions.push_back(VMInstr::JMPFR(reg, -1));
+  return curr_frame.instructions.size() - 1;
+}
@@ -0,0 +1,57 @@
+//----------------------------------------------------------------------
+// FILE: register_code_generator.h
+// DATE: CPSC 326, Spring 2023
+// AUTH: Cameron Chetcuti
+// DESC: Interface for the register-based code generator visitor.
+//----------------------------------------------------------------------
+
+
+#ifndef REGISTER_CODE_GENERATOR_H
+#define REGISTER_CODE_GENERATOR_H
+
+#include "code_generator.h"
+
+
+// Code generator that computes expressions with three-address register
+// instructions (ADDR, CMPLTR, ...) that operate directly on the frame's
+// local variable slots. Temporary values use slots past the function's
+// variables. Anything without a register form (calls, paths, new, ...)
+// is generated as stack code and then stored into a register.
+class RegisterCodeGenerator : public CodeGenerator {
+public:
+  RegisterCodeGenerator(VM& vm);
+  void visit(VarDeclStmt& s);
+  void visit(AssignStmt& s);
+  void visit(Expr& e);
+
+protected:
+
+  int branch_false(Expr& condition);
+
+private:
+
+  // next available temporary slot
+  int next_temp = 0;
+
+  // start a new statement (temporaries from earlier statements are dead)
+  void begin_stmt();
+
+  // allocate a new temporary slot
+  int new_temp();
+
+  // generate code that stores the value of the expression (term) into
+  // the given slot
+  void expr_into(Expr& e, int dst);
+  void term_into(ExprTerm& t, int dst);
+
+  // generate code for the expression (term), returns the slot holding
+  // its value (a variable's own slot or a new temporary)
+  int expr_reg(Expr& e);
+  int term_reg(ExprTerm& t);
+
+  // the slot of a simple variable term (or -1 if not a simple variable)
+  int var_slot(ExprTerm& t);
+
+};
+
+#endif
@@ -18,7 +18,7 @@ const unordered_set<string> BASE_TYPES {"int", "double", "char", "string", "bool
 const unordered_set<string> BUILT_INS {"print", "input", "to_string",  "to_int",
   "to_double", "length", "get", "concat", "list_create", "list_add", "list_numi",
   "list_numd", "list_nums", "list_numb", "list_rmb", "list_avgi", "list_avgd", 
-  "list_change", "list_size"};
+  "list_change", "list_size", "heap_dump"};
 
 
 // helper functions
@@ -33,6 +33,25 @@ optional<VarDef> SemanticChecker::get_field(const StructDef& struct_def,
 }
 
 
+void SemanticChecker::set_field_slots(vector<VarRef>& path)
+{
+  optional<DataType> type = symbol_table.get(path[0].var_name.lexeme());
+  for (int i = 1; i < path.size() and type; ++i) {
+    if (!struct_defs.contains(type->type_name))
+      return;
+    const StructDef& struct_def = struct_defs.at(type->type_name);
+    type = nullopt;
+    for (int slot = 0; slot < struct_def.fields.size(); ++slot) {
+      const VarDef& field = struct_def.fields[slot];
+      if (field.var_name.lexeme() == path[i].var_name.lexeme()) {
+        path[i].field_slot = slot;
+        type = field.data_type;
+      }
+    }
+  }
+}
+
+
 void SemanticChecker::error(const string& msg, const Token& token)
 {
   string s = msg;
@@ -309,6 +328,7 @@ void SemanticChecker::visit(AssignStmt& s){
         left_type = {return_array, var_type -> type_name};
       }
     } 
+    set_field_slots(s.lvalue);
   }
   s.expr.accept(*this);
   if(curr_type.type_name != left_type.type_name || curr_type.is_array != left_type.is_array){
@@ -347,6 +367,17 @@ void SemanticChecker::visit(CallExpr& e){
       }
       curr_type = {false, "void"};
     }
+    // HEAP_DUMP
+    else if (fun_name == "heap_dump"){
+      if(e.args.size() != 1){
+        error("Invalid number of parameters (expected 1)", e.fun_name);
+      }
+      e.args[0].accept(*this);
+      if (curr_type.type_name != "string" || curr_type.is_array){
+        error("Invalid parameter type (expected string)", e.fun_name);
+      }
+      curr_type = {false, "void"};
+    }
     // INPUT
     else if (fun_name == "input"){
       if(e.args.size() != 0){
@@ -605,6 +636,10 @@ void SemanticChecker::visit(Expr& e){
     e.rest -> accept(*this);
     DataType rhs_type = curr_type;
     string op = e.op -> lexeme();
+    // records the operand type (lets the code generator specialize ops)
+    if(!lhs_type.is_array && !rhs_type.is_array && lhs_type.type_name == rhs_type.type_name){
+      e.op_type = lhs_type.type_name;
+    }
     // STANDARD MATH OPS
     if(op == "+" || op == "-" || op == "*" || op == "/"){
       if(lhs_type.type_name == rhs_type.type_name){
@@ -749,6 +784,7 @@ void SemanticChecker::visit(VarRValue& v){
         curr_type = {return_array, var_type -> type_name};
       }
     } 
+    set_field_slots(v.path);
   }
 }    
 
@@ -53,6 +53,9 @@ private:
   std::optional<VarDef> get_field(const StructDef& struct_def,
                                   const std::string& field_name);
 
+  // helper function to set the slot of each field in a path
+  void set_field_slots(std::vector<VarRef>& path);
+
   // error helper functions
   void error(const std::string& msg, const Token& token);
   void error(const std::string& msg);
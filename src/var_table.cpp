@@ -49,6 +49,12 @@ int VarTable::get(const string& name) const
 }
 
 
+int VarTable::size() const
+{
+  return next_index;
+}
+
+
 string to_string(const VarTable& var_table)
 {
   string str = "";
@@ -5,14 +5,56 @@
 // DESC: VM Operations for mypl
 //----------------------------------------------------------------------
 
+#include <algorithm>
+#include <chrono>
 #include <iostream>
+#include <unordered_set>
 #include "vm.h"
+#include "vm_execute.h"
+#include "heap_snapshot.h"
 #include "mypl_exception.h"
 
 
 using namespace std;
 
 
+// Instruction dispatch. With GCC/Clang each handler jumps directly to
+// the next handler through a table of label addresses (threaded
+// code); otherwise the handlers are the cases of a dense switch. Note
+// that VM_NEXT() must be used outside of a handler's block so that
+// its locals are destroyed before the (computed) jump. Define
+// VM_SWITCH_DISPATCH to force the switch version.
+#if (defined(__GNUC__) || defined(__clang__)) && !defined(VM_SWITCH_DISPATCH)
+#define VM_THREADED_DISPATCH
+#endif
+
+// fetch the next instruction (halting when there is none left)
+#define VM_FETCH()                                                      \
+  if (call_stack.empty() or                                             \
+      frame->pc >= frame->info->instructions.size())                    \
+    goto vm_halt;                                                       \
+  instr = &frame->info->instructions[frame->pc++];                      \
+  ++executed;                                                           \
+  if (DEBUG)                                                            \
+    trace(*frame, *instr)
+
+#ifdef VM_THREADED_DISPATCH
+#define VM_CASE(op) op_##op
+#define VM_NEXT()                                                       \
+  VM_FETCH();                                                           \
+  goto *dispatch_table[static_cast<int>(instr->opcode())]
+#else
+#define VM_CASE(op) case OpCode::op
+#define VM_NEXT() goto vm_fetch
+#endif
+
+// a handler that just performs the instruction (see vm_execute.h)
+#define VM_EXECUTE(op)                                                  \
+  VM_CASE(op):                                                          \
+    execute<OpCode::op>(frame, instr);                                  \
+  VM_NEXT()
+
+
 void VM::error(string msg) const
 {
   throw MyPLException::VMError(msg);
@@ -22,8 +64,8 @@ void VM::error(string msg) const
 void VM::error(string msg, const VMFrame& frame) const
 {
   int pc = frame.pc - 1;
-  VMInstr instr = frame.info.instructions[pc];
-  string name = frame.info.function_name;
+  const VMInstr& instr = frame.info->instructions[pc];
+  string name = frame.info->function_name;
   msg += " (in " + name + " at " + to_string(pc) + ": " +
     to_string(instr) + ")";
   throw MyPLException::VMError(msg);
@@ -33,10 +75,8 @@ void VM::error(string msg, const VMFrame& frame) const
 string to_string(const VM& vm)
 {
   string s = "";
-  for (const auto& entry : vm.frame_info) {
-    const string& name = entry.first;
-    s += "\nFrame '" + name + "'\n";
-    const VMFrameInfo& frame = entry.second;
+  for (const VMFrameInfo& frame : vm.frame_info) {
+    s += "\nFrame '" + frame.function_name + "'\n";
     for (int i = 0; i < frame.instructions.size(); ++i) {
       VMInstr instr = frame.instructions[i];
       s += "  " + to_string(i) + ": " + to_string(instr) + "\n"; 
@@ -48,827 +88,995 @@ string to_string(const VM& vm)
 
 void VM::add(const VMFrameInfo& frame)
 {
-  frame_info[frame.function_name] = frame;
+  if (!frame_index.contains(frame.function_name)) {
+    frame_index[frame.function_name] = frame_info.size();
+    frame_info.push_back(frame);
+  }
+  VMFrameInfo& info = frame_info[frame_index[frame.function_name]];
+  info = frame;
+  linked = false;
+  // make sure every slot used fits in the frame's local variables
+  // (LOAD, STORE, and register operands don't check their slot index)
+  for (const VMInstr& instr : info.instructions) {
+    OpCode op = instr.opcode();
+    if (op == OpCode::LOAD or op == OpCode::STORE) {
+      int slot = instr.operand().value().as_int();
+      info.local_count = max(info.local_count, slot + 1);
+    }
+    // field instructions give a field slot, and the fused compare and
+    // jumps a jump target in their second register
+    if (op == OpCode::GETF or op == OpCode::SETF or op == OpCode::SETFN)
+      continue;
+    bool jump = op >= OpCode::CMPLTKJF and op <= OpCode::CMPNEKJF;
+    for (int i = 0; i < 3; ++i) {
+      if (instr.reg(i) != -1 and !(jump and i == 1))
+        info.local_count = max(info.local_count, instr.reg(i) + 1);
+    }
+  }
 }
 
 
-void VM::run(bool DEBUG)
+void VM::add_struct(const string& struct_name, const vector<string>& fields)
 {
-  // grab the "main" frame if it exists
-  if (!frame_info.contains("main"))
-    error("No 'main' function");
-  shared_ptr<VMFrame> frame = make_shared<VMFrame>();
-  frame->info = frame_info["main"];
-  call_stack.push(frame);
+  int shape = 0;
+  for (const string& field : fields)
+    shape = add_field(shape, field);
+  struct_shape[struct_name] = shape;
+  linked = false;
+}
 
-  // run loop (keep going until we run out of instructions)
-  while (!call_stack.empty() and frame->pc < frame->info.instructions.size()) {
-
-    // get the next instruction
-    VMInstr& instr = frame->info.instructions[frame->pc];
-
-    // increment the program counter
-    ++frame->pc;
-
-    // for debugging
-    if (DEBUG) {
-      cerr << endl << endl;
-      cerr << "\t FRAME.........: " << frame->info.function_name << endl;
-      cerr << "\t PC............: " << (frame->pc - 1) << endl;
-      cerr << "\t INSTR.........: " << to_string(instr) << endl;
-      cerr << "\t NEXT OPERAND..: ";
-      if (!frame->operand_stack.empty())
-        cerr << to_string(frame->operand_stack.top()) << endl;
-      else
-        cerr << "empty" << endl;
-      cerr << "\t NEXT FUNCTION.: ";
-      if (!call_stack.empty())
-        cerr << call_stack.top()->info.function_name << endl;
-      else
-        cerr << "empty" << endl;
-    }
 
-    //----------------------------------------------------------------------
-    // Literals and Variables
-    //----------------------------------------------------------------------
+int VM::add_field(int shape, const string& field)
+{
+  if (shapes[shape].slots.contains(field))
+    return shape;
+  auto transition = shapes[shape].transitions.find(field);
+  if (transition != shapes[shape].transitions.end())
+    return transition->second;
+  VMShape next = shapes[shape];
+  next.transitions.clear();
+  next.slots[field] = next.fields.size();
+  next.fields.push_back(field);
+  int index = shapes.size();
+  shapes[shape].transitions[field] = index;
+  shapes.push_back(next);
+  return index;
+}
 
-    if (instr.opcode() == OpCode::PUSH) {
-      frame->operand_stack.push(instr.operand().value());
-    }
 
-    else if (instr.opcode() == OpCode::POP) {
-      frame->operand_stack.pop();
-    }
+int VM::field_slot(const VMFrame& f, const VMStruct& obj,
+                   const VMInstr& instr) const
+{
+  int slot = instr.reg(0);
+  if (slot >= 0 and slot < obj.slot_count)
+    return slot;
+  string field(instr.operand().value().as_string());
+  auto entry = shapes[obj.shape].slots.find(field);
+  if (entry == shapes[obj.shape].slots.end())
+    error("undefined field '" + field + "'", f);
+  return entry->second;
+}
 
-    else if (instr.opcode() == OpCode::LOAD){
-      int var_location = get<int>(instr.operand().value());
-      frame->operand_stack.push(frame->variables[var_location]);
-    }
 
-    else if (instr.opcode() == OpCode::STORE){
-      VMValue x = frame->operand_stack.top();
-      frame->operand_stack.pop();
-      int var_location = get<int>(instr.operand().value());
-      if(var_location >= frame->variables.size()){
-        frame->variables.push_back(x);
-      }
-      else{
-        frame->variables[var_location] = x;
-      }
-    }
+void VM::set_gc_threshold(int objects)
+{
+  gc_threshold = objects;
+}
 
-    //----------------------------------------------------------------------
-    // Operations
-    //----------------------------------------------------------------------
 
-    else if (instr.opcode() == OpCode::ADD) {
-      VMValue x = frame->operand_stack.top();
-      ensure_not_null(*frame, x);
-      frame->operand_stack.pop();
-      VMValue y = frame->operand_stack.top();
-      ensure_not_null(*frame, y);
-      frame->operand_stack.pop();
-      frame->operand_stack.push(add(y, x));
-    }
+string VM::gc_stats() const
+{
+  string s = "GC stats:\n";
+  s += "  collections: " + to_string(gc_collections) + "\n";
+  s += "  minor collections: " + to_string(gc_minor_collections) + "\n";
+  s += "  objects freed: " + to_string(gc_freed) + "\n";
+  s += "  live objects: " + to_string(heap_size()) + "\n";
+  s += "  peak objects: " + to_string(max(gc_peak, heap_size())) + "\n";
+  s += "  pause time: " + to_string(gc_seconds * 1000) + " ms\n";
+  return s;
+}
 
-    else if (instr.opcode() == OpCode::SUB){
-      VMValue x = frame->operand_stack.top();
-      ensure_not_null(*frame, x);
-      frame->operand_stack.pop();
-      VMValue y = frame->operand_stack.top();
-      ensure_not_null(*frame, y);
-      frame->operand_stack.pop();
-      frame->operand_stack.push(sub(y, x));
-    }
 
-    else if (instr.opcode() == OpCode::MUL){
-      VMValue x = frame->operand_stack.top();
-      ensure_not_null(*frame, x);
-      frame->operand_stack.pop();
-      VMValue y = frame->operand_stack.top();
-      ensure_not_null(*frame, y);
-      frame->operand_stack.pop();
-      frame->operand_stack.push(mul(y, x));
-    }
+void VM::set_max_heap(size_t bytes)
+{
+  max_heap = bytes;
+}
 
-    else if (instr.opcode() == OpCode::DIV){
-      VMValue x = frame->operand_stack.top();
-      ensure_not_null(*frame, x);
-      frame->operand_stack.pop();
-      VMValue y = frame->operand_stack.top();
-      ensure_not_null(*frame, y);
-      frame->operand_stack.pop();
-      frame->operand_stack.push(div(y, x));
-    }
 
-    else if (instr.opcode() == OpCode::AND){
-      VMValue x = frame->operand_stack.top();
-      ensure_not_null(*frame, x);
-      frame->operand_stack.pop();
-      VMValue y = frame->operand_stack.top();
-      ensure_not_null(*frame, y);
-      frame->operand_stack.pop();
-      frame -> operand_stack.push(get<bool>(x) && get<bool>(y));
-    }
+void VM::set_output_buffer(size_t bytes, bool line_flush)
+{
+  output.configure(bytes, line_flush);
+}
 
-    else if (instr.opcode() == OpCode::OR){
-      VMValue x = frame->operand_stack.top();
-      ensure_not_null(*frame, x);
-      frame->operand_stack.pop();
-      VMValue y = frame->operand_stack.top();
-      ensure_not_null(*frame, y);
-      frame->operand_stack.pop();
-      frame -> operand_stack.push(get<bool>(x) || get<bool>(y));
-    }
 
-    else if (instr.opcode() == OpCode::NOT){
-      VMValue x = frame->operand_stack.top();
-      ensure_not_null(*frame, x);
-      frame->operand_stack.pop();
-      frame -> operand_stack.push(!get<bool>(x));
-    }
+string VM::memory_stats() const
+{
+  const char* names[] = {"", "structs", "arrays", "lists"};
+  string s = "Memory stats:\n";
+  for (int kind = 1; kind < 4; ++kind)
+    s += "  " + string(names[kind]) + ": " + to_string(kind_objects[kind]) +
+      " objects, " + to_string(kind_bytes[kind]) + " bytes\n";
+  const VMStringTable& strings = VMStringTable::instance();
+  size_t refs = strings.reference_count();
+  s += "  strings: " + to_string(max(0, strings.size() - strings_base)) +
+    " strings, " + to_string(refs > string_refs_base ?
+                             refs - string_refs_base : 0) + " references, " +
+    to_string(heap_bytes() - kind_bytes[1] - kind_bytes[2] - kind_bytes[3]) +
+    " bytes\n";
+  s += "  total: " + to_string(heap_bytes()) + " bytes\n";
+  s += "  peak: " + to_string(max(heap_peak, heap_bytes())) + " bytes\n";
+  s += "  limit: " + (max_heap ? to_string(max_heap) + " bytes" : "none") +
+    "\n";
+  return s;
+}
 
-    else if (instr.opcode() == OpCode::CMPLT){
-      VMValue x = frame->operand_stack.top();
-      ensure_not_null(*frame, x);
-      frame->operand_stack.pop();
-      VMValue y = frame->operand_stack.top();
-      ensure_not_null(*frame, y);
-      frame->operand_stack.pop();
-      frame->operand_stack.push(lt(y, x));
-    }
 
-    else if (instr.opcode() == OpCode::CMPLE){
-      VMValue x = frame->operand_stack.top();
-      ensure_not_null(*frame, x);
-      frame->operand_stack.pop();
-      VMValue y = frame->operand_stack.top();
-      ensure_not_null(*frame, y);
-      frame->operand_stack.pop();
-      frame->operand_stack.push(le(y, x));
-    }
+size_t VM::object_bytes(const VMObject& entry) const
+{
+  if (entry.kind == VMObject::Kind::STRUCT)
+    return sizeof(VMStruct) + entry.struct_obj->slot_count * sizeof(VMValue);
+  if (entry.kind == VMObject::Kind::ARRAY)
+    return sizeof(VMArray) + entry.array->size() * sizeof(VMValue);
+  if (entry.kind == VMObject::Kind::LIST)
+    return sizeof(VMList) + entry.list->bytes();
+  return 0;
+}
 
-    else if (instr.opcode() == OpCode::CMPGT){
-      VMValue x = frame->operand_stack.top();
-      ensure_not_null(*frame, x);
-      frame->operand_stack.pop();
-      VMValue y = frame->operand_stack.top();
-      ensure_not_null(*frame, y);
-      frame->operand_stack.pop();
-      frame->operand_stack.push(gt(y, x));
-    }
-    
-    else if (instr.opcode() == OpCode::CMPGE){
-      VMValue x = frame->operand_stack.top();
-      ensure_not_null(*frame, x);
-      frame->operand_stack.pop();
-      VMValue y = frame->operand_stack.top();
-      ensure_not_null(*frame, y);
-      frame->operand_stack.pop();
-      frame->operand_stack.push(ge(y, x));
-    }
 
-    else if (instr.opcode() == OpCode::CMPEQ){
-      VMValue x = frame->operand_stack.top();
-      frame->operand_stack.pop();
-      VMValue y = frame->operand_stack.top();
-      frame->operand_stack.pop();
-      frame->operand_stack.push(eq(y, x));
-    }
+size_t VM::heap_bytes() const
+{
+  size_t strings = VMStringTable::instance().byte_count();
+  return kind_bytes[1] + kind_bytes[2] + kind_bytes[3] +
+    (strings > string_bytes_base ? strings - string_bytes_base : 0);
+}
 
-    else if (instr.opcode() == OpCode::CMPNE){
-      VMValue x = frame->operand_stack.top();
-      frame->operand_stack.pop();
-      VMValue y = frame->operand_stack.top();
-      frame->operand_stack.pop();
-      frame->operand_stack.push(ne(y, x));
-    }
 
-    //----------------------------------------------------------------------
-    // Branching
-    //----------------------------------------------------------------------
+void VM::list_resized(const VMFrame& f, const VMList& list,
+                      size_t old_bytes)
+{
+  size_t bytes = list.bytes();
+  if (bytes != old_bytes) {
+    account(VMObject::Kind::LIST, ptrdiff_t(bytes) - ptrdiff_t(old_bytes));
+    check_heap(f);
+  }
+}
 
-    else if (instr.opcode() == OpCode::JMP){
-      frame->pc = get<int>(instr.operand().value());
-    }
-    
-    else if (instr.opcode() == OpCode::JMPF){
-      VMValue x = frame->operand_stack.top();
-      ensure_not_null(*frame, x);
-      frame->operand_stack.pop();
-      if (!get<bool>(x)){
-        frame->pc = get<int>(instr.operand().value());
-      }
-    }
 
-    //----------------------------------------------------------------------
-    // Functions
-    //----------------------------------------------------------------------
+void VM::enforce_max_heap(const VMFrame& f, size_t extra)
+{
+  size_t bytes = heap_bytes();
+  if (bytes + extra <= max_heap)
+    return;
+  if (gc_threshold >= 0) {
+    collect();
+    bytes = heap_bytes();
+  }
+  if (bytes + extra > max_heap)
+    error("out of memory (heap limit of " + to_string(max_heap) +
+          " bytes exceeded)", f);
+}
 
-    else if (instr.opcode() == OpCode::CALL){
-      string fun_name = get<string>(instr.operand().value());
-      shared_ptr<VMFrame> new_frame = make_shared<VMFrame>();
-      new_frame->info = frame_info[fun_name]; 
-      call_stack.push(new_frame);
-      for (int i = 0; i < new_frame->info.arg_count; i++){
-        VMValue x = frame -> operand_stack.top();
-        new_frame->operand_stack.push(x);
-        frame->operand_stack.pop();
-      }
-      frame = new_frame;
-    }
 
-    else if (instr.opcode() == OpCode::RET){
-      VMValue x = frame->operand_stack.top();
-      frame->operand_stack.pop();
-      call_stack.pop();
-      if(call_stack.size() != 0){
-        frame = call_stack.top();
-        if(frame != nullptr){
-          frame->operand_stack.push(x);
-        }
-      }
-    }
-    
-    //----------------------------------------------------------------------
-    // Built in functions
-    //----------------------------------------------------------------------
+int VM::new_object(VMObject::Kind kind, int young_values)
+{
+  // young structs are left to minor collections
+  if (gc_threshold >= 0 and heap_size() - young_oids.size() >= gc_limit)
+    collect();
+  else if (gc_threshold >= 0 and nursery.exhausted(young_values))
+    minor_collect();
+  int oid = first_oid + objects.size();
+  if (free_oids.empty())
+    objects.emplace_back();
+  else {
+    oid = free_oids.back();
+    free_oids.pop_back();
+  }
+  VMObject& entry = objects[oid - first_oid];
+  entry.kind = kind;
+  if (kind == VMObject::Kind::STRUCT)
+    entry.struct_obj = struct_pool.acquire();
+  else if (kind == VMObject::Kind::ARRAY)
+    entry.array = array_pool.acquire();
+  else
+    entry.list = list_pool.acquire();
+  account(kind, object_bytes(entry));
+  ++kind_objects[static_cast<int>(kind)];
+  ++live_objects;
+  return oid;
+}
 
 
-    else if (instr.opcode() == OpCode::WRITE) {
-      VMValue x = frame->operand_stack.top();
-      frame->operand_stack.pop();
-      cout << to_string(x);
-    }
+void VM::free_object(int oid)
+{
+  VMObject& entry = objects[oid - first_oid];
+  account(entry.kind, -ptrdiff_t(object_bytes(entry)));
+  --kind_objects[static_cast<int>(entry.kind)];
+  if (entry.kind == VMObject::Kind::STRUCT)
+    struct_pool.release(entry.struct_obj);
+  else if (entry.kind == VMObject::Kind::ARRAY)
+    array_pool.release(entry.array);
+  else if (entry.kind == VMObject::Kind::LIST)
+    list_pool.release(entry.list);
+  entry = VMObject();
+  free_oids.push_back(oid);
+  --live_objects;
+}
 
-    else if (instr.opcode() == OpCode::READ) {
-      string val = "";
-      getline(cin, val);
-      frame->operand_stack.push(val);
-    }
-    
-    else if (instr.opcode() == OpCode::SLEN){
-      VMValue x = frame->operand_stack.top();
-      ensure_not_null(*frame, x);
-      frame->operand_stack.pop();
-      int len = to_string(x).length();
-      frame -> operand_stack.push(len);
-    }
 
-    else if (instr.opcode() == OpCode::ALEN){
-      VMValue x = frame->operand_stack.top();
-      ensure_not_null(*frame, x);
-      frame->operand_stack.pop();
-      int oid = get<int>(x);
-      vector<VMValue> array_for_len = array_heap.at(oid);
-      int len = array_for_len.size();
-      frame -> operand_stack.push(len);
-    }
+VMObject& VM::object(const VMFrame& f, const VMValue& ref,
+                     VMObject::Kind kind)
+{
+  // negative indexes wrap around to large ones
+  size_t index = static_cast<unsigned>(ref.as_int() - first_oid);
+  if (index >= objects.size() or objects[index].kind != kind)
+    error("invalid object reference", f);
+  return objects[index];
+}
 
-    else if (instr.opcode() == OpCode::GETC){
-      VMValue x = frame->operand_stack.top();
-      ensure_not_null(*frame, x);
-      frame->operand_stack.pop();
-      VMValue y = frame->operand_stack.top();
-      ensure_not_null(*frame, y);
-      frame->operand_stack.pop();
-      if (stoi(to_string(y)) > to_string(x).length() -1 || stoi(to_string(y)) < 0){
-        error("out-of-bounds string index", *frame);
-      }
-      string xstr = to_string(x);
-      int yint = get<int>(y);
-      string c = "";
-      c.push_back(xstr[yint]);
-      frame -> operand_stack.push(c);
-    }
 
-    else if (instr.opcode() == OpCode::TOINT){
-      VMValue x = frame->operand_stack.top();
-      ensure_not_null(*frame, x);
-      frame->operand_stack.pop();
-      if (holds_alternative<int>(x)) {
-        frame -> operand_stack.push(to_string(x));
-      }
-      else if (holds_alternative<string>(x)){
-        try{
-          frame -> operand_stack.push(stoi(to_string(x)));
-        }
-        catch (exception& e) {
-          error("cannot convert string to int", *frame);
-        }
-      }
-      else if (holds_alternative<double>(x)){
-        frame -> operand_stack.push(stoi(to_string(x)));
-      }
-      else if (holds_alternative<nullptr_t>(x)){
-        frame -> operand_stack.push(nullptr);
-      }
-    }
+template<typename Visit>
+void VM::for_each_value(int oid, Visit visit) const
+{
+  const VMObject& entry = objects[oid - first_oid];
+  if (entry.kind == VMObject::Kind::STRUCT) {
+    for (int i = 0; i < entry.struct_obj->slot_count; ++i)
+      visit(entry.struct_obj->slots[i]);
+  }
+  else if (entry.kind == VMObject::Kind::ARRAY) {
+    for (const VMValue& value : *entry.array)
+      visit(value);
+  }
+  else if (entry.kind == VMObject::Kind::LIST) {
+    for (const VMValue& value : entry.list->tagged_values())
+      visit(value);
+  }
+}
 
-    else if (instr.opcode() == OpCode::TODBL){
-      VMValue x = frame->operand_stack.top();
-      ensure_not_null(*frame, x);
-      frame->operand_stack.pop();
-      if (holds_alternative<int>(x)) {
-        frame -> operand_stack.push(stod(to_string(x)));
-      }
-      else if (holds_alternative<string>(x)){
-        try{
-          frame -> operand_stack.push(stod(to_string(x)));
-        }
-        catch (exception& e) {
-          error("cannot convert string to double", *frame);
-        }
-      }
-      else if (holds_alternative<nullptr_t>(x)){
-        frame -> operand_stack.push(nullptr);
-      }
-    }
 
-    else if (instr.opcode() == OpCode::TOSTR){
-      VMValue x = frame->operand_stack.top();
-      ensure_not_null(*frame, x);
-      frame->operand_stack.pop();
-      frame->operand_stack.push(to_string(x));
+bool VM::dump_heap(const string& path) const
+{
+  HeapSnapshotWriter out(path);
+  // structs are typed by shape (named if made by a struct type)
+  const int array_type = 0;
+  const int list_type = 1;
+  const int first_shape_type = 2;
+  vector<string> names(shapes.size());
+  for (const auto& [name, shape] : struct_shape)
+    names[shape] = name;
+  out.type(array_type, "array");
+  out.type(list_type, "list");
+  for (int shape = 0; shape < shapes.size(); ++shape) {
+    string name = names[shape];
+    if (name.empty()) {
+      name = "struct{";
+      for (const string& field : shapes[shape].fields)
+        name += (name.back() == '{' ? "" : ",") + field;
+      name += "}";
     }
+    out.type(first_shape_type + shape, name);
+  }
+  for (const VMValue& value : value_stack) {
+    if (value.is_ref())
+      out.root(value.as_int());
+  }
+  vector<uint32_t> refs;
+  for (int index = 0; index < objects.size() and out.ok(); ++index) {
+    const VMObject& entry = objects[index];
+    if (entry.kind == VMObject::Kind::FREE)
+      continue;
+    int type = entry.kind == VMObject::Kind::ARRAY ? array_type :
+      entry.kind == VMObject::Kind::LIST ? list_type :
+      first_shape_type + entry.struct_obj->shape;
+    refs.clear();
+    for_each_value(first_oid + index, [&](const VMValue& value) {
+      if (value.is_ref())
+        refs.push_back(value.as_int());
+    });
+    out.object(first_oid + index, type, object_bytes(entry), refs);
+  }
+  return out.finish();
+}
 
-    else if (instr.opcode() == OpCode::CONCAT){
-      VMValue x = frame->operand_stack.top();
-      ensure_not_null(*frame, x);
-      frame->operand_stack.pop();
-      VMValue y = frame->operand_stack.top();
-      ensure_not_null(*frame, y);
-      frame->operand_stack.pop();
-      frame->operand_stack.push(to_string(y) + to_string(x));
-    }
-    
-    //----------------------------------------------------------------------
-    // heap
-    //----------------------------------------------------------------------
 
-    else if (instr.opcode() == OpCode::ALLOCS){
-      std::unordered_map<std::string, VMValue> new_struct;
-      struct_heap.emplace(next_obj_id, new_struct);
-      frame->operand_stack.push(next_obj_id);
-      next_obj_id = next_obj_id + 1; 
+void VM::collect()
+{
+  auto start = chrono::steady_clock::now();
+  gc_peak = max(gc_peak, heap_size());
+  update_heap_peak();
+
+  // mark the objects reachable from the value stack (oids pushed as
+  // plain ints, e.g., by hand-written code, are not references)
+  vector<bool> marked(objects.size(), false);
+  vector<int> pending;
+  auto mark = [&](const VMValue& value) {
+    if (!value.is_ref())
+      return;
+    int index = value.as_int() - first_oid;
+    if (!marked[index]) {
+      marked[index] = true;
+      pending.push_back(value.as_int());
     }
+  };
+  for (const VMValue& value : value_stack)
+    mark(value);
+  while (!pending.empty()) {
+    int oid = pending.back();
+    pending.pop_back();
+    for_each_value(oid, mark);
+  }
 
-    else if (instr.opcode() == OpCode::ALLOCA){
-      VMValue x = frame->operand_stack.top();
-      frame->operand_stack.pop();
-      VMValue y = frame->operand_stack.top();
-      ensure_not_null(*frame, y);
-      frame->operand_stack.pop();
-      vector<VMValue> new_array (get<int>(y), x);
-      array_heap.emplace(next_obj_id, new_array);
-      frame->operand_stack.push(next_obj_id);
-      next_obj_id = next_obj_id + 1;  
+  // sweep the rest, their ids can be reused
+  for (int index = 0; index < objects.size(); ++index) {
+    if (objects[index].kind != VMObject::Kind::FREE and !marked[index]) {
+      free_object(first_oid + index);
+      ++gc_freed;
     }
+  }
 
-    // LISTS
-    else if (instr.opcode() == OpCode::ALLOCL){
-      std::unordered_map<int, VMValue> new_list;
-      list_heap.emplace(next_obj_id, new_list);
-      frame->operand_stack.push(next_obj_id);
-      next_obj_id = next_obj_id + 1;
-    }
+  // the nursery only holds garbage once the survivors are moved out
+  for (int oid : young_oids) {
+    VMObject& entry = objects[oid - first_oid];
+    if (entry.kind == VMObject::Kind::STRUCT)
+      promote(*entry.struct_obj);
+  }
+  young_oids.clear();
+  forget_remembered();
+  nursery.reset();
+
+  gc_limit = max<size_t>(gc_threshold, 2 * heap_size());
+  ++gc_collections;
+  gc_seconds += chrono::duration<double>(chrono::steady_clock::now() -
+                                         start).count();
+}
 
-    else if (instr.opcode() == OpCode::ADDLI){
-      VMValue x = frame->operand_stack.top();
-      ensure_not_null(*frame, x);
-      frame->operand_stack.pop();
-      list_heap.at(get<int>(x)).emplace(list_heap.at(get<int>(x)).size(), nullptr);   
-    }
 
-    else if (instr.opcode() == OpCode::SETLE){
-      VMValue x = frame->operand_stack.top();
-      frame->operand_stack.pop();
-      VMValue y = frame->operand_stack.top();
-      ensure_not_null(*frame, y);
-      frame->operand_stack.pop();
-      list_heap.at(get<int>(x))[list_heap.at(get<int>(x)).size() - 1] = y;
+void VM::minor_collect()
+{
+  auto start = chrono::steady_clock::now();
+  gc_peak = max(gc_peak, heap_size());
+  update_heap_peak();
+
+  // mark the young structs reachable from the value stack or from an old
+  // object that stored a reference since the last collection (old
+  // objects are assumed to be live)
+  vector<bool> marked(objects.size(), false);
+  vector<int> pending;
+  auto mark = [&](const VMValue& value) {
+    if (!value.is_ref())
+      return;
+    int index = value.as_int() - first_oid;
+    const VMObject& entry = objects[index];
+    if (entry.kind == VMObject::Kind::STRUCT and entry.struct_obj->young and
+        !marked[index]) {
+      marked[index] = true;
+      pending.push_back(value.as_int());
     }
+  };
+  for (const VMValue& value : value_stack)
+    mark(value);
+  for (int oid : remembered)
+    for_each_value(oid, mark);
+  while (!pending.empty()) {
+    int oid = pending.back();
+    pending.pop_back();
+    for_each_value(oid, mark);
+  }
 
-    else if (instr.opcode() == OpCode::SETLI){
-      VMValue x = frame->operand_stack.top();
-      frame->operand_stack.pop();
-      VMValue y = frame->operand_stack.top();
-      ensure_not_null(*frame, y);
-      frame->operand_stack.pop();
-      VMValue z = frame->operand_stack.top();
-      ensure_not_null(*frame, z);
-      frame->operand_stack.pop();
-      list_heap.at(get<int>(z))[get<int>(y)] = x;
+  // promote the survivors and free the rest
+  for (int oid : young_oids) {
+    VMObject& entry = objects[oid - first_oid];
+    if (entry.kind != VMObject::Kind::STRUCT or !entry.struct_obj->young)
+      continue;
+    if (marked[oid - first_oid])
+      promote(*entry.struct_obj);
+    else {
+      free_object(oid);
+      ++gc_freed;
     }
+  }
+  young_oids.clear();
+  forget_remembered();
+  nursery.reset();
 
-    else if (instr.opcode() == OpCode::GETLI){
-      VMValue x = frame->operand_stack.top();
-      ensure_not_null(*frame, x);
-      frame->operand_stack.pop();
-      VMValue y = frame->operand_stack.top();
-      ensure_not_null(*frame, y);
-      frame->operand_stack.pop();
-      VMValue value = list_heap.at(get<int>(y)).at(get<int>(x));
-      if (holds_alternative<int>(value)){
-        frame->operand_stack.push(get<int>(value));
-      }
-      else if (holds_alternative<bool>(value)){
-        frame->operand_stack.push(get<bool>(value));
-      }
-      else if (holds_alternative<string>(value)){
-        frame->operand_stack.push(get<string>(value));
-      }
-      else if (holds_alternative<double>(value)){
-        frame->operand_stack.push(get<double>(value));
-      }
-      else {
-        frame->operand_stack.push(get<nullptr_t>(value));
-      }
-    }
+  ++gc_minor_collections;
+  gc_seconds += chrono::duration<double>(chrono::steady_clock::now() -
+                                         start).count();
+}
 
-    else if (instr.opcode() == OpCode::LNUMI){
-      VMValue x = frame->operand_stack.top();
-      ensure_not_null(*frame, x);
-      frame->operand_stack.pop();
-      int num = 0;
-      int size = list_heap.at(get<int>(x)).size();
-      VMValue value;
-      for (int i = 0; i < size; i++){
-        value = list_heap.at(get<int>(x)).at(i);
-        if (holds_alternative<int>(value)){
-          num++;
-        }
-      }
-      frame->operand_stack.push(num);
-    }
 
-    else if (instr.opcode() == OpCode::LNUMD){
-      VMValue x = frame->operand_stack.top();
-      ensure_not_null(*frame, x);
-      frame->operand_stack.pop();
-      int num = 0;
-      int size = list_heap.at(get<int>(x)).size();
-      VMValue value;
-      for (int i = 0; i < size; i++){
-        value = list_heap.at(get<int>(x)).at(i);
-        if (holds_alternative<double>(value)){
-          num++;
-        }
-      }
-      frame->operand_stack.push(num);
-    }
+void VM::forget_remembered()
+{
+  for (int oid : remembered)
+    objects[oid - first_oid].remembered = false;
+  remembered.clear();
+}
 
-    else if (instr.opcode() == OpCode::LNUMS){
-      VMValue x = frame->operand_stack.top();
-      ensure_not_null(*frame, x);
-      frame->operand_stack.pop();
-      int num = 0;
-      int size = list_heap.at(get<int>(x)).size();
-      VMValue value;
-      for (int i = 0; i < size; i++){
-        value = list_heap.at(get<int>(x)).at(i);
-        if (holds_alternative<string>(value)){
-          num++;
-        }
-      }
-      frame->operand_stack.push(num);
-    }
 
-    else if (instr.opcode() == OpCode::LNUMB){
-      VMValue x = frame->operand_stack.top();
-      ensure_not_null(*frame, x);
-      frame->operand_stack.pop();
-      int num = 0;
-      int size = list_heap.at(get<int>(x)).size();
-      VMValue value;
-      for (int i = 0; i < size; i++){
-        value = list_heap.at(get<int>(x)).at(i);
-        if (holds_alternative<bool>(value)){
-          num++;
-        }
-      }
-      frame->operand_stack.push(num);
+void VM::resize_slots(int oid, VMStruct& obj, int count, bool allocated)
+{
+  account(VMObject::Kind::STRUCT,
+          ptrdiff_t(count - obj.slot_count) * ptrdiff_t(sizeof(VMValue)));
+  // (a promoted struct stays old: its old referrers aren't remembered)
+  if (obj.young or allocated) {
+    if (VMValue* slots = nursery.allocate(count)) {
+      move(obj.slots, obj.slots + obj.slot_count, slots);
+      obj.slots = slots;
+      obj.slot_count = count;
+      if (!obj.young)
+        young_oids.push_back(oid);
+      obj.young = true;
+      return;
     }
+  }
+  // an object promoted between collections may refer to young objects
+  if (obj.young and !objects[oid - first_oid].remembered) {
+    objects[oid - first_oid].remembered = true;
+    remembered.push_back(oid);
+  }
+  promote(obj);
+  obj.storage.resize(count, nullptr);
+  obj.slots = obj.storage.data();
+  obj.slot_count = count;
+}
 
-    else if (instr.opcode() == OpCode::LRMB){
-      VMValue x = frame->operand_stack.top();
-      ensure_not_null(*frame, x);
-      frame->operand_stack.pop();
-      int size = list_heap.at(get<int>(x)).size();
-      list_heap.at(get<int>(x)).erase(size - 1);
-    }
-    
-    else if (instr.opcode() == OpCode::LAVGI){
-      VMValue x = frame->operand_stack.top();
-      ensure_not_null(*frame, x);
-      frame->operand_stack.pop();
-      int num = 0;
-      int sum = 0;
-      int size = list_heap.at(get<int>(x)).size();
-      VMValue value;
-      for (int i = 0; i < size; i++){
-        value = list_heap.at(get<int>(x)).at(i);
-        if (holds_alternative<int>(value)){
-          sum += get<int>(value);
-          num++;
-        }
-      }
-      if (num != 0){
-        frame->operand_stack.push(sum / num);
-      }
-      else {
-        frame->operand_stack.push(0);
-      }
-    }
 
-    else if (instr.opcode() == OpCode::LAVGD){
-      VMValue x = frame->operand_stack.top();
-      ensure_not_null(*frame, x);
-      frame->operand_stack.pop();
-      int num = 0;
-      double sum = 0.0;
-      int size = list_heap.at(get<int>(x)).size();
-      VMValue value;
-      for (int i = 0; i < size; i++){
-        value = list_heap.at(get<int>(x)).at(i);
-        if (holds_alternative<double>(value)){
-          sum += get<double>(value);
-          num++;
+void VM::promote(VMStruct& obj)
+{
+  if (!obj.young)
+    return;
+  obj.storage.assign(make_move_iterator(obj.slots),
+                     make_move_iterator(obj.slots + obj.slot_count));
+  obj.slots = obj.storage.data();
+  obj.young = false;
+}
+
+
+
+unsigned long long VM::instruction_count() const
+{
+  return executed;
+}
+
+
+void VM::set_jit_threshold(int calls)
+{
+  jit_threshold = calls;
+}
+
+
+int VM::jit_compiled_count() const
+{
+  return jit.compiled_count();
+}
+
+
+// the string literal as written in a program, e.g. for comments in
+// listings (escaping newlines, tabs, quotes, and backslashes)
+string escaped_literal(const string& literal)
+{
+  string s = "\"";
+  for (char c : literal) {
+    if (c == '\n')
+      s += "\\n";
+    else if (c == '\t')
+      s += "\\t";
+    else if (c == '"' or c == '\\')
+      s += string("\\") + c;
+    else
+      s += c;
+  }
+  return s + "\"";
+}
+
+
+void VM::link()
+{
+  // resolve each call's function name to its frame_info index (and
+  // each struct allocation's name to its shape), and move each pushed
+  // string literal into the frame's constant pool
+  for (VMFrameInfo& frame : frame_info) {
+    unordered_map<string, int> constant_index;
+    for (int i = 0; i < frame.constants.size(); ++i)
+      constant_index[string(frame.constants[i].as_string())] = i;
+    for (VMInstr& instr : frame.instructions) {
+      if (instr.opcode() == OpCode::PUSH and instr.operand()->is_string()) {
+        string literal(instr.operand()->as_string());
+        auto entry = constant_index.find(literal);
+        if (entry == constant_index.end()) {
+          entry = constant_index.emplace(literal, frame.constants.size()).first;
+          frame.constants.push_back(instr.operand().value());
         }
+        string comment = instr.comment();
+        instr = VMInstr::PUSHK(entry->second);
+        instr.set_comment(comment != "" ? comment : escaped_literal(literal));
+        continue;
       }
-      if (num != 0){
-        double avg = sum / double(num);
-        frame->operand_stack.push(avg);
-      }
-      else {
-        frame->operand_stack.push(0.0);
+      if (instr.opcode() == OpCode::ALLOCS and instr.operand() and
+          instr.operand().value().is_string()) {
+        string struct_name(instr.operand().value().as_string());
+        if (!struct_shape.contains(struct_name))
+          error("undefined struct '" + struct_name + "' (allocated in " +
+                frame.function_name + ")");
+        instr.set_operand(struct_shape[struct_name]);
+        if (instr.comment() == "")
+          instr.set_comment(struct_name);
+        continue;
       }
+      if (instr.opcode() != OpCode::CALL)
+        continue;
+      VMValue callee = instr.operand().value();
+      if (!callee.is_string())
+        continue;
+      string fun_name(callee.as_string());
+      if (!frame_index.contains(fun_name))
+        error("undefined function '" + fun_name + "' (called in " +
+              frame.function_name + ")");
+      instr.set_operand(frame_index[fun_name]);
+      if (instr.comment() == "")
+        instr.set_comment(fun_name);
     }
+  }
+  linked = true;
+}
 
-    else if (instr.opcode() == OpCode::LSIZE){
-      VMValue x = frame->operand_stack.top();
-      ensure_not_null(*frame, x);
-      frame->operand_stack.pop();
-      int size = list_heap.at(get<int>(x)).size();
-      frame->operand_stack.push(size);
-    }
 
-    else if (instr.opcode() == OpCode::LRETRIEVE){
-      VMValue x = frame->operand_stack.top();
-      ensure_not_null(*frame, x);
-      frame->operand_stack.pop();
-      VMValue y = frame->operand_stack.top();
-      ensure_not_null(*frame, y);
-      frame->operand_stack.pop();
-      int size = list_heap.at(get<int>(y)).size();
-      VMValue value;
-      if (get<int>(x) > size - 1){
-        value = list_heap.at(get<int>(y)).at(size - 1);
-      }
-      else{
-        value = list_heap.at(get<int>(y)).at(get<int>(x));
-      }
-      //retrieval
-      if (holds_alternative<int>(value)){
-        frame->operand_stack.push(get<int>(value));
-      }
-      else if (holds_alternative<string>(value)){
-        frame->operand_stack.push(get<string>(value));
-      }
-      else if (holds_alternative<double>(value)){
-        frame->operand_stack.push(get<double>(value));
-      }
-      else if (holds_alternative<bool>(value)){
-        frame->operand_stack.push(get<bool>(value));
-      }
-    }
-    //LISTS
+void VM::run(bool DEBUG)
+{
+  if (!linked)
+    link();
+  // grab the "main" frame if it exists
+  if (!frame_index.contains("main"))
+    error("No 'main' function");
+  value_stack.clear();
+  call_stack.clear();
+  gc_limit = max<size_t>(gc_threshold, heap_size());
+  gc_collections = gc_minor_collections = gc_freed = 0;
+  gc_peak = heap_size();
+  gc_seconds = 0;
+  string_bytes_base = VMStringTable::instance().byte_count();
+  strings_base = VMStringTable::instance().size();
+  string_refs_base = VMStringTable::instance().reference_count();
+  heap_peak = heap_bytes();
+  VMFrame main_frame;
+  main_frame.info = &frame_info[frame_index["main"]];
+  value_stack.resize(main_frame.info->local_count, nullptr);
+  call_stack.push_back(main_frame);
+  VMFrame* frame = &call_stack.back();
+
+  // the output is flushed however the run ends (including errors)
+  struct FlushOutput {
+    VMOutput& output;
+    ~FlushOutput() {output.flush();}
+  } flush_output{output};
+
+  // the instruction currently being executed
+  const VMInstr* instr = nullptr;
+
+#ifdef VM_THREADED_DISPATCH
+  // handler addresses indexed by opcode (must follow OpCode order)
+  static void* dispatch_table[] = {
+    &&op_PUSH, &&op_POP, &&op_LOAD, &&op_STORE, &&op_ADD, &&op_SUB,
+    &&op_MUL, &&op_DIV, &&op_AND, &&op_OR, &&op_NOT, &&op_CMPLT,
+    &&op_CMPLE, &&op_CMPGT, &&op_CMPGE, &&op_CMPEQ, &&op_CMPNE,
+    &&op_JMP, &&op_JMPF, &&op_CALL, &&op_RET, &&op_WRITE, &&op_READ,
+    &&op_SLEN, &&op_ALEN, &&op_GETC, &&op_TOINT, &&op_TODBL,
+    &&op_TOSTR, &&op_CONCAT, &&op_ALLOCS, &&op_ALLOCA, &&op_ALLOCL,
+    &&op_ADDLI, &&op_SETLE, &&op_SETLI, &&op_GETLI, &&op_LNUMI,
+    &&op_LNUMD, &&op_LNUMS, &&op_LNUMB, &&op_LRMB, &&op_LAVGI,
+    &&op_LAVGD, &&op_LSIZE, &&op_LRETRIEVE, &&op_ADDF, &&op_SETF,
+    &&op_GETF, &&op_SETI, &&op_GETI, &&op_DUP, &&op_NOP, &&op_MOVR,
+    &&op_MOVK, &&op_ADDR, &&op_SUBR, &&op_MULR, &&op_DIVR, &&op_ANDR,
+    &&op_ORR, &&op_NOTR, &&op_CMPLTR, &&op_CMPLER, &&op_CMPGTR,
+    &&op_CMPGER, &&op_CMPEQR, &&op_CMPNER, &&op_JMPFR, &&op_CMPLTKJF,
+    &&op_CMPLEKJF, &&op_CMPGTKJF, &&op_CMPGEKJF, &&op_CMPEQKJF,
+    &&op_CMPNEKJF, &&op_ADDK, &&op_SUBK, &&op_SETFN, &&op_ADDI,
+    &&op_ADDD, &&op_SUBI, &&op_SUBD, &&op_MULI, &&op_MULD, &&op_DIVI,
+    &&op_DIVD, &&op_CMPLTI, &&op_CMPLTD, &&op_CMPLEI, &&op_CMPLED,
+    &&op_CMPGTI, &&op_CMPGTD, &&op_CMPGEI, &&op_CMPGED, &&op_ADDLE,
+    &&op_HDUMP, &&op_PUSHK
+  };
+  static_assert(sizeof(dispatch_table) / sizeof(dispatch_table[0]) ==
+                static_cast<int>(OpCode::PUSHK) + 1);
+#endif
+
+  // hot functions run as native code (not while tracing)
+  bool use_jit = jit_threshold >= 0 and !DEBUG and VMJit::supported();
+  if (use_jit) {
+    jit.reset(frame_info.size());
+    if (jit.called(frame_index["main"], *frame->info, jit_threshold))
+      goto vm_native;
+  }
 
-    else if (instr.opcode() == OpCode::ADDF){
-      VMValue x = frame->operand_stack.top();
-      ensure_not_null(*frame, x);
-      frame->operand_stack.pop();
-      struct_heap.at(get<int>(x)).emplace(get<string>(instr.operand().value()), nullptr);
-    }
+  // run loop (keep going until we run out of instructions)
+ vm_fetch:
+  VM_FETCH();
+#ifdef VM_THREADED_DISPATCH
+  goto *dispatch_table[static_cast<int>(instr->opcode())];
+#else
+  switch (instr->opcode()) {
+#endif
 
-    else if (instr.opcode() == OpCode::SETF){
-      VMValue x = frame->operand_stack.top();
-      frame->operand_stack.pop();
-      VMValue y = frame->operand_stack.top();
-      ensure_not_null(*frame, y);
-      frame->operand_stack.pop();
-      struct_heap.at(get<int>(y)).at(get<string>(instr.operand().value())) = x;
-    }
+    //----------------------------------------------------------------------
+    // Literals and Variables
+    //----------------------------------------------------------------------
+
+    VM_EXECUTE(PUSH);
+    VM_EXECUTE(PUSHK);
+    VM_EXECUTE(POP);
+    VM_EXECUTE(LOAD);
+    VM_EXECUTE(STORE);
+
+    //----------------------------------------------------------------------
+    // Operations
+    //----------------------------------------------------------------------
+
+    VM_EXECUTE(ADD);
+    VM_EXECUTE(SUB);
+    VM_EXECUTE(MUL);
+    VM_EXECUTE(DIV);
+    VM_EXECUTE(AND);
+    VM_EXECUTE(OR);
+    VM_EXECUTE(NOT);
+    VM_EXECUTE(CMPLT);
+    VM_EXECUTE(CMPLE);
+    VM_EXECUTE(CMPGT);
+    VM_EXECUTE(CMPGE);
+    VM_EXECUTE(CMPEQ);
+    VM_EXECUTE(CMPNE);
 
-    else if (instr.opcode() == OpCode::GETF){
-      VMValue x = frame->operand_stack.top();
-      ensure_not_null(*frame, x);
-      frame->operand_stack.pop();
-      frame->operand_stack.push(struct_heap.at(get<int>(x)).at(get<string>(instr.operand().value())));
+    //----------------------------------------------------------------------
+    // Branching
+    //----------------------------------------------------------------------
+
+    VM_CASE(JMP): {
+      frame->pc = instr->operand().value().as_int();
     }
+    VM_NEXT();
+    
+    VM_EXECUTE(JMPF);
 
-    else if (instr.opcode() == OpCode::SETI){
-      VMValue x = frame->operand_stack.top();
-      ensure_not_null(*frame, x);
-      frame->operand_stack.pop();
-      VMValue y = frame->operand_stack.top();
-      ensure_not_null(*frame, y);
-      frame->operand_stack.pop();
-      VMValue z = frame->operand_stack.top();
-      ensure_not_null(*frame, z);
-      frame->operand_stack.pop();
-      if(get<int>(y) >= array_heap.at(get<int>(z)).size() || get<int>(y) < 0){
-        error("out-of-bounds array index", *frame);
-      }
-      array_heap.at(get<int>(z))[get<int>(y)] = x;
+    //----------------------------------------------------------------------
+    // Functions
+    //----------------------------------------------------------------------
+
+    VM_CASE(CALL): {
+      VMFrame new_frame;
+      new_frame.info = &frame_info[instr->operand().value().as_int()];
+      // the arguments on top of the stack become the callee's operand
+      // stack (first argument on top), with its locals just below them
+      new_frame.base = value_stack.size() - new_frame.info->arg_count;
+      reverse(value_stack.begin() + new_frame.base, value_stack.end());
+      value_stack.insert(value_stack.begin() + new_frame.base,
+                         new_frame.info->local_count, nullptr);
+      call_stack.push_back(new_frame);
+      frame = &call_stack.back();
+      if (use_jit and jit.called(instr->operand().value().as_int(),
+                                 *frame->info, jit_threshold))
+        goto vm_native;
     }
+    VM_NEXT();
 
-    else if (instr.opcode() == OpCode::GETI){
-      VMValue x = frame->operand_stack.top();
-      ensure_not_null(*frame, x);
-      frame->operand_stack.pop();
-      VMValue y = frame->operand_stack.top();
-      ensure_not_null(*frame, y);
-      frame->operand_stack.pop();
-      if(get<int>(x) >= array_heap.at(get<int>(y)).size() || get<int>(x) < 0){
-        error("out-of-bounds array index", *frame);
+    VM_CASE(RET): {
+      VMValue x = value_stack.back();
+      value_stack.erase(value_stack.begin() + frame->base, value_stack.end());
+      call_stack.pop_back();
+      if(call_stack.size() != 0){
+        frame = &call_stack.back();
+        value_stack.push_back(x);
+        if (use_jit and jit.code(frame->info - frame_info.data()))
+          goto vm_native;
       }
-      frame->operand_stack.push(array_heap.at(get<int>(y))[get<int>(x)]);
     }
+    VM_NEXT();
     
     //----------------------------------------------------------------------
-    // special
+    // Built in functions
     //----------------------------------------------------------------------
 
+
+    VM_EXECUTE(WRITE);
+    VM_EXECUTE(READ);
+    VM_EXECUTE(SLEN);
+    VM_EXECUTE(ALEN);
+    VM_EXECUTE(GETC);
+    VM_EXECUTE(TOINT);
+    VM_EXECUTE(TODBL);
+    VM_EXECUTE(TOSTR);
+    VM_EXECUTE(CONCAT);
     
-    else if (instr.opcode() == OpCode::DUP) {
-      VMValue x = frame->operand_stack.top();
-      frame->operand_stack.pop();
-      frame->operand_stack.push(x);
-      frame->operand_stack.push(x);      
-    }
+    //----------------------------------------------------------------------
+    // heap
+    //----------------------------------------------------------------------
 
-    else if (instr.opcode() == OpCode::NOP) {
-      // do nothing
-    }
+    VM_EXECUTE(ALLOCS);
+    VM_EXECUTE(ALLOCA);
+
+    // LISTS
+    VM_EXECUTE(ALLOCL);
+
+    // (list operands are popped after the heap check so that the list
+    // isn't collected)
+    VM_EXECUTE(ADDLI);
+    VM_EXECUTE(SETLE);
+    VM_EXECUTE(SETLI);
+    VM_EXECUTE(GETLI);
+    VM_EXECUTE(LNUMI);
+    VM_EXECUTE(LNUMD);
+    VM_EXECUTE(LNUMS);
+    VM_EXECUTE(LNUMB);
+    VM_EXECUTE(LRMB);
+    VM_EXECUTE(LAVGI);
+    VM_EXECUTE(LAVGD);
+    VM_EXECUTE(LSIZE);
+    VM_EXECUTE(LRETRIEVE);
+    //LISTS
+
+    VM_EXECUTE(ADDF);
+    VM_EXECUTE(SETF);
+    VM_EXECUTE(GETF);
+    VM_EXECUTE(SETI);
+    VM_EXECUTE(GETI);
     
-    else {
-      error("unsupported operation " + to_string(instr));
+    //----------------------------------------------------------------------
+    // special
+    //----------------------------------------------------------------------
+
+    
+    VM_EXECUTE(DUP);
+    VM_EXECUTE(NOP);
+
+    //----------------------------------------------------------------------
+    // registers
+    //----------------------------------------------------------------------
+
+    VM_EXECUTE(MOVR);
+    VM_EXECUTE(MOVK);
+    VM_EXECUTE(ADDR);
+    VM_EXECUTE(SUBR);
+    VM_EXECUTE(MULR);
+    VM_EXECUTE(DIVR);
+    VM_EXECUTE(ANDR);
+    VM_EXECUTE(ORR);
+    VM_EXECUTE(NOTR);
+    VM_EXECUTE(CMPLTR);
+    VM_EXECUTE(CMPLER);
+    VM_EXECUTE(CMPGTR);
+    VM_EXECUTE(CMPGER);
+    VM_EXECUTE(CMPEQR);
+    VM_EXECUTE(CMPNER);
+    VM_EXECUTE(JMPFR);
+
+    //----------------------------------------------------------------------
+    // superinstructions (constants are never null, see Peephole)
+    //----------------------------------------------------------------------
+
+    VM_EXECUTE(CMPLTKJF);
+    VM_EXECUTE(CMPLEKJF);
+    VM_EXECUTE(CMPGTKJF);
+    VM_EXECUTE(CMPGEKJF);
+    VM_EXECUTE(CMPEQKJF);
+    VM_EXECUTE(CMPNEKJF);
+    VM_EXECUTE(ADDK);
+    VM_EXECUTE(SUBK);
+    VM_EXECUTE(SETFN);
+
+    //----------------------------------------------------------------------
+    // typed operations
+    //----------------------------------------------------------------------
+
+    VM_EXECUTE(ADDI);
+    VM_EXECUTE(ADDD);
+    VM_EXECUTE(SUBI);
+    VM_EXECUTE(SUBD);
+    VM_EXECUTE(MULI);
+    VM_EXECUTE(MULD);
+    VM_EXECUTE(DIVI);
+    VM_EXECUTE(DIVD);
+    VM_EXECUTE(CMPLTI);
+    VM_EXECUTE(CMPLTD);
+    VM_EXECUTE(CMPLEI);
+    VM_EXECUTE(CMPLED);
+    VM_EXECUTE(CMPGTI);
+    VM_EXECUTE(CMPGTD);
+    VM_EXECUTE(CMPGEI);
+    VM_EXECUTE(CMPGED);
+    VM_EXECUTE(HDUMP);
+    VM_EXECUTE(ADDLE);
+#ifndef VM_THREADED_DISPATCH
+    default:
+      error("unsupported operation " + to_string(*instr));
+  }
+#endif
+
+ vm_halt:
+  return;
+
+  // run the current frame's native code from its pc until it stops at
+  // an instruction left to the interpreter
+ vm_native:
+  {
+    VMJit::NativeCode code = jit.code(frame->info - frame_info.data());
+    int pc = code(this, frame, &executed, frame->pc, &value_stack);
+    if (pc < 0) {
+      exception_ptr ex = jit_error;
+      jit_error = nullptr;
+      rethrow_exception(ex);
     }
+    frame->pc = pc;
   }
+  goto vm_fetch;
+}
+
+
+void VM::trace(const VMFrame& frame, const VMInstr& instr) const
+{
+  cerr << endl << endl;
+  cerr << "\t FRAME.........: " << frame.info->function_name << endl;
+  cerr << "\t PC............: " << (frame.pc - 1) << endl;
+  cerr << "\t INSTR.........: " << to_string(instr) << endl;
+  cerr << "\t NEXT OPERAND..: ";
+  if (value_stack.size() > frame.base + frame.info->local_count)
+    cerr << to_string(value_stack.back()) << endl;
+  else
+    cerr << "empty" << endl;
+  cerr << "\t NEXT FUNCTION.: ";
+  if (!call_stack.empty())
+    cerr << call_stack.back().info->function_name << endl;
+  else
+    cerr << "empty" << endl;
 }
 
 
 void VM::ensure_not_null(const VMFrame& f, const VMValue& x) const
 {
-  if (holds_alternative<nullptr_t>(x))
+  if (x.is_null())
     error("null reference", f);
 }
 
 VMValue VM::add(const VMValue& x, const VMValue& y) const
 {
-  if (holds_alternative<int>(x)) 
-    return get<int>(x) + get<int>(y);
+  if (x.is_int()) 
+    return x.as_int() + y.as_int();
   else
-    return get<double>(x) + get<double>(y);
+    return x.as_double() + y.as_double();
 }
 
 VMValue VM::sub(const VMValue& x, const VMValue& y) const
 {
-  if (holds_alternative<int>(x)){
-    return get<int>(x) - get<int>(y);
+  if (x.is_int()){
+    return x.as_int() - y.as_int();
   }
   else{
-    return get<double>(x) - get<double>(y);
+    return x.as_double() - y.as_double();
   }
 }
 
 VMValue VM::mul(const VMValue& x, const VMValue& y) const
 {
-  if (holds_alternative<int>(x)){
-    return get<int>(x) * get<int>(y);
+  if (x.is_int()){
+    return x.as_int() * y.as_int();
   }
   else{
-    return get<double>(x) * get<double>(y);
+    return x.as_double() * y.as_double();
   }
 }
 
 VMValue VM::div(const VMValue& x, const VMValue& y) const
 {
-  if (holds_alternative<int>(x)){
-    return get<int>(x) / get<int>(y);
+  if (x.is_int()){
+    return x.as_int() / y.as_int();
   }
   else{
-    return get<double>(x) / get<double>(y);
+    return x.as_double() / y.as_double();
   }
 }
 
 VMValue VM::eq(const VMValue& x, const VMValue& y) const
 {
-  if (holds_alternative<nullptr_t>(x) and not holds_alternative<nullptr_t>(y)) 
+  if (x.is_null() and not y.is_null()) 
     return false;
-  else if (not holds_alternative<nullptr_t>(x) and holds_alternative<nullptr_t>(y))
+  else if (not x.is_null() and y.is_null())
     return false;
-  else if (holds_alternative<nullptr_t>(x) and holds_alternative<nullptr_t>(y))
+  else if (x.is_null() and y.is_null())
     return true;
-  else if (holds_alternative<int>(x)) 
-    return get<int>(x) == get<int>(y);
-  else if (holds_alternative<double>(x))
-    return get<double>(x) == get<double>(y);
-  else if (holds_alternative<string>(x)){
-    return get<string>(x) == get<string>(y);
+  else if (x.is_int() or x.is_ref()) 
+    return x.as_int() == y.as_int();
+  else if (x.is_double())
+    return x.as_double() == y.as_double();
+  else if (x.is_string()){
+    return x.as_string() == y.as_string();
   }
   else
-    return get<bool>(x) == get<bool>(y);
+    return x.as_bool() == y.as_bool();
 }
 
 VMValue VM::lt(const VMValue& x, const VMValue& y) const
 {
-  if (holds_alternative<nullptr_t>(x) and not holds_alternative<nullptr_t>(y)) 
+  if (x.is_null() and not y.is_null()) 
     return false;
-  else if (not holds_alternative<nullptr_t>(x) and holds_alternative<nullptr_t>(y))
+  else if (not x.is_null() and y.is_null())
     return false;
-  else if (holds_alternative<nullptr_t>(x) and holds_alternative<nullptr_t>(y))
+  else if (x.is_null() and y.is_null())
     return true;
-  else if (holds_alternative<int>(x)) 
-    return get<int>(x) < get<int>(y);
-  else if (holds_alternative<double>(x))
-    return get<double>(x) < get<double>(y);
-  else if (holds_alternative<string>(x))
-    return get<string>(x) < get<string>(y);
+  else if (x.is_int()) 
+    return x.as_int() < y.as_int();
+  else if (x.is_double())
+    return x.as_double() < y.as_double();
+  else if (x.is_string())
+    return x.as_string() < y.as_string();
   else
-    return get<bool>(x) < get<bool>(y);
+    return x.as_bool() < y.as_bool();
 }
 
 VMValue VM::le(const VMValue& x, const VMValue& y) const
 {
-  if (holds_alternative<nullptr_t>(x) and not holds_alternative<nullptr_t>(y)) 
+  if (x.is_null() and not y.is_null()) 
     return false;
-  else if (not holds_alternative<nullptr_t>(x) and holds_alternative<nullptr_t>(y))
+  else if (not x.is_null() and y.is_null())
     return false;
-  else if (holds_alternative<nullptr_t>(x) and holds_alternative<nullptr_t>(y))
+  else if (x.is_null() and y.is_null())
     return true; 
-  else if (holds_alternative<int>(x)) 
-    return get<int>(x) <= get<int>(y);
-  else if (holds_alternative<double>(x))
-    return get<double>(x) <= get<double>(y);
-  else if (holds_alternative<string>(x))
-    return get<string>(x) <= get<string>(y);
+  else if (x.is_int()) 
+    return x.as_int() <= y.as_int();
+  else if (x.is_double())
+    return x.as_double() <= y.as_double();
+  else if (x.is_string())
+    return x.as_string() <= y.as_string();
   else
-    return get<bool>(x) <= get<bool>(y);
+    return x.as_bool() <= y.as_bool();
 }
 
 VMValue VM::gt(const VMValue& x, const VMValue& y) const
 {
-  if (holds_alternative<nullptr_t>(x) and not holds_alternative<nullptr_t>(y)) 
+  if (x.is_null() and not y.is_null()) 
     return false;
-  else if (not holds_alternative<nullptr_t>(x) and holds_alternative<nullptr_t>(y))
+  else if (not x.is_null() and y.is_null())
     return false;
-  else if (holds_alternative<nullptr_t>(x) and holds_alternative<nullptr_t>(y))
+  else if (x.is_null() and y.is_null())
     return true; 
-  else if (holds_alternative<int>(x)) 
-    return get<int>(x) > get<int>(y);
-  else if (holds_alternative<double>(x))
-    return get<double>(x) > get<double>(y);
-  else if (holds_alternative<string>(x))
-    return get<string>(x) > get<string>(y);
+  else if (x.is_int()) 
+    return x.as_int() > y.as_int();
+  else if (x.is_double())
+    return x.as_double() > y.as_double();
+  else if (x.is_string())
+    return x.as_string() > y.as_string();
   else
-    return get<bool>(x) > get<bool>(y);  
+    return x.as_bool() > y.as_bool();  
 }
 
 VMValue VM::ge(const VMValue& x, const VMValue& y) const
 {
-  if (holds_alternative<nullptr_t>(x) and not holds_alternative<nullptr_t>(y)) 
+  if (x.is_null() and not y.is_null()) 
     return false;
-  else if (not holds_alternative<nullptr_t>(x) and holds_alternative<nullptr_t>(y))
+  else if (not x.is_null() and y.is_null())
     return false;
-  else if (holds_alternative<nullptr_t>(x) and holds_alternative<nullptr_t>(y))
+  else if (x.is_null() and y.is_null())
     return true; 
-  else if (holds_alternative<int>(x)) 
-    return get<int>(x) >= get<int>(y);
-  else if (holds_alternative<double>(x))
-    return get<double>(x) >= get<double>(y);
-  else if (holds_alternative<string>(x))
-    return get<string>(x) >= get<string>(y);
+  else if (x.is_int()) 
+    return x.as_int() >= y.as_int();
+  else if (x.is_double())
+    return x.as_double() >= y.as_double();
+  else if (x.is_string())
+    return x.as_string() >= y.as_string();
   else
-    return get<bool>(x) >= get<bool>(y);
+    return x.as_bool() >= y.as_bool();
 }
 
 VMValue VM::ne(const VMValue& x, const VMValue& y) const
 {
-  if (holds_alternative<nullptr_t>(x) and not holds_alternative<nullptr_t>(y)) 
+  if (x.is_null() and not y.is_null()) 
     return true;
-  else if (not holds_alternative<nullptr_t>(x) and holds_alternative<nullptr_t>(y))
+  else if (not x.is_null() and y.is_null())
     return true;
-  else if (holds_alternative<nullptr_t>(x) and holds_alternative<nullptr_t>(y))
+  else if (x.is_null() and y.is_null())
     return false;
-  else if (holds_alternative<int>(x)) 
-    return get<int>(x) != get<int>(y);
-  else if (holds_alternative<double>(x))
-    return get<double>(x) != get<double>(y);
-  else if (holds_alternative<string>(x))
-    return get<string>(x).compare(get<string>(y)) != 0;
+  else if (x.is_int() or x.is_ref()) 
+    return x.as_int() != y.as_int();
+  else if (x.is_double())
+    return x.as_double() != y.as_double();
+  else if (x.is_string())
+    return x.as_string().compare(y.as_string()) != 0;
   else
-    return get<bool>(x) != get<bool>(y);
+    return x.as_bool() != y.as_bool();
 }
 
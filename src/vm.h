@@ -8,13 +8,20 @@
 #ifndef VM_H
 #define VM_H
 
-#include <memory>
-#include <stack>
+#include <algorithm>
+#include <cstddef>
+#include <exception>
 #include <string>
 #include <unordered_map>
 #include <vector>
 #include "vm_instr.h"
 #include "vm_frame.h"
+#include "vm_nursery.h"
+#include "vm_input.h"
+#include "vm_object.h"
+#include "vm_output.h"
+#include "vm_struct.h"
+#include "vm_jit.h"
 
 
 class VM
@@ -24,37 +31,269 @@ public:
   // add a new frame type to the vm
   void add(const VMFrameInfo& frame);
 
+  // add a struct type to the vm (its fields in slot order)
+  void add_struct(const std::string& struct_name,
+                  const std::vector<std::string>& fields);
+
+  // resolve function names in CALL instructions to frame indexes and
+  // struct names in ALLOCS instructions to shapes, reporting undefined
+  // functions and structs (run links if needed)
+  void link();
+
   // run the virtual machine
   void run(bool DEBUG = false);
 
+  // number of instructions executed so far
+  unsigned long long instruction_count() const;
+
+  // compile functions to native code once they have been called more
+  // than the given number of times (negative disables the jit)
+  void set_jit_threshold(int calls);
+
+  // number of functions compiled to native code by the last run
+  int jit_compiled_count() const;
+
+  // collect garbage once the heaps hold the given number of old objects
+  // (afterwards twice the number of live objects), young structs are
+  // collected whenever the nursery is full, negative disables garbage
+  // collection
+  void set_gc_threshold(int objects);
+
+  // summary of the garbage collections done by the last run
+  std::string gc_stats() const;
+
+  // limit the bytes used by heap objects and strings, a VM error is
+  // raised if a garbage collection can't bring the heap back under the
+  // limit (0, the default, is no limit)
+  void set_max_heap(std::size_t bytes);
+
+  // summary of the memory used by heap objects and strings
+  std::string memory_stats() const;
+
+  // buffer up to the given number of bytes of the program's output (0
+  // writes each value right away), also flushing at the end of each
+  // line if line_flush (the output is always flushed before reading
+  // input and when a run ends)
+  void set_output_buffer(std::size_t bytes, bool line_flush);
+
+  // writes a snapshot of the heap objects, their types and references,
+  // and the objects referenced by the value stack to the given file
+  // (see heap_snapshot.h), returns false if the file couldn't be written
+  bool dump_heap(const std::string& path) const;
+
   // to print the instructions for each VM frame
   friend std::string to_string(const VM& vm);
 
   
 private:
 
-  // heap for struct objects mapping oid's to field values
-  std::unordered_map<int, std::unordered_map<std::string, VMValue>> struct_heap;
+  // the oid of the first entry in the object table
+  static const int first_oid = 2023;
+
+  // object table mapping each oid (minus first_oid) to its heap object
+  std::vector<VMObject> objects;
+
+  // the heap objects (owned by their pools)
+  VMPool<VMStruct> struct_pool;
+  VMPool<VMArray> array_pool;
+  VMPool<VMList> list_pool;
 
-  // heap for array objects
-  std::unordered_map<int, std::vector<VMValue>> array_heap;
+  // number of objects in the object table
+  std::size_t live_objects = 0;
 
-  // HEAP FOR LISTS
-  std::unordered_map<int, std::unordered_map<int, VMValue>> list_heap;
+  // storage for the field values of young struct objects
+  VMNursery nursery;
 
-  // next available object id 
-  int next_obj_id = 2023;
+  // ids of the structs made young since the last collection
+  std::vector<int> young_oids;
 
-  // collection of frame "templates" identified by function name
-  std::unordered_map<std::string, VMFrameInfo> frame_info;
+  // ids of old objects that stored a reference since the last
+  // collection (the extra roots of a minor collection)
+  std::vector<int> remembered;
+
+  // struct layouts (shape 0 has no fields)
+  std::vector<VMShape> shapes = std::vector<VMShape>(1);
+
+  // index in shapes of each struct type (see add_struct)
+  std::unordered_map<std::string, int> struct_shape;
+
+  // ids of collected objects (reused before growing the table)
+  std::vector<int> free_oids;
+
+  // number of heap objects that triggers the next collection
+  int gc_threshold = 10000;
+  std::size_t gc_limit = 10000;
+
+  // garbage collection statistics (see gc_stats)
+  int gc_collections = 0;
+  int gc_minor_collections = 0;
+  long long gc_freed = 0;
+  std::size_t gc_peak = 0;
+  double gc_seconds = 0;
+
+  // bytes used by and number of heap objects of each kind (indexed by
+  // kind, see object_bytes)
+  std::size_t kind_bytes[4] = {};
+  std::size_t kind_objects[4] = {};
+
+  // string table usage when the last run started (the strings of the
+  // program's instructions aren't counted)
+  std::size_t string_bytes_base = 0;
+  int strings_base = 0;
+  std::size_t string_refs_base = 0;
+
+  // heap limit (see set_max_heap) and the most bytes used by the last
+  // run (as of its collections)
+  std::size_t max_heap = 0;
+  std::size_t heap_peak = 0;
+
+  // collection of frame "templates" (in the order they were added)
+  std::vector<VMFrameInfo> frame_info;
+
+  // index in frame_info of each function name
+  std::unordered_map<std::string, int> frame_index;
+
+  // true if every CALL refers to a frame_info index (see link)
+  bool linked = false;
 
   // VM function call stack
-  std::stack<std::shared_ptr<VMFrame>> call_stack;
+  std::vector<VMFrame> call_stack;
+
+  // locals and operands of every active frame, stored contiguously
+  std::vector<VMValue> value_stack;
+
+  // total number of instructions executed (for benchmarking)
+  unsigned long long executed = 0;
+
+  // the program's (buffered) input and output
+  VMInput input;
+  VMOutput output;
+
+  // native code for hot functions (see set_jit_threshold)
+  VMJit jit;
+  int jit_threshold = -1;
+
+  // error raised while running native code (rethrown by run)
+  std::exception_ptr jit_error;
+  friend class VMJit;
+
+  // performs the instruction (other than JMP, CALL, and RET) in the
+  // frame, returns true if it took a branch (setting the frame's pc),
+  // shared by run and the JIT's helpers (see vm_execute.h)
+  template<OpCode op>
+  bool execute(VMFrame* frame, const VMInstr* instr);
+
+  // the id of a new (empty) heap object of the given kind, first
+  // collecting garbage if the heap limit has been reached or the given
+  // number of values no longer fit in the nursery (so the new object's
+  // initial values must still be on the value stack)
+  int new_object(VMObject::Kind kind, int young_values = 0);
+
+  // removes the object from the object table (making its oid available)
+  void free_object(int oid);
+
+  // the object table entry of a reference to an object of the given
+  // kind (a VM error if it isn't one)
+  VMObject& object(const VMFrame& f, const VMValue& ref, VMObject::Kind kind);
+
+  // the heap object a reference refers to
+  VMStruct& get_struct(const VMFrame& f, const VMValue& ref)
+  {
+    return *object(f, ref, VMObject::Kind::STRUCT).struct_obj;
+  }
+  VMArray& get_array(const VMFrame& f, const VMValue& ref)
+  {
+    return *object(f, ref, VMObject::Kind::ARRAY).array;
+  }
+  VMList& get_list(const VMFrame& f, const VMValue& ref)
+  {
+    return *object(f, ref, VMObject::Kind::LIST).list;
+  }
+
+  // frees every heap object not reachable from a reference in the value
+  // stack (i.e., from the locals and operands of the active frames),
+  // then promotes the surviving young structs and resets the nursery
+  void collect();
+
+  // like collect but only frees young structs, so only young structs
+  // and old objects that stored a reference are traced
+  void minor_collect();
+
+  // empties the remembered set
+  void forget_remembered();
+
+  // calls visit with each value stored in the heap object
+  template<typename Visit>
+  void for_each_value(int oid, Visit visit) const;
+
+  // write barrier, records that the old object stored the value
+  void remember(int oid, const VMValue& value)
+  {
+    VMObject& entry = objects[oid - first_oid];
+    if (value.is_ref() and !entry.remembered) {
+      entry.remembered = true;
+      remembered.push_back(oid);
+    }
+  }
+
+  // resizes the struct's slots (new slots are null), in the nursery if
+  // the struct is young (or was just allocated) and they fit
+  void resize_slots(int oid, VMStruct& obj, int count,
+                    bool allocated = false);
+
+  // moves a young struct's slots out of the nursery
+  void promote(VMStruct& obj);
+
+  // number of heap objects
+  std::size_t heap_size() const { return live_objects; }
+
+  // bytes used by the heap object (its values count 16 bytes each,
+  // packed list values 4 or 8)
+  std::size_t object_bytes(const VMObject& entry) const;
+
+  // bytes used by heap objects and by strings created by the last run
+  std::size_t heap_bytes() const;
+
+  // adds to the bytes used by heap objects of the given kind
+  void account(VMObject::Kind kind, std::ptrdiff_t bytes)
+  {
+    kind_bytes[static_cast<int>(kind)] += bytes;
+  }
+
+  // accounts for the list's change in size (from the given bytes) and
+  // checks the heap limit
+  void list_resized(const VMFrame& f, const VMList& list,
+                    std::size_t old_bytes);
+
+  // collects garbage if the heap plus the given bytes would exceed the
+  // heap limit, and raises an out of memory error if it still would
+  // (every live value must be on the value stack)
+  void check_heap(const VMFrame& f, std::size_t extra = 0)
+  {
+    if (max_heap != 0)
+      enforce_max_heap(f, extra);
+  }
+  void enforce_max_heap(const VMFrame& f, std::size_t extra);
+
+  // records the current heap usage if it is the largest so far
+  void update_heap_peak() { heap_peak = std::max(heap_peak, heap_bytes()); }
 
   // helper functions to report VM errors
   void error(std::string msg) const;
   void error(std::string msg, const VMFrame& f) const;
 
+  // helper function to print the current frame and instruction
+  void trace(const VMFrame& f, const VMInstr& instr) const;
+
+  // the shape reached by adding the field to the given shape
+  int add_field(int shape, const std::string& field);
+
+  // the slot of the GETF/SETF instruction's field in the object, the
+  // slot given by the code generator if there is one, otherwise found
+  // by name
+  int field_slot(const VMFrame& f, const VMStruct& obj,
+                 const VMInstr& instr) const;
+
   // helper function to check for null values (throws mypl exception)
   void ensure_not_null(const VMFrame& f, const VMValue& x) const;
 
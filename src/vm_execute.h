@@ -0,0 +1,892 @@
+//----------------------------------------------------------------------
+// FILE: vm_execute.h
+// DATE: CPSC 326, Spring 2023
+// AUTH: Cameron Chetcuti
+// DESC: The VM's instruction handlers, shared by the interpreter
+//       (VM::run) and the JIT's helpers
+//----------------------------------------------------------------------
+
+#ifndef VM_EXECUTE_H
+#define VM_EXECUTE_H
+
+#include <algorithm>
+#include <cstddef>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include "vm.h"
+
+
+// the handlers are inlined into each dispatch site (even when not
+// optimizing) so the interpreter doesn't pay for a call per instruction
+#if defined(__GNUC__) || defined(__clang__)
+#define VM_INLINE __attribute__((always_inline)) inline
+#else
+#define VM_INLINE inline
+#endif
+
+// the local variable named by the i-th register of the instruction
+#define VM_REG(i) value_stack[frame->base + instr->reg(i)]
+
+// replace the top two stack values y, x with the value of expr, where
+// the semantic checker found both to be of type type (e.g., is_int). A
+// value can still be null (or not match if the checker was wrong), so
+// anything else goes through the null checks and generic operation op
+#define VM_TYPED_BINARY(type, expr, op)                                 \
+  {                                                                     \
+    VMValue& y = value_stack[value_stack.size() - 2];                   \
+    const VMValue& x = value_stack.back();                              \
+    if (x.type() and y.type())                                          \
+      y = (expr);                                                       \
+    else {                                                              \
+      ensure_not_null(*frame, x);                                       \
+      ensure_not_null(*frame, y);                                       \
+      y = op(y, x);                                                     \
+    }                                                                   \
+    value_stack.pop_back();                                             \
+  }
+
+
+template<OpCode op>
+VM_INLINE bool VM::execute(VMFrame* frame, const VMInstr* instr)
+{
+  //----------------------------------------------------------------------
+  // Literals and Variables
+  //----------------------------------------------------------------------
+
+  if constexpr (op == OpCode::PUSH) {
+    value_stack.push_back(instr->operand().value());
+  }
+
+  else if constexpr (op == OpCode::PUSHK) {
+    value_stack.push_back(frame->info->constants[instr->operand()->as_int()]);
+  }
+
+  else if constexpr (op == OpCode::POP) {
+    value_stack.pop_back();
+  }
+
+  else if constexpr (op == OpCode::LOAD) {
+    int var_location = instr->operand().value().as_int();
+    value_stack.push_back(value_stack[frame->base + var_location]);
+  }
+
+  else if constexpr (op == OpCode::STORE) {
+    VMValue x = value_stack.back();
+    value_stack.pop_back();
+    int var_location = instr->operand().value().as_int();
+    value_stack[frame->base + var_location] = x;
+  }
+
+  //----------------------------------------------------------------------
+  // Operations
+  //----------------------------------------------------------------------
+
+  else if constexpr (op == OpCode::ADD) {
+    VMValue x = value_stack.back();
+    ensure_not_null(*frame, x);
+    value_stack.pop_back();
+    VMValue y = value_stack.back();
+    ensure_not_null(*frame, y);
+    value_stack.pop_back();
+    value_stack.push_back(add(y, x));
+  }
+
+  else if constexpr (op == OpCode::SUB) {
+    VMValue x = value_stack.back();
+    ensure_not_null(*frame, x);
+    value_stack.pop_back();
+    VMValue y = value_stack.back();
+    ensure_not_null(*frame, y);
+    value_stack.pop_back();
+    value_stack.push_back(sub(y, x));
+  }
+
+  else if constexpr (op == OpCode::MUL) {
+    VMValue x = value_stack.back();
+    ensure_not_null(*frame, x);
+    value_stack.pop_back();
+    VMValue y = value_stack.back();
+    ensure_not_null(*frame, y);
+    value_stack.pop_back();
+    value_stack.push_back(mul(y, x));
+  }
+
+  else if constexpr (op == OpCode::DIV) {
+    VMValue x = value_stack.back();
+    ensure_not_null(*frame, x);
+    value_stack.pop_back();
+    VMValue y = value_stack.back();
+    ensure_not_null(*frame, y);
+    value_stack.pop_back();
+    value_stack.push_back(div(y, x));
+  }
+
+  else if constexpr (op == OpCode::AND) {
+    VMValue x = value_stack.back();
+    ensure_not_null(*frame, x);
+    value_stack.pop_back();
+    VMValue y = value_stack.back();
+    ensure_not_null(*frame, y);
+    value_stack.pop_back();
+    value_stack.push_back(x.as_bool() && y.as_bool());
+  }
+
+  else if constexpr (op == OpCode::OR) {
+    VMValue x = value_stack.back();
+    ensure_not_null(*frame, x);
+    value_stack.pop_back();
+    VMValue y = value_stack.back();
+    ensure_not_null(*frame, y);
+    value_stack.pop_back();
+    value_stack.push_back(x.as_bool() || y.as_bool());
+  }
+
+  else if constexpr (op == OpCode::NOT) {
+    VMValue x = value_stack.back();
+    ensure_not_null(*frame, x);
+    value_stack.pop_back();
+    value_stack.push_back(!x.as_bool());
+  }
+
+  else if constexpr (op == OpCode::CMPLT) {
+    VMValue x = value_stack.back();
+    ensure_not_null(*frame, x);
+    value_stack.pop_back();
+    VMValue y = value_stack.back();
+    ensure_not_null(*frame, y);
+    value_stack.pop_back();
+    value_stack.push_back(lt(y, x));
+  }
+
+  else if constexpr (op == OpCode::CMPLE) {
+    VMValue x = value_stack.back();
+    ensure_not_null(*frame, x);
+    value_stack.pop_back();
+    VMValue y = value_stack.back();
+    ensure_not_null(*frame, y);
+    value_stack.pop_back();
+    value_stack.push_back(le(y, x));
+  }
+
+  else if constexpr (op == OpCode::CMPGT) {
+    VMValue x = value_stack.back();
+    ensure_not_null(*frame, x);
+    value_stack.pop_back();
+    VMValue y = value_stack.back();
+    ensure_not_null(*frame, y);
+    value_stack.pop_back();
+    value_stack.push_back(gt(y, x));
+  }
+
+  else if constexpr (op == OpCode::CMPGE) {
+    VMValue x = value_stack.back();
+    ensure_not_null(*frame, x);
+    value_stack.pop_back();
+    VMValue y = value_stack.back();
+    ensure_not_null(*frame, y);
+    value_stack.pop_back();
+    value_stack.push_back(ge(y, x));
+  }
+
+  else if constexpr (op == OpCode::CMPEQ) {
+    VMValue x = value_stack.back();
+    value_stack.pop_back();
+    VMValue y = value_stack.back();
+    value_stack.pop_back();
+    value_stack.push_back(eq(y, x));
+  }
+
+  else if constexpr (op == OpCode::CMPNE) {
+    VMValue x = value_stack.back();
+    value_stack.pop_back();
+    VMValue y = value_stack.back();
+    value_stack.pop_back();
+    value_stack.push_back(ne(y, x));
+  }
+
+  else if constexpr (op == OpCode::JMPF) {
+    VMValue x = value_stack.back();
+    ensure_not_null(*frame, x);
+    value_stack.pop_back();
+    if (!x.as_bool()){
+      frame->pc = instr->operand().value().as_int();
+      return true;
+    }
+  }
+
+  //----------------------------------------------------------------------
+  // Built in functions
+  //----------------------------------------------------------------------
+
+  else if constexpr (op == OpCode::WRITE) {
+    output.write(value_stack.back());
+    value_stack.pop_back();
+  }
+
+  else if constexpr (op == OpCode::READ) {
+    output.flush();
+    std::string_view line;
+    if (!input.read_line(line))
+      line = "";
+    if (line.size() > max_string_length)
+      error("string too long", *frame);
+    value_stack.push_back(line);
+  }
+
+  else if constexpr (op == OpCode::SLEN) {
+    VMValue x = value_stack.back();
+    ensure_not_null(*frame, x);
+    value_stack.pop_back();
+    value_stack.push_back(int(x.as_string().size()));
+  }
+
+  else if constexpr (op == OpCode::ALEN) {
+    VMValue x = value_stack.back();
+    ensure_not_null(*frame, x);
+    value_stack.pop_back();
+    value_stack.push_back(int(get_array(*frame, x).size()));
+  }
+
+  else if constexpr (op == OpCode::GETC) {
+    VMValue x = value_stack.back();
+    ensure_not_null(*frame, x);
+    value_stack.pop_back();
+    VMValue y = value_stack.back();
+    ensure_not_null(*frame, y);
+    value_stack.pop_back();
+    std::string_view xstr = x.as_string();
+    int yint = y.as_int();
+    if (yint < 0 or std::size_t(yint) >= xstr.size())
+      error("out-of-bounds string index", *frame);
+    value_stack.push_back(std::string(1, xstr[yint]));
+  }
+
+  else if constexpr (op == OpCode::TOINT) {
+    VMValue x = value_stack.back();
+    ensure_not_null(*frame, x);
+    value_stack.pop_back();
+    if (x.is_int())
+      value_stack.push_back(x);
+    else if (x.is_string()) {
+      int result;
+      if (!parse_int(x.as_string(), result))
+        error("cannot convert string to int", *frame);
+      value_stack.push_back(result);
+    }
+    else if (x.is_double()) {
+      // truncates toward zero
+      double d = x.as_double();
+      if (!(d > -2147483649.0 and d < 2147483648.0))
+        error("cannot convert double to int", *frame);
+      value_stack.push_back(int(d));
+    }
+    else if (x.is_bool())
+      value_stack.push_back(int(x.as_bool()));
+  }
+
+  else if constexpr (op == OpCode::TODBL) {
+    VMValue x = value_stack.back();
+    ensure_not_null(*frame, x);
+    value_stack.pop_back();
+    if (x.is_int())
+      value_stack.push_back(double(x.as_int()));
+    else if (x.is_double())
+      value_stack.push_back(x);
+    else if (x.is_string()) {
+      double result;
+      if (!parse_double(x.as_string(), result))
+        error("cannot convert string to double", *frame);
+      value_stack.push_back(result);
+    }
+    else if (x.is_bool())
+      value_stack.push_back(double(x.as_bool()));
+  }
+
+  else if constexpr (op == OpCode::TOSTR) {
+    VMValue x = value_stack.back();
+    ensure_not_null(*frame, x);
+    value_stack.pop_back();
+    if (x.is_string())
+      value_stack.push_back(x);
+    else {
+      char buffer[max_value_chars];
+      value_stack.push_back(to_chars(x, buffer));
+    }
+  }
+
+  else if constexpr (op == OpCode::CONCAT) {
+    VMValue x = value_stack.back();
+    ensure_not_null(*frame, x);
+    value_stack.pop_back();
+    VMValue y = value_stack.back();
+    ensure_not_null(*frame, y);
+    value_stack.pop_back();
+    try {
+      value_stack.push_back(VMValue::concat(y, x));
+    }
+    catch (const std::length_error&) {
+      error("string too long", *frame);
+    }
+    check_heap(*frame);
+  }
+
+  //----------------------------------------------------------------------
+  // heap
+  //----------------------------------------------------------------------
+
+  else if constexpr (op == OpCode::ALLOCS) {
+    // a struct type starts with all its fields (null), otherwise ADDF
+    // adds them one at a time
+    int shape = instr->operand() ? instr->operand().value().as_int() : 0;
+    int oid = new_object(VMObject::Kind::STRUCT, shapes[shape].fields.size());
+    VMStruct& obj = *objects[oid - first_oid].struct_obj;
+    obj.shape = shape;
+    resize_slots(oid, obj, shapes[shape].fields.size(), true);
+    value_stack.push_back(VMValue::ref(oid));
+    check_heap(*frame);
+  }
+
+  else if constexpr (op == OpCode::ALLOCA) {
+    VMValue x = value_stack.back();
+    VMValue y = value_stack[value_stack.size() - 2];
+    ensure_not_null(*frame, y);
+    std::size_t bytes = std::max(y.as_int(), 0) * sizeof(VMValue);
+    check_heap(*frame, bytes + sizeof(VMArray));
+    int oid = new_object(VMObject::Kind::ARRAY);
+    value_stack.pop_back();
+    value_stack.pop_back();
+    objects[oid - first_oid].array->assign(y.as_int(), x);
+    account(VMObject::Kind::ARRAY, bytes);
+    remember(oid, x);
+    value_stack.push_back(VMValue::ref(oid));
+  }
+
+  // LISTS
+
+  else if constexpr (op == OpCode::ALLOCL) {
+    int oid = new_object(VMObject::Kind::LIST);
+    value_stack.push_back(VMValue::ref(oid));
+    check_heap(*frame);
+  }
+
+  // (list operands are popped after the heap check so that the list
+  // isn't collected)
+
+  else if constexpr (op == OpCode::ADDLI) {
+    VMValue x = value_stack.back();
+    ensure_not_null(*frame, x);
+    VMList& list = get_list(*frame, x);
+    std::size_t bytes = list.bytes();
+    list.push_back(nullptr);
+    list_resized(*frame, list, bytes);
+    value_stack.pop_back();
+  }
+
+  else if constexpr (op == OpCode::SETLE) {
+    VMValue x = value_stack.back();
+    VMValue y = value_stack[value_stack.size() - 2];
+    ensure_not_null(*frame, y);
+    VMList& list = get_list(*frame, x);
+    if (list.empty()){
+      error("empty list", *frame);
+    }
+    std::size_t bytes = list.bytes();
+    list.set(list.size() - 1, y);
+    list_resized(*frame, list, bytes);
+    remember(x.as_int(), y);
+    value_stack.pop_back();
+    value_stack.pop_back();
+  }
+
+  else if constexpr (op == OpCode::SETLI) {
+    VMValue x = value_stack.back();
+    VMValue y = value_stack[value_stack.size() - 2];
+    ensure_not_null(*frame, y);
+    VMValue z = value_stack[value_stack.size() - 3];
+    ensure_not_null(*frame, z);
+    VMList& list = get_list(*frame, z);
+    if(y.as_int() >= list.size() || y.as_int() < 0){
+      error("out-of-bounds list index", *frame);
+    }
+    std::size_t bytes = list.bytes();
+    list.set(y.as_int(), x);
+    list_resized(*frame, list, bytes);
+    remember(z.as_int(), x);
+    value_stack.resize(value_stack.size() - 3);
+  }
+
+  else if constexpr (op == OpCode::GETLI) {
+    VMValue x = value_stack.back();
+    ensure_not_null(*frame, x);
+    value_stack.pop_back();
+    VMValue y = value_stack.back();
+    ensure_not_null(*frame, y);
+    value_stack.pop_back();
+    const VMList& list = get_list(*frame, y);
+    if(x.as_int() >= list.size() || x.as_int() < 0){
+      error("out-of-bounds list index", *frame);
+    }
+    value_stack.push_back(list.get(x.as_int()));
+  }
+
+  else if constexpr (op == OpCode::LNUMI) {
+    VMValue x = value_stack.back();
+    ensure_not_null(*frame, x);
+    value_stack.pop_back();
+    value_stack.push_back(get_list(*frame, x).count_ints());
+  }
+
+  else if constexpr (op == OpCode::LNUMD) {
+    VMValue x = value_stack.back();
+    ensure_not_null(*frame, x);
+    value_stack.pop_back();
+    value_stack.push_back(get_list(*frame, x).count_doubles());
+  }
+
+  else if constexpr (op == OpCode::LNUMS) {
+    VMValue x = value_stack.back();
+    ensure_not_null(*frame, x);
+    value_stack.pop_back();
+    value_stack.push_back(get_list(*frame, x).count_strings());
+  }
+
+  else if constexpr (op == OpCode::LNUMB) {
+    VMValue x = value_stack.back();
+    ensure_not_null(*frame, x);
+    value_stack.pop_back();
+    value_stack.push_back(get_list(*frame, x).count_bools());
+  }
+
+  else if constexpr (op == OpCode::LRMB) {
+    VMValue x = value_stack.back();
+    ensure_not_null(*frame, x);
+    value_stack.pop_back();
+    VMList& list = get_list(*frame, x);
+    if (!list.empty()){
+      list.pop_back();
+    }
+  }
+
+  else if constexpr (op == OpCode::LAVGI) {
+    VMValue x = value_stack.back();
+    ensure_not_null(*frame, x);
+    value_stack.pop_back();
+    const VMList& list = get_list(*frame, x);
+    int num = list.count_ints();
+    if (num != 0){
+      value_stack.push_back(int(list.sum_ints() / num));
+    }
+    else {
+      value_stack.push_back(0);
+    }
+  }
+
+  else if constexpr (op == OpCode::LAVGD) {
+    VMValue x = value_stack.back();
+    ensure_not_null(*frame, x);
+    value_stack.pop_back();
+    const VMList& list = get_list(*frame, x);
+    int num = list.count_doubles();
+    if (num != 0){
+      double avg = list.sum_doubles() / double(num);
+      value_stack.push_back(avg);
+    }
+    else {
+      value_stack.push_back(0.0);
+    }
+  }
+
+  else if constexpr (op == OpCode::LSIZE) {
+    VMValue x = value_stack.back();
+    ensure_not_null(*frame, x);
+    value_stack.pop_back();
+    int size = get_list(*frame, x).size();
+    value_stack.push_back(size);
+  }
+
+  else if constexpr (op == OpCode::LRETRIEVE) {
+    VMValue x = value_stack.back();
+    ensure_not_null(*frame, x);
+    value_stack.pop_back();
+    VMValue y = value_stack.back();
+    ensure_not_null(*frame, y);
+    value_stack.pop_back();
+    // indexes past the end retrieve the last element
+    const VMList& list = get_list(*frame, y);
+    int index = std::min<int>(x.as_int(), list.size() - 1);
+    if(index < 0){
+      error("out-of-bounds list index", *frame);
+    }
+    value_stack.push_back(list.get(index));
+  }
+
+  //LISTS
+
+  else if constexpr (op == OpCode::ADDF) {
+    VMValue x = value_stack.back();
+    ensure_not_null(*frame, x);
+    VMStruct& obj = get_struct(*frame, x);
+    obj.shape = add_field(obj.shape,
+                          std::string(instr->operand().value().as_string()));
+    resize_slots(x.as_int(), obj, shapes[obj.shape].fields.size());
+    check_heap(*frame);
+    value_stack.pop_back();
+  }
+
+  else if constexpr (op == OpCode::SETF) {
+    VMValue x = value_stack.back();
+    value_stack.pop_back();
+    VMValue y = value_stack.back();
+    ensure_not_null(*frame, y);
+    value_stack.pop_back();
+    VMStruct& obj = get_struct(*frame, y);
+    obj.slots[field_slot(*frame, obj, *instr)] = x;
+    if (!obj.young)
+      remember(y.as_int(), x);
+  }
+
+  else if constexpr (op == OpCode::GETF) {
+    VMValue& x = value_stack.back();
+    ensure_not_null(*frame, x);
+    const VMStruct& obj = get_struct(*frame, x);
+    x = obj.slots[field_slot(*frame, obj, *instr)];
+  }
+
+  else if constexpr (op == OpCode::SETI) {
+    VMValue x = value_stack.back();
+    ensure_not_null(*frame, x);
+    value_stack.pop_back();
+    VMValue y = value_stack.back();
+    ensure_not_null(*frame, y);
+    value_stack.pop_back();
+    VMValue z = value_stack.back();
+    ensure_not_null(*frame, z);
+    value_stack.pop_back();
+    VMArray& array = get_array(*frame, z);
+    if(y.as_int() >= array.size() || y.as_int() < 0){
+      error("out-of-bounds array index", *frame);
+    }
+    array[y.as_int()] = x;
+    remember(z.as_int(), x);
+  }
+
+  else if constexpr (op == OpCode::GETI) {
+    VMValue x = value_stack.back();
+    ensure_not_null(*frame, x);
+    value_stack.pop_back();
+    VMValue y = value_stack.back();
+    ensure_not_null(*frame, y);
+    value_stack.pop_back();
+    const VMArray& array = get_array(*frame, y);
+    if(x.as_int() >= array.size() || x.as_int() < 0){
+      error("out-of-bounds array index", *frame);
+    }
+    value_stack.push_back(array[x.as_int()]);
+  }
+
+  //----------------------------------------------------------------------
+  // special
+  //----------------------------------------------------------------------
+
+  else if constexpr (op == OpCode::DUP) {
+    VMValue x = value_stack.back();
+    value_stack.pop_back();
+    value_stack.push_back(x);
+    value_stack.push_back(x);
+  }
+
+  else if constexpr (op == OpCode::NOP) {
+    // do nothing
+  }
+
+  //----------------------------------------------------------------------
+  // registers
+  //----------------------------------------------------------------------
+
+  else if constexpr (op == OpCode::MOVR) {
+    VM_REG(0) = VM_REG(1);
+  }
+
+  else if constexpr (op == OpCode::MOVK) {
+    VM_REG(0) = instr->operand().value();
+  }
+
+  else if constexpr (op == OpCode::ADDR) {
+    const VMValue& y = VM_REG(1);
+    const VMValue& x = VM_REG(2);
+    ensure_not_null(*frame, y);
+    ensure_not_null(*frame, x);
+    VM_REG(0) = add(y, x);
+  }
+
+  else if constexpr (op == OpCode::SUBR) {
+    const VMValue& y = VM_REG(1);
+    const VMValue& x = VM_REG(2);
+    ensure_not_null(*frame, y);
+    ensure_not_null(*frame, x);
+    VM_REG(0) = sub(y, x);
+  }
+
+  else if constexpr (op == OpCode::MULR) {
+    const VMValue& y = VM_REG(1);
+    const VMValue& x = VM_REG(2);
+    ensure_not_null(*frame, y);
+    ensure_not_null(*frame, x);
+    VM_REG(0) = mul(y, x);
+  }
+
+  else if constexpr (op == OpCode::DIVR) {
+    const VMValue& y = VM_REG(1);
+    const VMValue& x = VM_REG(2);
+    ensure_not_null(*frame, y);
+    ensure_not_null(*frame, x);
+    VM_REG(0) = div(y, x);
+  }
+
+  else if constexpr (op == OpCode::ANDR) {
+    const VMValue& y = VM_REG(1);
+    const VMValue& x = VM_REG(2);
+    ensure_not_null(*frame, y);
+    ensure_not_null(*frame, x);
+    VM_REG(0) = VMValue(y.as_bool() && x.as_bool());
+  }
+
+  else if constexpr (op == OpCode::ORR) {
+    const VMValue& y = VM_REG(1);
+    const VMValue& x = VM_REG(2);
+    ensure_not_null(*frame, y);
+    ensure_not_null(*frame, x);
+    VM_REG(0) = VMValue(y.as_bool() || x.as_bool());
+  }
+
+  else if constexpr (op == OpCode::NOTR) {
+    const VMValue& x = VM_REG(1);
+    ensure_not_null(*frame, x);
+    VM_REG(0) = !x.as_bool();
+  }
+
+  else if constexpr (op == OpCode::CMPLTR) {
+    const VMValue& y = VM_REG(1);
+    const VMValue& x = VM_REG(2);
+    ensure_not_null(*frame, y);
+    ensure_not_null(*frame, x);
+    VM_REG(0) = lt(y, x);
+  }
+
+  else if constexpr (op == OpCode::CMPLER) {
+    const VMValue& y = VM_REG(1);
+    const VMValue& x = VM_REG(2);
+    ensure_not_null(*frame, y);
+    ensure_not_null(*frame, x);
+    VM_REG(0) = le(y, x);
+  }
+
+  else if constexpr (op == OpCode::CMPGTR) {
+    const VMValue& y = VM_REG(1);
+    const VMValue& x = VM_REG(2);
+    ensure_not_null(*frame, y);
+    ensure_not_null(*frame, x);
+    VM_REG(0) = gt(y, x);
+  }
+
+  else if constexpr (op == OpCode::CMPGER) {
+    const VMValue& y = VM_REG(1);
+    const VMValue& x = VM_REG(2);
+    ensure_not_null(*frame, y);
+    ensure_not_null(*frame, x);
+    VM_REG(0) = ge(y, x);
+  }
+
+  else if constexpr (op == OpCode::CMPEQR) {
+    const VMValue& y = VM_REG(1);
+    const VMValue& x = VM_REG(2);
+    VM_REG(0) = eq(y, x);
+  }
+
+  else if constexpr (op == OpCode::CMPNER) {
+    const VMValue& y = VM_REG(1);
+    const VMValue& x = VM_REG(2);
+    VM_REG(0) = ne(y, x);
+  }
+
+  else if constexpr (op == OpCode::JMPFR) {
+    const VMValue& x = VM_REG(0);
+    ensure_not_null(*frame, x);
+    if (!x.as_bool()){
+      frame->pc = instr->operand().value().as_int();
+      return true;
+    }
+  }
+
+  //----------------------------------------------------------------------
+  // superinstructions (constants are never null, see Peephole)
+  //----------------------------------------------------------------------
+
+  else if constexpr (op == OpCode::CMPLTKJF) {
+    const VMValue& y = VM_REG(0);
+    ensure_not_null(*frame, y);
+    if (!lt(y, instr->operand().value()).as_bool()) {
+      frame->pc = instr->reg(1);
+      return true;
+    }
+  }
+
+  else if constexpr (op == OpCode::CMPLEKJF) {
+    const VMValue& y = VM_REG(0);
+    ensure_not_null(*frame, y);
+    if (!le(y, instr->operand().value()).as_bool()) {
+      frame->pc = instr->reg(1);
+      return true;
+    }
+  }
+
+  else if constexpr (op == OpCode::CMPGTKJF) {
+    const VMValue& y = VM_REG(0);
+    ensure_not_null(*frame, y);
+    if (!gt(y, instr->operand().value()).as_bool()) {
+      frame->pc = instr->reg(1);
+      return true;
+    }
+  }
+
+  else if constexpr (op == OpCode::CMPGEKJF) {
+    const VMValue& y = VM_REG(0);
+    ensure_not_null(*frame, y);
+    if (!ge(y, instr->operand().value()).as_bool()) {
+      frame->pc = instr->reg(1);
+      return true;
+    }
+  }
+
+  else if constexpr (op == OpCode::CMPEQKJF) {
+    if (!eq(VM_REG(0), instr->operand().value()).as_bool()) {
+      frame->pc = instr->reg(1);
+      return true;
+    }
+  }
+
+  else if constexpr (op == OpCode::CMPNEKJF) {
+    if (!ne(VM_REG(0), instr->operand().value()).as_bool()) {
+      frame->pc = instr->reg(1);
+      return true;
+    }
+  }
+
+  else if constexpr (op == OpCode::ADDK) {
+    const VMValue& y = VM_REG(1);
+    ensure_not_null(*frame, y);
+    VM_REG(0) = add(y, instr->operand().value());
+  }
+
+  else if constexpr (op == OpCode::SUBK) {
+    const VMValue& y = VM_REG(1);
+    ensure_not_null(*frame, y);
+    VM_REG(0) = sub(y, instr->operand().value());
+  }
+
+  else if constexpr (op == OpCode::SETFN) {
+    const VMValue& x = value_stack.back();
+    ensure_not_null(*frame, x);
+    VMStruct& obj = get_struct(*frame, x);
+    obj.slots[field_slot(*frame, obj, *instr)] = nullptr;
+  }
+
+  //----------------------------------------------------------------------
+  // typed operations
+  //----------------------------------------------------------------------
+
+  else if constexpr (op == OpCode::ADDI) {
+    VM_TYPED_BINARY(is_int, y.as_int() + x.as_int(), add);
+  }
+
+  else if constexpr (op == OpCode::ADDD) {
+    VM_TYPED_BINARY(is_double, y.as_double() + x.as_double(), add);
+  }
+
+  else if constexpr (op == OpCode::SUBI) {
+    VM_TYPED_BINARY(is_int, y.as_int() - x.as_int(), sub);
+  }
+
+  else if constexpr (op == OpCode::SUBD) {
+    VM_TYPED_BINARY(is_double, y.as_double() - x.as_double(), sub);
+  }
+
+  else if constexpr (op == OpCode::MULI) {
+    VM_TYPED_BINARY(is_int, y.as_int() * x.as_int(), mul);
+  }
+
+  else if constexpr (op == OpCode::MULD) {
+    VM_TYPED_BINARY(is_double, y.as_double() * x.as_double(), mul);
+  }
+
+  else if constexpr (op == OpCode::DIVI) {
+    VM_TYPED_BINARY(is_int, y.as_int() / x.as_int(), div);
+  }
+
+  else if constexpr (op == OpCode::DIVD) {
+    VM_TYPED_BINARY(is_double, y.as_double() / x.as_double(), div);
+  }
+
+  else if constexpr (op == OpCode::CMPLTI) {
+    VM_TYPED_BINARY(is_int, y.as_int() < x.as_int(), lt);
+  }
+
+  else if constexpr (op == OpCode::CMPLTD) {
+    VM_TYPED_BINARY(is_double, y.as_double() < x.as_double(), lt);
+  }
+
+  else if constexpr (op == OpCode::CMPLEI) {
+    VM_TYPED_BINARY(is_int, y.as_int() <= x.as_int(), le);
+  }
+
+  else if constexpr (op == OpCode::CMPLED) {
+    VM_TYPED_BINARY(is_double, y.as_double() <= x.as_double(), le);
+  }
+
+  else if constexpr (op == OpCode::CMPGTI) {
+    VM_TYPED_BINARY(is_int, y.as_int() > x.as_int(), gt);
+  }
+
+  else if constexpr (op == OpCode::CMPGTD) {
+    VM_TYPED_BINARY(is_double, y.as_double() > x.as_double(), gt);
+  }
+
+  else if constexpr (op == OpCode::CMPGEI) {
+    VM_TYPED_BINARY(is_int, y.as_int() >= x.as_int(), ge);
+  }
+
+  else if constexpr (op == OpCode::CMPGED) {
+    VM_TYPED_BINARY(is_double, y.as_double() >= x.as_double(), ge);
+  }
+
+  else if constexpr (op == OpCode::HDUMP) {
+    VMValue x = value_stack.back();
+    ensure_not_null(*frame, x);
+    value_stack.pop_back();
+    if (!dump_heap(std::string(x.as_string())))
+      error("unable to write heap snapshot " + to_string(x), *frame);
+  }
+
+  else if constexpr (op == OpCode::ADDLE) {
+    VMValue x = value_stack.back();
+    ensure_not_null(*frame, x);
+    VMValue y = value_stack[value_stack.size() - 2];
+    ensure_not_null(*frame, y);
+    VMList& list = get_list(*frame, x);
+    std::size_t bytes = list.bytes();
+    list.push_back(y);
+    list_resized(*frame, list, bytes);
+    remember(x.as_int(), y);
+    value_stack.pop_back();
+    value_stack.pop_back();
+  }
+  return false;
+}
+
+
+#undef VM_REG
+#undef VM_TYPED_BINARY
+#undef VM_INLINE
+
+#endif
@@ -9,7 +9,6 @@
 #ifndef VM_FRAME_H
 #define VM_FRAME_H
 
-#include <stack>
 #include <string>
 #include <vector>
 #include "vm_instr.h"
@@ -31,6 +30,14 @@ public:
   // the program instructions
   std::vector<VMInstr> instructions;  
 
+  // the string literals pushed by the frame's PUSHK instructions, each
+  // stored once (filled in when the program is linked)
+  std::vector<VMValue> constants;
+
+  // the number of local variable slots, allocated on frame entry
+  // (set by the code generator)
+  int local_count = 0;
+
 };
 
 
@@ -38,17 +45,16 @@ class VMFrame
 {
 public:
 
-  // the type of the current frame
-  VMFrameInfo info;
+  // the type of the current frame (owned by the VM and shared by all
+  // frames of the same function, so it is never copied on a call)
+  const VMFrameInfo* info = nullptr;
   
   // the program counter
   int pc = 0;
 
-  // the internal memory of the function
-  std::vector<VMValue> variables;
-
-  // the operand stack
-  std::stack<VMValue> operand_stack;
+  // index in the VM's value stack of the frame's first local variable
+  // (the operand stack starts right after the last local)
+  int base = 0;
 
 };
 
@@ -0,0 +1,118 @@
+//----------------------------------------------------------------------
+// FILE: vm_input.cpp
+// DATE: CPSC 326, Spring 2023
+// AUTH: Cameron Chetcuti
+// DESC: Buffered line input for the values read by a VM program
+//----------------------------------------------------------------------
+
+#include <cerrno>
+#include <cstring>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "vm_input.h"
+
+using namespace std;
+
+
+VMInput::~VMInput()
+{
+  if (mapped) {
+    lseek(STDIN_FILENO, begin, SEEK_SET);
+    munmap(const_cast<char*>(mapped), mapped_size);
+  }
+}
+
+
+void VMInput::open()
+{
+  opened = true;
+  struct stat info;
+  if (fstat(STDIN_FILENO, &info) == 0 and S_ISREG(info.st_mode)) {
+    off_t offset = lseek(STDIN_FILENO, 0, SEEK_CUR);
+    if (offset >= 0 and offset < info.st_size) {
+      void* memory = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE,
+                          STDIN_FILENO, 0);
+      if (memory != MAP_FAILED) {
+        madvise(memory, info.st_size, MADV_SEQUENTIAL);
+        mapped = static_cast<const char*>(memory);
+        mapped_size = info.st_size;
+        data = mapped;
+        begin = offset;
+        end = mapped_size;
+        at_end = true;
+        return;
+      }
+    }
+  }
+  buffer.resize(block_size);
+  data = buffer.data();
+}
+
+
+bool VMInput::fill()
+{
+  if (at_end)
+    return false;
+  // move the unread part of the buffer to the front, growing the buffer
+  // if a single line fills it
+  if (begin > 0) {
+    memmove(buffer.data(), buffer.data() + begin, end - begin);
+    end -= begin;
+    begin = 0;
+  }
+  if (end == buffer.size())
+    buffer.resize(buffer.size() * 2);
+  data = buffer.data();
+  ssize_t count;
+  do
+    count = read(STDIN_FILENO, buffer.data() + end, buffer.size() - end);
+  while (count < 0 and errno == EINTR);
+  if (count <= 0) {
+    at_end = true;
+    return false;
+  }
+  end += count;
+  return true;
+}
+
+
+void VMInput::release()
+{
+  size_t page = sysconf(_SC_PAGESIZE);
+  size_t upto = begin / page * page;
+  if (upto > released) {
+    madvise(const_cast<char*>(mapped) + released, upto - released,
+            MADV_DONTNEED);
+    released = upto;
+  }
+}
+
+
+bool VMInput::read_line(string_view& line)
+{
+  if (!opened)
+    open();
+  size_t scanned = begin;
+  while (true) {
+    const void* newline = memchr(data + scanned, '\n', end - scanned);
+    if (newline) {
+      size_t at = static_cast<const char*>(newline) - data;
+      line = string_view(data + begin, at - begin);
+      begin = at + 1;
+      if (mapped and begin - released >= block_size * 16)
+        release();
+      return true;
+    }
+    scanned = end - begin;
+    if (!fill()) {
+      // a last line without a newline
+      if (begin == end)
+        return false;
+      line = string_view(data + begin, end - begin);
+      begin = end;
+      return true;
+    }
+    scanned += begin;
+  }
+}
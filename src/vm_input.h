@@ -0,0 +1,69 @@
+//----------------------------------------------------------------------
+// FILE: vm_input.h
+// DATE: CPSC 326, Spring 2023
+// AUTH: Cameron Chetcuti
+// DESC: Buffered line input for the values read by a VM program
+//----------------------------------------------------------------------
+
+#ifndef VM_INPUT_H
+#define VM_INPUT_H
+
+#include <cstddef>
+#include <string_view>
+#include <vector>
+
+
+// Hands out the lines of the standard input (file descriptor 0). A
+// regular file is mapped into memory from its current offset, anything
+// else (pipes, terminals) is read in large blocks, so most lines cost
+// no system call. Lines follow std::getline: the newline is dropped
+// and a last line without one is still a line.
+class VMInput
+{
+public:
+
+  VMInput() = default;
+  VMInput(const VMInput&) = delete;
+  VMInput& operator=(const VMInput&) = delete;
+
+  // unmaps the input (leaving the file offset after the lines read)
+  ~VMInput();
+
+  // the next line (valid until the next call), false once the input
+  // is exhausted
+  bool read_line(std::string_view& line);
+
+private:
+
+  static const std::size_t block_size = 1 << 20;
+
+  bool opened = false;
+  bool at_end = false;
+
+  // the mapped file (if any)
+  const char* mapped = nullptr;
+  std::size_t mapped_size = 0;
+
+  // the start of the mapped pages not yet given back (pages are given
+  // back in large runs once read, so a big file isn't kept in memory)
+  std::size_t released = 0;
+
+  // the unread input is data[begin, end), either in the mapping or in
+  // the block buffer
+  const char* data = nullptr;
+  std::size_t begin = 0;
+  std::size_t end = 0;
+  std::vector<char> buffer;
+
+  void open();
+
+  // read another block, returns false at the end of the input
+  bool fill();
+
+  // give back the mapped pages before begin
+  void release();
+
+};
+
+
+#endif
@@ -22,6 +22,12 @@ VMInstr::VMInstr(OpCode opcode, const VMValue& operand)
 {}
 
 
+VMInstr::VMInstr(OpCode opcode, const optional<VMValue>& operand, int r1,
+                 int r2, int r3)
+  : instr_opcode(opcode), instr_operand(operand), instr_regs{r1, r2, r3}
+{}
+
+
 void VMInstr::set_comment(const std::string& comment)
 {
   instr_comment = comment;
@@ -40,7 +46,7 @@ OpCode VMInstr::opcode() const
 }
 
 
-std::optional<VMValue> VMInstr::operand() const
+const std::optional<VMValue>& VMInstr::operand() const
 {
   return instr_operand;
 }
@@ -52,6 +58,12 @@ void VMInstr::set_operand(VMValue value)
 }
 
 
+void VMInstr::set_reg(int i, int value)
+{
+  instr_regs[i] = value;
+}
+
+
 VMInstr VMInstr::PUSH(const VMValue& value)
 {
   return VMInstr(OpCode::PUSH, value);
@@ -238,6 +250,12 @@ VMInstr VMInstr::ALLOCS()
 }
 
 
+VMInstr VMInstr::ALLOCS(const string& struct_name)
+{
+  return VMInstr(OpCode::ALLOCS, struct_name);
+}
+
+
 VMInstr VMInstr::ALLOCA()
 {
   return VMInstr(OpCode::ALLOCA);    
@@ -314,6 +332,21 @@ VMInstr VMInstr::LRETRIEVE()
   return VMInstr(OpCode::LRETRIEVE);    
 }
 
+VMInstr VMInstr::ADDLE()
+{
+  return VMInstr(OpCode::ADDLE);
+}
+
+VMInstr VMInstr::HDUMP()
+{
+  return VMInstr(OpCode::HDUMP);
+}
+
+VMInstr VMInstr::PUSHK(int constant_index)
+{
+  return VMInstr(OpCode::PUSHK, constant_index);
+}
+
 // LISTS
 
 VMInstr VMInstr::ADDF(const string& field)
@@ -322,15 +355,15 @@ VMInstr VMInstr::ADDF(const string& field)
 }
 
 
-VMInstr VMInstr::SETF(const string& field)
+VMInstr VMInstr::SETF(const string& field, int slot)
 {
-  return VMInstr(OpCode::SETF, field);      
+  return VMInstr(OpCode::SETF, field, slot, -1, -1);      
 }
 
 
-VMInstr VMInstr::GETF(const string& field)
+VMInstr VMInstr::GETF(const string& field, int slot)
 {
-  return VMInstr(OpCode::GETF, field);
+  return VMInstr(OpCode::GETF, field, slot, -1, -1);
 }
 
 
@@ -358,19 +391,220 @@ VMInstr VMInstr::NOP()
 }
 
 
-string to_string(const VMValue& val) {
-  if (holds_alternative<int>(val))
-    return to_string(get<int>(val));
-  else if (holds_alternative<double>(val))
-    return to_string(get<double>(val));
-  else if (holds_alternative<bool>(val) and get<bool>(val))
-    return "true";
-  else if (holds_alternative<bool>(val) and !get<bool>(val))
-    return "false";
-  else if (holds_alternative<string>(val))
-    return get<string>(val);
-  else
-    return "null";
+VMInstr VMInstr::MOVR(int r1, int r2)
+{
+  return VMInstr(OpCode::MOVR, nullopt, r1, r2, -1);
+}
+
+
+VMInstr VMInstr::MOVK(int r1, const VMValue& value)
+{
+  return VMInstr(OpCode::MOVK, value, r1, -1, -1);
+}
+
+
+VMInstr VMInstr::ADDR(int r1, int r2, int r3)
+{
+  return VMInstr(OpCode::ADDR, nullopt, r1, r2, r3);
+}
+
+
+VMInstr VMInstr::SUBR(int r1, int r2, int r3)
+{
+  return VMInstr(OpCode::SUBR, nullopt, r1, r2, r3);
+}
+
+
+VMInstr VMInstr::MULR(int r1, int r2, int r3)
+{
+  return VMInstr(OpCode::MULR, nullopt, r1, r2, r3);
+}
+
+
+VMInstr VMInstr::DIVR(int r1, int r2, int r3)
+{
+  return VMInstr(OpCode::DIVR, nullopt, r1, r2, r3);
+}
+
+
+VMInstr VMInstr::ANDR(int r1, int r2, int r3)
+{
+  return VMInstr(OpCode::ANDR, nullopt, r1, r2, r3);
+}
+
+
+VMInstr VMInstr::ORR(int r1, int r2, int r3)
+{
+  return VMInstr(OpCode::ORR, nullopt, r1, r2, r3);
+}
+
+
+VMInstr VMInstr::NOTR(int r1, int r2)
+{
+  return VMInstr(OpCode::NOTR, nullopt, r1, r2, -1);
+}
+
+
+VMInstr VMInstr::CMPLTR(int r1, int r2, int r3)
+{
+  return VMInstr(OpCode::CMPLTR, nullopt, r1, r2, r3);
+}
+
+
+VMInstr VMInstr::CMPLER(int r1, int r2, int r3)
+{
+  return VMInstr(OpCode::CMPLER, nullopt, r1, r2, r3);
+}
+
+
+VMInstr VMInstr::CMPGTR(int r1, int r2, int r3)
+{
+  return VMInstr(OpCode::CMPGTR, nullopt, r1, r2, r3);
+}
+
+
+VMInstr VMInstr::CMPGER(int r1, int r2, int r3)
+{
+  return VMInstr(OpCode::CMPGER, nullopt, r1, r2, r3);
+}
+
+
+VMInstr VMInstr::CMPEQR(int r1, int r2, int r3)
+{
+  return VMInstr(OpCode::CMPEQR, nullopt, r1, r2, r3);
+}
+
+
+VMInstr VMInstr::CMPNER(int r1, int r2, int r3)
+{
+  return VMInstr(OpCode::CMPNER, nullopt, r1, r2, r3);
+}
+
+
+VMInstr VMInstr::JMPFR(int r1, int instruction_index)
+{
+  return VMInstr(OpCode::JMPFR, instruction_index, r1, -1, -1);
+}
+
+
+VMInstr VMInstr::CMPKJF(OpCode cmp, int r1, const VMValue& value,
+                        int instruction_index)
+{
+  return VMInstr(cmp, value, r1, instruction_index, -1);
+}
+
+
+VMInstr VMInstr::ADDK(int r1, int r2, const VMValue& value)
+{
+  return VMInstr(OpCode::ADDK, value, r1, r2, -1);
+}
+
+
+VMInstr VMInstr::SUBK(int r1, int r2, const VMValue& value)
+{
+  return VMInstr(OpCode::SUBK, value, r1, r2, -1);
+}
+
+
+VMInstr VMInstr::SETFN(const string& field, int slot)
+{
+  return VMInstr(OpCode::SETFN, field, slot, -1, -1);
+}
+
+
+VMInstr VMInstr::ADDI()
+{
+  return VMInstr(OpCode::ADDI);
+}
+
+
+VMInstr VMInstr::ADDD()
+{
+  return VMInstr(OpCode::ADDD);
+}
+
+
+VMInstr VMInstr::SUBI()
+{
+  return VMInstr(OpCode::SUBI);
+}
+
+
+VMInstr VMInstr::SUBD()
+{
+  return VMInstr(OpCode::SUBD);
+}
+
+
+VMInstr VMInstr::MULI()
+{
+  return VMInstr(OpCode::MULI);
+}
+
+
+VMInstr VMInstr::MULD()
+{
+  return VMInstr(OpCode::MULD);
+}
+
+
+VMInstr VMInstr::DIVI()
+{
+  return VMInstr(OpCode::DIVI);
+}
+
+
+VMInstr VMInstr::DIVD()
+{
+  return VMInstr(OpCode::DIVD);
+}
+
+
+VMInstr VMInstr::CMPLTI()
+{
+  return VMInstr(OpCode::CMPLTI);
+}
+
+
+VMInstr VMInstr::CMPLTD()
+{
+  return VMInstr(OpCode::CMPLTD);
+}
+
+
+VMInstr VMInstr::CMPLEI()
+{
+  return VMInstr(OpCode::CMPLEI);
+}
+
+
+VMInstr VMInstr::CMPLED()
+{
+  return VMInstr(OpCode::CMPLED);
+}
+
+
+VMInstr VMInstr::CMPGTI()
+{
+  return VMInstr(OpCode::CMPGTI);
+}
+
+
+VMInstr VMInstr::CMPGTD()
+{
+  return VMInstr(OpCode::CMPGTD);
+}
+
+
+VMInstr VMInstr::CMPGEI()
+{
+  return VMInstr(OpCode::CMPGEI);
+}
+
+
+VMInstr VMInstr::CMPGED()
+{
+  return VMInstr(OpCode::CMPGED);
 }
 
 
@@ -403,11 +637,50 @@ std::string to_string(const VMInstr& instr)
     {OpCode::LNUMS, "LNUMS"}, {OpCode::LNUMB, "LNUMB"},
     {OpCode::LRMB, "LRMB"}, {OpCode::LAVGI, "LAVGI"},
     {OpCode::LAVGD, "LAVGD"}, {OpCode::LSIZE, "LSIZE"},
-    {OpCode::LRETRIEVE, "LRETRIEVE"}
+    {OpCode::LRETRIEVE, "LRETRIEVE"}, {OpCode::MOVR, "MOVR"},
+    {OpCode::MOVK, "MOVK"}, {OpCode::ADDR, "ADDR"},
+    {OpCode::SUBR, "SUBR"}, {OpCode::MULR, "MULR"},
+    {OpCode::DIVR, "DIVR"}, {OpCode::ANDR, "ANDR"},
+    {OpCode::ORR, "ORR"}, {OpCode::NOTR, "NOTR"},
+    {OpCode::CMPLTR, "CMPLTR"}, {OpCode::CMPLER, "CMPLER"},
+    {OpCode::CMPGTR, "CMPGTR"}, {OpCode::CMPGER, "CMPGER"},
+    {OpCode::CMPEQR, "CMPEQR"}, {OpCode::CMPNER, "CMPNER"},
+    {OpCode::JMPFR, "JMPFR"}, {OpCode::CMPLTKJF, "CMPLTKJF"},
+    {OpCode::CMPLEKJF, "CMPLEKJF"}, {OpCode::CMPGTKJF, "CMPGTKJF"},
+    {OpCode::CMPGEKJF, "CMPGEKJF"}, {OpCode::CMPEQKJF, "CMPEQKJF"},
+    {OpCode::CMPNEKJF, "CMPNEKJF"}, {OpCode::ADDK, "ADDK"},
+    {OpCode::SUBK, "SUBK"}, {OpCode::SETFN, "SETFN"},
+    {OpCode::ADDI, "ADDI"}, {OpCode::ADDD, "ADDD"},
+    {OpCode::SUBI, "SUBI"}, {OpCode::SUBD, "SUBD"},
+    {OpCode::MULI, "MULI"}, {OpCode::MULD, "MULD"},
+    {OpCode::DIVI, "DIVI"}, {OpCode::DIVD, "DIVD"},
+    {OpCode::CMPLTI, "CMPLTI"}, {OpCode::CMPLTD, "CMPLTD"},
+    {OpCode::CMPLEI, "CMPLEI"}, {OpCode::CMPLED, "CMPLED"},
+    {OpCode::CMPGTI, "CMPGTI"}, {OpCode::CMPGTD, "CMPGTD"},
+    {OpCode::CMPGEI, "CMPGEI"}, {OpCode::CMPGED, "CMPGED"},
+    {OpCode::ADDLE, "ADDLE"}, {OpCode::HDUMP, "HDUMP"},
+    {OpCode::PUSHK, "PUSHK"}
   };
   string vstr = "";
-  if (instr.operand().has_value()) {
-    vstr = to_string(instr.operand().value());
+  // field instructions give the field's slot instead of registers
+  OpCode op = instr.opcode();
+  bool field = op == OpCode::GETF or op == OpCode::SETF or op == OpCode::SETFN;
+  if (op >= OpCode::CMPLTKJF and op <= OpCode::CMPNEKJF) {
+    // the register, the constant, then the jump target (as for JMPF)
+    vstr = "r" + to_string(instr.reg(0)) + ", " +
+      to_string(instr.operand().value()) + ", " + to_string(instr.reg(1));
+  }
+  else {
+    for (int i = 0; i < 3 and instr.reg(i) != -1; ++i) {
+      if (i > 0)
+        vstr += ", ";
+      vstr += (field ? "#" : "r") + to_string(instr.reg(i));
+    }
+    if (instr.operand().has_value()) {
+      if (vstr != "")
+        vstr += ", ";
+      vstr += to_string(instr.operand().value());
+    }
   }
   string s = os[instr.opcode()] + "(" + vstr + ")";
   if (instr.instr_comment != "")
@@ -9,17 +9,10 @@
 #ifndef VM_INSTR_H
 #define VM_INSTR_H
 
-#include <variant>
 #include <optional>
 #include <string>
 #include "op_code.h"
-
-
-// vm values are one of int, double, bool, string, or nullptr_t
-typedef std::variant<int, double, bool, std::string, std::nullptr_t> VMValue;
-
-// function to get a string representation of a vm_value
-std::string to_string(const VMValue& val);
+#include "vm_value.h"
 
 
 class VMInstr
@@ -58,6 +51,7 @@ public:
   static VMInstr TOSTR();
   static VMInstr CONCAT();
   static VMInstr ALLOCS();
+  static VMInstr ALLOCS(const std::string& struct_name);
   static VMInstr ALLOCA();
   // Lists
   static VMInstr ALLOCL();
@@ -74,14 +68,57 @@ public:
   static VMInstr LAVGD();
   static VMInstr LSIZE();
   static VMInstr LRETRIEVE();
+  static VMInstr ADDLE();
+  static VMInstr HDUMP();
+  static VMInstr PUSHK(int constant_index);
   // Lists
   static VMInstr ADDF(const std::string& field);
-  static VMInstr SETF(const std::string& field);
-  static VMInstr GETF(const std::string& field);
+  static VMInstr SETF(const std::string& field, int slot = -1);
+  static VMInstr GETF(const std::string& field, int slot = -1);
   static VMInstr SETI();
   static VMInstr GETI();  
   static VMInstr DUP();
   static VMInstr NOP();
+  // Registers
+  static VMInstr MOVR(int r1, int r2);
+  static VMInstr MOVK(int r1, const VMValue& value);
+  static VMInstr ADDR(int r1, int r2, int r3);
+  static VMInstr SUBR(int r1, int r2, int r3);
+  static VMInstr MULR(int r1, int r2, int r3);
+  static VMInstr DIVR(int r1, int r2, int r3);
+  static VMInstr ANDR(int r1, int r2, int r3);
+  static VMInstr ORR(int r1, int r2, int r3);
+  static VMInstr NOTR(int r1, int r2);
+  static VMInstr CMPLTR(int r1, int r2, int r3);
+  static VMInstr CMPLER(int r1, int r2, int r3);
+  static VMInstr CMPGTR(int r1, int r2, int r3);
+  static VMInstr CMPGER(int r1, int r2, int r3);
+  static VMInstr CMPEQR(int r1, int r2, int r3);
+  static VMInstr CMPNER(int r1, int r2, int r3);
+  static VMInstr JMPFR(int r1, int instruction_index);
+  // Superinstructions
+  static VMInstr CMPKJF(OpCode cmp, int r1, const VMValue& value,
+                        int instruction_index);
+  static VMInstr ADDK(int r1, int r2, const VMValue& value);
+  static VMInstr SUBK(int r1, int r2, const VMValue& value);
+  static VMInstr SETFN(const std::string& field, int slot = -1);
+  // Typed operations
+  static VMInstr ADDI();
+  static VMInstr ADDD();
+  static VMInstr SUBI();
+  static VMInstr SUBD();
+  static VMInstr MULI();
+  static VMInstr MULD();
+  static VMInstr DIVI();
+  static VMInstr DIVD();
+  static VMInstr CMPLTI();
+  static VMInstr CMPLTD();
+  static VMInstr CMPLEI();
+  static VMInstr CMPLED();
+  static VMInstr CMPGTI();
+  static VMInstr CMPGTD();
+  static VMInstr CMPGEI();
+  static VMInstr CMPGED();
 
   // set the instruction's comment (optional)
   void set_comment(const std::string& comment);
@@ -93,10 +130,17 @@ public:
   OpCode opcode() const;
 
   // returns the operand for those instructions with operands
-  std::optional<VMValue> operand() const;
+  const std::optional<VMValue>& operand() const;
 
   // set the operand value
   void set_operand(VMValue value);
+
+  // returns the i-th (0, 1, or 2) register operand (or -1 if unused),
+  // for GETF, SETF, and SETFN the first is the field's slot
+  int reg(int i) const { return instr_regs[i]; }
+
+  // set the i-th register operand
+  void set_reg(int i, int value);
   
   // pretty print the instruction
   friend std::string to_string(const VMInstr& instr);
@@ -109,6 +153,9 @@ private:
   // some instructions have operands
   std::optional<VMValue> instr_operand;
 
+  // register instructions name up to three local variable slots
+  int instr_regs[3] = {-1, -1, -1};
+
   // comments can be optionally added
   std::string instr_comment;
 
@@ -118,6 +165,10 @@ private:
   // operand constructor (helper) for use by static construction methods
   VMInstr(OpCode opcode, const VMValue& value);
 
+  // register constructor (helper) for use by static construction methods
+  VMInstr(OpCode opcode, const std::optional<VMValue>& value, int r1,
+          int r2, int r3);
+
 };
 
 
@@ -0,0 +1,681 @@
+//----------------------------------------------------------------------
+// FILE: vm_jit.cpp
+// DATE: CPSC 326, Spring 2023
+// AUTH: Cameron Chetcuti
+// DESC: Baseline x86-64 JIT compiler for MyPL VM functions
+//----------------------------------------------------------------------
+
+#include <cstdint>
+#include <cstring>
+#include <exception>
+#include <utility>
+#include "vm_jit.h"
+#include "vm.h"
+#include "vm_execute.h"
+
+#if defined(__x86_64__) && defined(__linux__)
+#include <sys/mman.h>
+#define VM_JIT_X86_64
+#endif
+
+using namespace std;
+
+
+namespace {
+
+  // helper results checked by the native code
+  const int CONTINUE = 0;
+  const int BRANCH = 1;
+  const int ERROR = 2;
+
+  // the jump target of a (supported) jump instruction (or -1)
+  int jump_target(const VMInstr& instr)
+  {
+    OpCode op = instr.opcode();
+    if (op == OpCode::JMP or op == OpCode::JMPF or op == OpCode::JMPFR)
+      return instr.operand().value().as_int();
+    if (op >= OpCode::CMPLTKJF and op <= OpCode::CMPNEKJF)
+      return instr.reg(1);
+    return -1;
+  }
+
+  // Emits x86-64 machine code into a byte buffer. Jumps to instructions
+  // are recorded and patched once every instruction's offset is known.
+  class Assembler
+  {
+  public:
+
+    vector<uint8_t> code;
+
+    void bytes(initializer_list<uint8_t> bs) {
+      code.insert(code.end(), bs);
+    }
+
+    void imm32(int32_t v) {
+      for (int i = 0; i < 4; ++i)
+        code.push_back((v >> (8 * i)) & 0xff);
+    }
+
+    void imm64(uint64_t v) {
+      for (int i = 0; i < 8; ++i)
+        code.push_back((v >> (8 * i)) & 0xff);
+    }
+
+    // emit a rel32 (to be patched) referring to the given label
+    void rel32(int label) {
+      fixups.push_back({code.size(), label});
+      imm32(0);
+    }
+
+    // label positions (offsets into code)
+    vector<size_t> labels;
+
+    // a new label (bound later)
+    int label() {
+      labels.push_back(0);
+      return labels.size() - 1;
+    }
+
+    // set the label to the current position
+    void bind(int label) {
+      labels[label] = code.size();
+    }
+
+    // jmp label
+    void jmp(int label) {
+      bytes({0xe9});
+      rel32(label);
+    }
+
+    // jcc label (for the given condition code)
+    void jcc(uint8_t cc, int label) {
+      bytes({0x0f, uint8_t(0x80 | cc)});
+      rel32(label);
+    }
+
+    void patch() {
+      for (auto [at, label] : fixups) {
+        int32_t rel = labels[label] - (at + 4);
+        memcpy(&code[at], &rel, 4);
+      }
+    }
+
+  private:
+    vector<pair<size_t,int>> fixups;
+
+  };
+
+
+  // x86-64 condition codes
+  const uint8_t CC_E = 0x4;
+  const uint8_t CC_NE = 0x5;
+  const uint8_t CC_L = 0xc;
+  const uint8_t CC_GE = 0xd;
+  const uint8_t CC_LE = 0xe;
+  const uint8_t CC_G = 0xf;
+
+  // the condition code of a (register, constant, or typed) comparison
+  uint8_t condition(OpCode op)
+  {
+    switch (op) {
+      case OpCode::CMPLTR: case OpCode::CMPLTKJF: case OpCode::CMPLTI:
+        return CC_L;
+      case OpCode::CMPLER: case OpCode::CMPLEKJF: case OpCode::CMPLEI:
+        return CC_LE;
+      case OpCode::CMPGTR: case OpCode::CMPGTKJF: case OpCode::CMPGTI:
+        return CC_G;
+      case OpCode::CMPGER: case OpCode::CMPGEKJF: case OpCode::CMPGEI:
+        return CC_GE;
+      case OpCode::CMPEQR: case OpCode::CMPEQKJF:
+        return CC_E;
+      default:
+        return CC_NE;
+    }
+  }
+
+  uint8_t tag(VMValue::Type type)
+  {
+    return static_cast<uint8_t>(type);
+  }
+
+  const uint8_t INT = tag(VMValue::Type::INT);
+  const uint8_t DOUBLE = tag(VMValue::Type::DOUBLE);
+  const uint8_t BOOL = tag(VMValue::Type::BOOL);
+  const uint8_t STRING = tag(VMValue::Type::STRING);
+
+
+  // Emits native code for the common case of an instruction (ints,
+  // doubles, and bools that need no reference counting), jumping to
+  // slow (the helper call) otherwise and to next when done. Values are
+  // a one byte tag followed by the payload at offset 8 (see
+  // VMJit::supported). While running, r14 is the value stack vector
+  // (begin, end, and capacity pointers), rax is the frame's first local
+  // variable, and rcx is the end of the stack. Returns false if there
+  // is no fast path for the instruction.
+  bool fast_path(Assembler& a, const VMInstr& instr, int next, int slow)
+  {
+    OpCode op = instr.opcode();
+    auto r = [&](int i) { return instr.reg(i) * 16; };
+    auto k = [&]() { return instr.operand().value(); };
+    auto locals = [&]() {
+      a.bytes({0x49, 0x8b, 0x06});                    // mov rax, [r14]
+      a.bytes({0x49, 0x63, 0x54, 0x24,                // movsxd rdx,
+               uint8_t(offsetof(VMFrame, base))});    //   [r12 + base]
+      a.bytes({0x48, 0xc1, 0xe2, 0x04});              // shl rdx, 4
+      a.bytes({0x48, 0x01, 0xd0});                    // add rax, rdx
+    };
+    auto end = [&]() {
+      a.bytes({0x49, 0x8b, 0x4e, 0x08});              // mov rcx, [r14+8]
+    };
+    // branch to slow unless the tag of the local at d is (isn't) t
+    auto local_is = [&](int d, uint8_t t) {
+      a.bytes({0x80, 0xb8}); a.imm32(d); a.bytes({t}); // cmp byte [rax+d], t
+      a.jcc(CC_NE, slow);
+    };
+    auto local_not = [&](int d, uint8_t t) {
+      a.bytes({0x80, 0xb8}); a.imm32(d); a.bytes({t}); // cmp byte [rax+d], t
+      a.jcc(CC_E, slow);
+    };
+    // the same for the stack value at rcx + d
+    auto stack_is = [&](int8_t d, uint8_t t) {
+      a.bytes({0x80, 0x79, uint8_t(d), t});           // cmp byte [rcx+d], t
+      a.jcc(CC_NE, slow);
+    };
+    auto stack_not = [&](int8_t d, uint8_t t) {
+      a.bytes({0x80, 0x79, uint8_t(d), t});           // cmp byte [rcx+d], t
+      a.jcc(CC_E, slow);
+    };
+    // branch to slow if the stack is full
+    auto room = [&]() {
+      a.bytes({0x49, 0x3b, 0x4e, 0x10});              // cmp rcx, [r14+16]
+      a.jcc(CC_E, slow);
+    };
+    auto push = [&]() {
+      a.bytes({0x49, 0x83, 0x46, 0x08, 0x10});        // add qword [r14+8], 16
+    };
+    auto pop = [&]() {
+      a.bytes({0x49, 0x83, 0x6e, 0x08, 0x10});        // sub qword [r14+8], 16
+    };
+    // store a constant value (tag and payload) at [base + d], where
+    // modrm selects the base (0x41 for rcx + disp8, 0x80 for rax + disp32)
+    auto constant = [&](uint8_t modrm, int d, const VMValue& v) {
+      auto disp = [&](int x) {
+        if (modrm & 0x80) a.imm32(x); else a.bytes({uint8_t(x)});
+      };
+      a.bytes({0xc6, modrm}); disp(d); a.bytes({tag(v.type())});
+      if (v.is_int() or v.is_null()) {
+        a.bytes({0xc7, modrm}); disp(d + 8);          // mov dword [..], v
+        a.imm32(v.is_int() ? v.as_int() : 0);
+      }
+      else if (v.is_bool()) {
+        a.bytes({0xc6, modrm}); disp(d + 8);          // mov byte [..], v
+        a.bytes({uint8_t(v.as_bool())});
+      }
+      else {
+        double x = v.as_double();
+        uint64_t bits;
+        memcpy(&bits, &x, 8);
+        a.bytes({0x48, 0xba}); a.imm64(bits);         // mov rdx, v
+        a.bytes({0x48, 0x89, uint8_t(modrm | 0x10)});
+        disp(d + 8);                                   // mov [..], rdx
+      }
+    };
+
+    switch (op) {
+
+      case OpCode::PUSH:
+        if (k().is_string())
+          return false;
+        end();
+        room();
+        constant(0x41, 0, k());                        // [rcx], [rcx+8]
+        push();
+        break;
+
+      case OpCode::POP:
+        end();
+        stack_not(-16, STRING);
+        pop();
+        break;
+
+      case OpCode::DUP:
+        end();
+        stack_not(-16, STRING);
+        room();
+        a.bytes({0x0f, 0x10, 0x41, 0xf0});            // movups xmm0, [rcx-16]
+        a.bytes({0x0f, 0x11, 0x01});                  // movups [rcx], xmm0
+        push();
+        break;
+
+      case OpCode::LOAD: {
+        int d = k().as_int() * 16;
+        locals();
+        local_not(d, STRING);
+        end();
+        room();
+        a.bytes({0x0f, 0x10, 0x80}); a.imm32(d);      // movups xmm0, [rax+d]
+        a.bytes({0x0f, 0x11, 0x01});                  // movups [rcx], xmm0
+        push();
+        break;
+      }
+
+      case OpCode::STORE: {
+        int d = k().as_int() * 16;
+        locals();
+        local_not(d, STRING);
+        end();
+        stack_not(-16, STRING);
+        a.bytes({0x0f, 0x10, 0x41, 0xf0});            // movups xmm0, [rcx-16]
+        a.bytes({0x0f, 0x11, 0x80}); a.imm32(d);      // movups [rax+d], xmm0
+        pop();
+        break;
+      }
+
+      case OpCode::JMPF:
+        end();
+        stack_is(-16, BOOL);
+        a.bytes({0x8a, 0x51, 0xf8});                  // mov dl, [rcx-8]
+        pop();
+        a.bytes({0x84, 0xd2});                        // test dl, dl
+        a.jcc(CC_E, instr.operand().value().as_int());
+        break;
+
+      case OpCode::ADDI: case OpCode::SUBI: case OpCode::MULI:
+        end();
+        stack_is(-16, INT);
+        stack_is(-32, INT);
+        a.bytes({0x8b, 0x51, 0xe8});                  // mov edx, [rcx-24]
+        if (op == OpCode::ADDI)
+          a.bytes({0x03, 0x51, 0xf8});                // add edx, [rcx-8]
+        else if (op == OpCode::SUBI)
+          a.bytes({0x2b, 0x51, 0xf8});                // sub edx, [rcx-8]
+        else
+          a.bytes({0x0f, 0xaf, 0x51, 0xf8});          // imul edx, [rcx-8]
+        a.bytes({0x89, 0x51, 0xe8});                  // mov [rcx-24], edx
+        pop();
+        break;
+
+      case OpCode::ADDD: case OpCode::SUBD: case OpCode::MULD:
+      case OpCode::DIVD: {
+        uint8_t sse = op == OpCode::ADDD ? 0x58 : op == OpCode::SUBD ? 0x5c :
+          op == OpCode::MULD ? 0x59 : 0x5e;
+        end();
+        stack_is(-16, DOUBLE);
+        stack_is(-32, DOUBLE);
+        a.bytes({0xf2, 0x0f, 0x10, 0x41, 0xe8});      // movsd xmm0, [rcx-24]
+        a.bytes({0xf2, 0x0f, sse, 0x41, 0xf8});       // op xmm0, [rcx-8]
+        a.bytes({0xf2, 0x0f, 0x11, 0x41, 0xe8});      // movsd [rcx-24], xmm0
+        pop();
+        break;
+      }
+
+      case OpCode::CMPLTI: case OpCode::CMPLEI: case OpCode::CMPGTI:
+      case OpCode::CMPGEI:
+        end();
+        stack_is(-16, INT);
+        stack_is(-32, INT);
+        a.bytes({0x8b, 0x51, 0xe8});                  // mov edx, [rcx-24]
+        a.bytes({0x3b, 0x51, 0xf8});                  // cmp edx, [rcx-8]
+        a.bytes({0x0f, uint8_t(0x90 | condition(op)), 0xc2}); // setcc dl
+        a.bytes({0x88, 0x51, 0xe8});                  // mov [rcx-24], dl
+        a.bytes({0xc6, 0x41, 0xe0, BOOL});            // mov byte [rcx-32], BOOL
+        pop();
+        break;
+
+      case OpCode::MOVK:
+        if (k().is_string())
+          return false;
+        locals();
+        local_not(r(0), STRING);
+        constant(0x80, r(0), k());                    // [rax+r0]
+        break;
+
+      case OpCode::MOVR:
+        locals();
+        local_not(r(0), STRING);
+        local_not(r(1), STRING);
+        a.bytes({0x0f, 0x10, 0x80}); a.imm32(r(1));   // movups xmm0, [rax+r1]
+        a.bytes({0x0f, 0x11, 0x80}); a.imm32(r(0));   // movups [rax+r0], xmm0
+        break;
+
+      case OpCode::ADDK: case OpCode::SUBK:
+        if (!k().is_int())
+          return false;
+        locals();
+        local_not(r(0), STRING);
+        local_is(r(1), INT);
+        a.bytes({0x8b, 0x88}); a.imm32(r(1) + 8);     // mov ecx, [rax+r1+8]
+        a.bytes({0x81, uint8_t(op == OpCode::ADDK ? 0xc1 : 0xe9)});
+        a.imm32(k().as_int());                         // add/sub ecx, k
+        a.bytes({0x89, 0x88}); a.imm32(r(0) + 8);     // mov [rax+r0+8], ecx
+        a.bytes({0xc6, 0x80}); a.imm32(r(0));         // mov byte [rax+r0],
+        a.bytes({INT});                                //   INT
+        break;
+
+      case OpCode::ADDR: case OpCode::SUBR: case OpCode::MULR:
+        locals();
+        local_not(r(0), STRING);
+        local_is(r(1), INT);
+        local_is(r(2), INT);
+        a.bytes({0x8b, 0x88}); a.imm32(r(1) + 8);     // mov ecx, [rax+r1+8]
+        if (op == OpCode::ADDR)
+          a.bytes({0x03, 0x88});                      // add ecx, [rax+r2+8]
+        else if (op == OpCode::SUBR)
+          a.bytes({0x2b, 0x88});                      // sub ecx, [rax+r2+8]
+        else
+          a.bytes({0x0f, 0xaf, 0x88});                // imul ecx, [rax+r2+8]
+        a.imm32(r(2) + 8);
+        a.bytes({0x89, 0x88}); a.imm32(r(0) + 8);     // mov [rax+r0+8], ecx
+        a.bytes({0xc6, 0x80}); a.imm32(r(0));         // mov byte [rax+r0],
+        a.bytes({INT});                                //   INT
+        break;
+
+      case OpCode::CMPLTR: case OpCode::CMPLER: case OpCode::CMPGTR:
+      case OpCode::CMPGER: case OpCode::CMPEQR: case OpCode::CMPNER:
+        locals();
+        local_not(r(0), STRING);
+        local_is(r(1), INT);
+        local_is(r(2), INT);
+        a.bytes({0x8b, 0x88}); a.imm32(r(1) + 8);     // mov ecx, [rax+r1+8]
+        a.bytes({0x3b, 0x88}); a.imm32(r(2) + 8);     // cmp ecx, [rax+r2+8]
+        a.bytes({0x0f, uint8_t(0x90 | condition(op)), 0xc1}); // setcc cl
+        a.bytes({0x88, 0x88}); a.imm32(r(0) + 8);     // mov [rax+r0+8], cl
+        a.bytes({0xc6, 0x80}); a.imm32(r(0));         // mov byte [rax+r0],
+        a.bytes({BOOL});                               //   BOOL
+        break;
+
+      case OpCode::JMPFR:
+        locals();
+        local_is(r(0), BOOL);
+        a.bytes({0x80, 0xb8}); a.imm32(r(0) + 8);     // cmp byte [rax+r0+8],
+        a.bytes({0x00});                               //   0
+        a.jcc(CC_E, instr.operand().value().as_int());
+        break;
+
+      case OpCode::CMPLTKJF: case OpCode::CMPLEKJF: case OpCode::CMPGTKJF:
+      case OpCode::CMPGEKJF: case OpCode::CMPEQKJF: case OpCode::CMPNEKJF:
+        if (!k().is_int())
+          return false;
+        locals();
+        local_is(r(0), INT);
+        a.bytes({0x81, 0xb8}); a.imm32(r(0) + 8);     // cmp dword [rax+r0+8],
+        a.imm32(k().as_int());                         //   k
+        a.jcc(condition(op) ^ 1, instr.reg(1));       // jump unless true
+        break;
+
+      default:
+        return false;
+    }
+    a.jmp(next);
+    return true;
+  }
+
+}
+
+
+//----------------------------------------------------------------------
+// Native code management
+//----------------------------------------------------------------------
+
+VMJit::~VMJit()
+{
+  for (Function& f : functions)
+    release(f);
+}
+
+
+bool VMJit::supported()
+{
+#ifdef VM_JIT_X86_64
+  // the native code relies on the layout of values (tag byte, payload at
+  // offset 8) and of the value stack (begin, end, capacity pointers)
+  static bool layout_ok = [] {
+    VMValue v(0x12345678);
+    uint8_t bytes[16];
+    memcpy(bytes, &v, 16);
+    int32_t payload;
+    memcpy(&payload, bytes + 8, 4);
+    vector<VMValue> stack;
+    stack.reserve(4);
+    stack.push_back(v);
+    VMValue* const* p = reinterpret_cast<VMValue* const*>(&stack);
+    return bytes[0] == static_cast<uint8_t>(VMValue::Type::INT) and
+      payload == 0x12345678 and sizeof(stack) == 24 and
+      p[0] == stack.data() and p[1] == stack.data() + 1 and
+      p[2] == stack.data() + 4;
+  }();
+  return layout_ok;
+#else
+  return false;
+#endif
+}
+
+
+void VMJit::reset(int function_count)
+{
+  for (Function& f : functions)
+    release(f);
+  functions.clear();
+  functions.resize(function_count);
+}
+
+
+void VMJit::release(Function& f)
+{
+#ifdef VM_JIT_X86_64
+  if (f.memory)
+    munmap(f.memory, f.size);
+#endif
+  f.memory = nullptr;
+  f.code = nullptr;
+}
+
+
+VMJit::NativeCode VMJit::called(int index, const VMFrameInfo& info,
+                                int threshold)
+{
+  Function& f = functions[index];
+  if (!f.attempted and ++f.calls > threshold) {
+    f.attempted = true;
+    compile(info, f);
+  }
+  return f.code;
+}
+
+
+int VMJit::compiled_count() const
+{
+  int count = 0;
+  for (const Function& f : functions)
+    if (f.code)
+      ++count;
+  return count;
+}
+
+
+// Native code layout (System V calling convention):
+//
+//   prologue: saves rbx, r12, r13, r14 and sets rbx = vm, r12 = frame,
+//             r13 = &executed, r14 = &value_stack, then jumps to
+//             entries[pc]
+//   instr i:  counts the instruction, runs its fast path (if any), or
+//             else calls its helper (vm, frame, &instr, i), branching
+//             on the result
+//   exit i:   returns i (calls, returns, and the end of the function)
+//   error:    returns -1
+void VMJit::compile(const VMFrameInfo& info, Function& f)
+{
+#ifdef VM_JIT_X86_64
+  const vector<VMInstr>& instructions = info.instructions;
+  int n = instructions.size();
+  for (const VMInstr& instr : instructions) {
+    OpCode op = instr.opcode();
+    if (op != OpCode::JMP and op != OpCode::CALL and op != OpCode::RET and
+        !helper(op))
+      return;
+    if (jump_target(instr) > n)
+      return;
+  }
+
+  // labels 0 to n are instructions (n is the end), then error and return
+  Assembler a;
+  a.labels.resize(n + 1);
+  const int error_label = a.label();
+  const int return_label = a.label();
+  f.entries.resize(n + 1);
+
+  // prologue
+  a.bytes({0x53, 0x41, 0x54, 0x41, 0x55});    // push rbx, r12, r13
+  a.bytes({0x41, 0x56});                      // push r14
+  a.bytes({0x48, 0x83, 0xec, 0x08});          // sub rsp, 8 (alignment)
+  a.bytes({0x48, 0x89, 0xfb});                // mov rbx, rdi
+  a.bytes({0x49, 0x89, 0xf4});                // mov r12, rsi
+  a.bytes({0x49, 0x89, 0xd5});                // mov r13, rdx
+  a.bytes({0x4d, 0x89, 0xc6});                // mov r14, r8
+  a.bytes({0x89, 0xc8});                      // mov eax, ecx
+  a.bytes({0x48, 0xba});                      // mov rdx, entries
+  a.imm64(reinterpret_cast<uint64_t>(f.entries.data()));
+  a.bytes({0xff, 0x24, 0xc2});                // jmp [rdx + rax*8]
+
+  // an exit returning i to the interpreter
+  auto exit = [&](int i) {
+    a.bytes({0xb8});                          // mov eax, i
+    a.imm32(i);
+    a.bytes({0xe9});                          // jmp return
+    a.rel32(return_label);
+  };
+
+  for (int i = 0; i < n; ++i) {
+    const VMInstr& instr = instructions[i];
+    OpCode op = instr.opcode();
+    a.labels[i] = a.code.size();
+    if (op == OpCode::CALL or op == OpCode::RET) {
+      exit(i);
+      continue;
+    }
+    a.bytes({0x49, 0x83, 0x45, 0x00, 0x01});  // add qword [r13], 1
+    if (op == OpCode::JMP) {
+      a.jmp(jump_target(instr));
+      continue;
+    }
+    int slow = a.label();
+    if (fast_path(a, instr, i + 1, slow))
+      a.bind(slow);
+    a.bytes({0x48, 0x89, 0xdf});              // mov rdi, rbx
+    a.bytes({0x4c, 0x89, 0xe6});              // mov rsi, r12
+    a.bytes({0x48, 0xba});                    // mov rdx, &instr
+    a.imm64(reinterpret_cast<uint64_t>(&instr));
+    a.bytes({0xb9});                          // mov ecx, i
+    a.imm32(i);
+    a.bytes({0x48, 0xb8});                    // mov rax, helper
+    a.imm64(reinterpret_cast<uint64_t>(helper(op)));
+    a.bytes({0xff, 0xd0});                    // call rax
+    int target = jump_target(instr);
+    if (target != -1) {
+      a.bytes({0x83, 0xf8, 0x01});            // cmp eax, 1
+      a.bytes({0x0f, 0x84});                  // je target
+      a.rel32(target);
+      a.bytes({0x0f, 0x87});                  // ja error
+      a.rel32(error_label);
+    }
+    else {
+      a.bytes({0x85, 0xc0});                  // test eax, eax
+      a.bytes({0x0f, 0x85});                  // jnz error
+      a.rel32(error_label);
+    }
+  }
+  a.labels[n] = a.code.size();
+  exit(n);
+
+  a.labels[error_label] = a.code.size();
+  a.bytes({0xb8});                            // mov eax, -1
+  a.imm32(-1);
+  a.labels[return_label] = a.code.size();
+  a.bytes({0x48, 0x83, 0xc4, 0x08});          // add rsp, 8
+  a.bytes({0x41, 0x5e});                      // pop r14
+  a.bytes({0x41, 0x5d, 0x41, 0x5c, 0x5b});    // pop r13, r12, rbx
+  a.bytes({0xc3});                            // ret
+  a.patch();
+
+  // copy into executable memory
+  size_t size = a.code.size();
+  void* memory = mmap(nullptr, size, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (memory == MAP_FAILED)
+    return;
+  memcpy(memory, a.code.data(), size);
+  if (mprotect(memory, size, PROT_READ | PROT_EXEC) != 0) {
+    munmap(memory, size);
+    return;
+  }
+  uint8_t* base = static_cast<uint8_t*>(memory);
+  for (int i = 0; i <= n; ++i)
+    f.entries[i] = base + a.labels[i];
+  f.memory = memory;
+  f.size = size;
+  f.code = reinterpret_cast<NativeCode>(memory);
+#endif
+}
+
+
+//----------------------------------------------------------------------
+// Helpers
+//----------------------------------------------------------------------
+
+VMJit::Helper VMJit::helper(OpCode op)
+{
+#define VM_JIT_HELPER(op) case OpCode::op: return &exec<OpCode::op>
+  switch (op) {
+    VM_JIT_HELPER(PUSH); VM_JIT_HELPER(PUSHK); VM_JIT_HELPER(POP);
+    VM_JIT_HELPER(LOAD); VM_JIT_HELPER(STORE); VM_JIT_HELPER(ADD);
+    VM_JIT_HELPER(SUB); VM_JIT_HELPER(MUL); VM_JIT_HELPER(DIV);
+    VM_JIT_HELPER(AND); VM_JIT_HELPER(OR); VM_JIT_HELPER(NOT);
+    VM_JIT_HELPER(CMPLT); VM_JIT_HELPER(CMPLE); VM_JIT_HELPER(CMPGT);
+    VM_JIT_HELPER(CMPGE); VM_JIT_HELPER(CMPEQ); VM_JIT_HELPER(CMPNE);
+    VM_JIT_HELPER(JMPF); VM_JIT_HELPER(WRITE); VM_JIT_HELPER(READ);
+    VM_JIT_HELPER(SLEN); VM_JIT_HELPER(ALEN); VM_JIT_HELPER(GETC);
+    VM_JIT_HELPER(TOINT); VM_JIT_HELPER(TODBL); VM_JIT_HELPER(TOSTR);
+    VM_JIT_HELPER(CONCAT); VM_JIT_HELPER(ALLOCS); VM_JIT_HELPER(ALLOCA);
+    VM_JIT_HELPER(ALLOCL); VM_JIT_HELPER(ADDLI); VM_JIT_HELPER(SETLE);
+    VM_JIT_HELPER(SETLI); VM_JIT_HELPER(GETLI); VM_JIT_HELPER(LNUMI);
+    VM_JIT_HELPER(LNUMD); VM_JIT_HELPER(LNUMS); VM_JIT_HELPER(LNUMB);
+    VM_JIT_HELPER(LRMB); VM_JIT_HELPER(LAVGI); VM_JIT_HELPER(LAVGD);
+    VM_JIT_HELPER(LSIZE); VM_JIT_HELPER(LRETRIEVE); VM_JIT_HELPER(ADDF);
+    VM_JIT_HELPER(SETF); VM_JIT_HELPER(GETF); VM_JIT_HELPER(SETI);
+    VM_JIT_HELPER(GETI); VM_JIT_HELPER(DUP); VM_JIT_HELPER(NOP);
+    VM_JIT_HELPER(MOVR); VM_JIT_HELPER(MOVK); VM_JIT_HELPER(ADDR);
+    VM_JIT_HELPER(SUBR); VM_JIT_HELPER(MULR); VM_JIT_HELPER(DIVR);
+    VM_JIT_HELPER(ANDR); VM_JIT_HELPER(ORR); VM_JIT_HELPER(NOTR);
+    VM_JIT_HELPER(CMPLTR); VM_JIT_HELPER(CMPLER); VM_JIT_HELPER(CMPGTR);
+    VM_JIT_HELPER(CMPGER); VM_JIT_HELPER(CMPEQR); VM_JIT_HELPER(CMPNER);
+    VM_JIT_HELPER(JMPFR); VM_JIT_HELPER(CMPLTKJF); VM_JIT_HELPER(CMPLEKJF);
+    VM_JIT_HELPER(CMPGTKJF); VM_JIT_HELPER(CMPGEKJF);
+    VM_JIT_HELPER(CMPEQKJF); VM_JIT_HELPER(CMPNEKJF); VM_JIT_HELPER(ADDK);
+    VM_JIT_HELPER(SUBK); VM_JIT_HELPER(SETFN); VM_JIT_HELPER(ADDI);
+    VM_JIT_HELPER(ADDD); VM_JIT_HELPER(SUBI); VM_JIT_HELPER(SUBD);
+    VM_JIT_HELPER(MULI); VM_JIT_HELPER(MULD); VM_JIT_HELPER(DIVI);
+    VM_JIT_HELPER(DIVD); VM_JIT_HELPER(CMPLTI); VM_JIT_HELPER(CMPLTD);
+    VM_JIT_HELPER(CMPLEI); VM_JIT_HELPER(CMPLED); VM_JIT_HELPER(CMPGTI);
+    VM_JIT_HELPER(CMPGTD); VM_JIT_HELPER(CMPGEI); VM_JIT_HELPER(CMPGED);
+    VM_JIT_HELPER(HDUMP); VM_JIT_HELPER(ADDLE);
+    default: return nullptr;
+  }
+#undef VM_JIT_HELPER
+}
+
+
+// Each instruction runs the interpreter's own handler (see
+// vm_execute.h).
+template<OpCode op>
+int VMJit::exec(VM* vm, VMFrame* frame, const VMInstr* instr, int pc)
+{
+  // errors are reported at the instruction (as in the interpreter), and
+  // must not unwind through the native code
+  frame->pc = pc + 1;
+  try {
+    return vm->execute<op>(frame, instr) ? BRANCH : CONTINUE;
+  } catch (...) {
+    vm->jit_error = current_exception();
+    return ERROR;
+  }
+}
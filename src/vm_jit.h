@@ -0,0 +1,97 @@
+//----------------------------------------------------------------------
+// FILE: vm_jit.h
+// DATE: CPSC 326, Spring 2023
+// AUTH: Cameron Chetcuti
+// DESC: Baseline x86-64 JIT compiler for MyPL VM functions
+//----------------------------------------------------------------------
+
+#ifndef VM_JIT_H
+#define VM_JIT_H
+
+#include <cstddef>
+#include <vector>
+#include "vm_frame.h"
+
+
+class VM;
+
+
+// Translates a function's instructions into x86-64 machine code (in an
+// mmap'd buffer). Jumps become native jumps and common instructions on
+// ints, doubles, and bools are done inline, everything else (and any
+// unexpected value) calls a helper that performs the instruction, so
+// the interpreter's dispatch is removed entirely. Calls and returns are
+// left to the interpreter: the native code stops at them and the
+// interpreter resumes the native code (at any instruction) afterwards.
+// The helpers run the interpreter's own handlers (see vm_execute.h), so
+// every other instruction has one.
+class VMJit
+{
+public:
+
+  // runs the frame's native code starting at instruction pc, returns
+  // the index of the instruction where it stopped (left to the
+  // interpreter) or -1 if an error was raised (see VM::jit_error)
+  using NativeCode = int (*)(VM* vm, VMFrame* frame,
+                             unsigned long long* executed, int pc,
+                             std::vector<VMValue>* value_stack);
+
+  VMJit() = default;
+  VMJit(const VMJit&) = delete;
+  VMJit& operator=(const VMJit&) = delete;
+  ~VMJit();
+
+  // true if native code can be generated on this platform
+  static bool supported();
+
+  // remove all native code and call counts (for the given number of
+  // functions)
+  void reset(int function_count);
+
+  // records a call of the function with the given index, compiling it
+  // once it has been called more than threshold times, returns the
+  // function's native code (or null if it isn't compiled)
+  NativeCode called(int index, const VMFrameInfo& info, int threshold);
+
+  // the native code of the function (or null if it isn't compiled)
+  NativeCode code(int index) const { return functions[index].code; }
+
+  // number of functions compiled to native code
+  int compiled_count() const;
+
+private:
+
+  struct Function {
+    int calls = 0;
+    bool attempted = false;
+    NativeCode code = nullptr;
+    void* memory = nullptr;
+    std::size_t size = 0;
+    // native address of each instruction (plus the end of the function)
+    std::vector<void*> entries;
+  };
+
+  std::vector<Function> functions;
+
+  // generate the native code for the function (null if unsupported)
+  void compile(const VMFrameInfo& info, Function& f);
+
+  // release the function's native code
+  void release(Function& f);
+
+  // helper called by the native code to perform an instruction
+  // (returns 0 to continue, 1 to take a branch, 2 on error)
+  using Helper = int (*)(VM* vm, VMFrame* frame, const VMInstr* instr,
+                         int pc);
+
+  // the helper for an opcode (or null if it has none)
+  static Helper helper(OpCode op);
+
+  // runs the instruction (catching any error for the native code)
+  template<OpCode op>
+  static int exec(VM* vm, VMFrame* frame, const VMInstr* instr, int pc);
+
+};
+
+
+#endif
@@ -0,0 +1,223 @@
+//----------------------------------------------------------------------
+// FILE: vm_list.cpp
+// DATE: CPSC 326, Spring 2023
+// AUTH: Cameron Chetcuti
+// DESC: Representation of VM list objects
+//----------------------------------------------------------------------
+
+#include <algorithm>
+#include "vm_list.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define VM_LIST_X86
+#endif
+
+using namespace std;
+
+
+//----------------------------------------------------------------------
+// Summation kernels for packed double lists (picked by CPU feature)
+//----------------------------------------------------------------------
+
+namespace {
+
+using DoubleSum = double (*)(const double*, size_t);
+
+
+double sum_doubles_scalar(const double* xs, size_t n)
+{
+  double sum = 0.0;
+  for (size_t i = 0; i < n; ++i)
+    sum += xs[i];
+  return sum;
+}
+
+
+#ifdef VM_LIST_X86
+
+__attribute__((target("sse2")))
+double sum_doubles_sse2(const double* xs, size_t n)
+{
+  __m128d acc0 = _mm_setzero_pd();
+  __m128d acc1 = _mm_setzero_pd();
+  size_t i = 0;
+  for (; i + 4 <= n; i += 4) {
+    acc0 = _mm_add_pd(acc0, _mm_loadu_pd(xs + i));
+    acc1 = _mm_add_pd(acc1, _mm_loadu_pd(xs + i + 2));
+  }
+  alignas(16) double lanes[2];
+  _mm_store_pd(lanes, _mm_add_pd(acc0, acc1));
+  return lanes[0] + lanes[1] + sum_doubles_scalar(xs + i, n - i);
+}
+
+
+__attribute__((target("avx")))
+double sum_doubles_avx(const double* xs, size_t n)
+{
+  __m256d acc0 = _mm256_setzero_pd();
+  __m256d acc1 = _mm256_setzero_pd();
+  size_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    acc0 = _mm256_add_pd(acc0, _mm256_loadu_pd(xs + i));
+    acc1 = _mm256_add_pd(acc1, _mm256_loadu_pd(xs + i + 4));
+  }
+  alignas(32) double lanes[4];
+  _mm256_store_pd(lanes, _mm256_add_pd(acc0, acc1));
+  return (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]) +
+    sum_doubles_scalar(xs + i, n - i);
+}
+
+#endif
+
+
+DoubleSum double_sum_kernel()
+{
+  static const DoubleSum kernel = [] {
+#ifdef VM_LIST_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx"))
+      return sum_doubles_avx;
+    if (__builtin_cpu_supports("sse2"))
+      return sum_doubles_sse2;
+#endif
+    return sum_doubles_scalar;
+  }();
+  return kernel;
+}
+
+
+// append doubling the capacity when full (amortized O(1) appends)
+template<typename T>
+void append(vector<T>& buffer, const T& value)
+{
+  if (buffer.size() == buffer.capacity())
+    buffer.reserve(max<size_t>(8, 2 * buffer.capacity()));
+  buffer.push_back(value);
+}
+
+}
+
+
+//----------------------------------------------------------------------
+// VMList
+//----------------------------------------------------------------------
+
+int VMList::size() const
+{
+  if (list_mode == Mode::INTS)
+    return ints.size();
+  if (list_mode == Mode::DOUBLES)
+    return doubles.size();
+  return values.size();
+}
+
+
+VMValue VMList::get(int index) const
+{
+  if (list_mode == Mode::INTS)
+    return VMValue(int(ints[index]));
+  if (list_mode == Mode::DOUBLES)
+    return VMValue(doubles[index]);
+  return values[index];
+}
+
+
+void VMList::set(int index, const VMValue& value)
+{
+  tally(get(index), -1);
+  tally(value, 1);
+  if (list_mode == Mode::INTS and value.is_int())
+    ints[index] = value.as_int();
+  else if (list_mode == Mode::DOUBLES and value.is_double())
+    doubles[index] = value.as_double();
+  else {
+    make_tagged();
+    values[index] = value;
+  }
+}
+
+
+void VMList::push_back(const VMValue& value)
+{
+  // an empty list takes on the representation of its first value
+  if (empty()) {
+    ints.clear();
+    doubles.clear();
+    values.clear();
+    list_mode = value.is_int() ? Mode::INTS :
+      value.is_double() ? Mode::DOUBLES : Mode::TAGGED;
+    double_sum = 0.0;
+    double_sum_stale = false;
+  }
+  tally(value, 1);
+  if (list_mode == Mode::INTS and value.is_int())
+    append(ints, int32_t(value.as_int()));
+  else if (list_mode == Mode::DOUBLES and value.is_double())
+    append(doubles, value.as_double());
+  else {
+    make_tagged();
+    append(values, value);
+  }
+}
+
+
+void VMList::pop_back()
+{
+  tally(get(size() - 1), -1);
+  if (list_mode == Mode::INTS)
+    ints.pop_back();
+  else if (list_mode == Mode::DOUBLES)
+    doubles.pop_back();
+  else
+    values.pop_back();
+}
+
+
+void VMList::tally(const VMValue& value, int sign)
+{
+  type_counts[static_cast<int>(value.type())] += sign;
+  if (value.is_int())
+    int_sum += sign * (long long)value.as_int();
+  else if (value.is_double() and sign > 0)
+    double_sum += value.as_double();
+  else if (value.is_double())
+    double_sum_stale = true;
+}
+
+
+void VMList::make_tagged()
+{
+  if (list_mode == Mode::TAGGED)
+    return;
+  values.reserve(max<size_t>(8, 2 * size()));
+  if (list_mode == Mode::INTS) {
+    for (int32_t x : ints)
+      values.push_back(int(x));
+    vector<int32_t>().swap(ints);
+  }
+  else {
+    for (double x : doubles)
+      values.push_back(x);
+    vector<double>().swap(doubles);
+  }
+  list_mode = Mode::TAGGED;
+}
+
+
+double VMList::sum_doubles() const
+{
+  if (!double_sum_stale)
+    return double_sum;
+  if (list_mode == Mode::DOUBLES)
+    double_sum = double_sum_kernel()(doubles.data(), doubles.size());
+  else {
+    double_sum = 0.0;
+    for (const VMValue& value : values) {
+      if (value.is_double())
+        double_sum += value.as_double();
+    }
+  }
+  double_sum_stale = false;
+  return double_sum;
+}
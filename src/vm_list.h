@@ -0,0 +1,101 @@
+//----------------------------------------------------------------------
+// FILE: vm_list.h
+// DATE: CPSC 326, Spring 2023
+// AUTH: Cameron Chetcuti
+// DESC: Representation of VM list objects
+//----------------------------------------------------------------------
+
+#ifndef VM_LIST_H
+#define VM_LIST_H
+
+#include <cstdint>
+#include <vector>
+#include "vm_value.h"
+
+
+// A list of values stored contiguously by position. A list holding
+// only ints (or only doubles) keeps them packed in a plain buffer so
+// that the list built-ins can scan it with vector instructions. The
+// first other value added switches the list to tagged values for good
+// (until it is emptied). The number of values of each type and the
+// int and double sums are kept up to date as the list changes.
+class VMList
+{
+public:
+
+  enum class Mode : unsigned char {INTS, DOUBLES, TAGGED};
+
+  Mode mode() const {return list_mode;}
+
+  int size() const;
+
+  bool empty() const {return size() == 0;}
+
+  // the value at the given (valid) index
+  VMValue get(int index) const;
+
+  // set the value at the given (valid) index
+  void set(int index, const VMValue& value);
+
+  // add the value to the end of the list
+  void push_back(const VMValue& value);
+
+  // remove the last value of the (non-empty) list
+  void pop_back();
+
+  // the number of ints (doubles, strings, bools) in the list
+  int count_ints() const {return count(VMValue::Type::INT);}
+  int count_doubles() const {return count(VMValue::Type::DOUBLE);}
+  int count_strings() const {return count(VMValue::Type::STRING);}
+  int count_bools() const {return count(VMValue::Type::BOOL);}
+
+  // the sum of the ints (doubles) in the list
+  long long sum_ints() const {return int_sum;}
+  double sum_doubles() const;
+
+  // the bytes allocated for the list's values
+  std::size_t bytes() const
+  {
+    return ints.capacity() * sizeof(int32_t) +
+      doubles.capacity() * sizeof(double) +
+      values.capacity() * sizeof(VMValue);
+  }
+
+  // the values of a tagged list (empty otherwise, packed lists don't
+  // hold references)
+  const std::vector<VMValue>& tagged_values() const {return values;}
+
+private:
+
+  Mode list_mode = Mode::INTS;
+
+  std::vector<int32_t> ints;
+  std::vector<double> doubles;
+  std::vector<VMValue> values;
+
+  // the number of values of each type (indexed by type)
+  int type_counts[6] = {};
+
+  long long int_sum = 0;
+
+  // removing a double from the sum isn't exact, so instead the sum is
+  // recomputed the next time it is needed
+  mutable double double_sum = 0.0;
+  mutable bool double_sum_stale = false;
+
+  int count(VMValue::Type type) const
+  {
+    return type_counts[static_cast<int>(type)];
+  }
+
+  // add the value to (sign 1) or remove it from (sign -1) the counts
+  // and sums
+  void tally(const VMValue& value, int sign);
+
+  // switch to tagged values
+  void make_tagged();
+
+};
+
+
+#endif
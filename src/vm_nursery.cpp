@@ -0,0 +1,63 @@
+//----------------------------------------------------------------------
+// FILE: vm_nursery.cpp
+// DATE: CPSC 326, Spring 2023
+// AUTH: Cameron Chetcuti
+// DESC: Bump-pointer allocator for the values of young heap objects
+//----------------------------------------------------------------------
+
+#include <memory>
+#include <new>
+#include "vm_nursery.h"
+
+using namespace std;
+
+
+VMNursery::VMNursery(size_t chunk_size, size_t chunk_count)
+  : chunk_size(chunk_size), chunk_count(chunk_count)
+{
+}
+
+
+VMNursery::~VMNursery()
+{
+  reset();
+  for (VMValue* chunk : chunks)
+    ::operator delete(chunk);
+}
+
+
+VMValue* VMNursery::allocate(size_t count)
+{
+  if (count > chunk_size)
+    return nullptr;
+  if (used.empty() or used.back() + count > chunk_size) {
+    if (used.size() == chunk_count)
+      return nullptr;
+    if (chunks.size() == used.size()) {
+      void* chunk = ::operator new(chunk_size * sizeof(VMValue));
+      chunks.push_back(static_cast<VMValue*>(chunk));
+    }
+    used.push_back(0);
+  }
+  VMValue* values = chunks[used.size() - 1] + used.back();
+  uninitialized_default_construct_n(values, count);
+  used.back() += count;
+  return values;
+}
+
+
+bool VMNursery::exhausted(size_t count) const
+{
+  if (count > chunk_size)
+    return false;
+  return !used.empty() and used.size() == chunk_count and
+    used.back() + count > chunk_size;
+}
+
+
+void VMNursery::reset()
+{
+  for (size_t i = 0; i < used.size(); ++i)
+    destroy_n(chunks[i], used[i]);
+  used.clear();
+}
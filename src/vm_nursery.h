@@ -0,0 +1,57 @@
+//----------------------------------------------------------------------
+// FILE: vm_nursery.h
+// DATE: CPSC 326, Spring 2023
+// AUTH: Cameron Chetcuti
+// DESC: Bump-pointer allocator for the values of young heap objects
+//----------------------------------------------------------------------
+
+#ifndef VM_NURSERY_H
+#define VM_NURSERY_H
+
+#include <cstddef>
+#include <vector>
+#include "vm_value.h"
+
+
+// Hands out runs of (null) values from a fixed number of contiguous
+// chunks by bumping a pointer, so a new object's values cost no
+// allocation of their own. Values are never freed individually: once
+// the nursery is exhausted the VM collects garbage, moves the values of
+// the surviving objects out (promotes them), and resets the nursery.
+class VMNursery
+{
+public:
+
+  // a nursery of chunk_count chunks each holding chunk_size values
+  // (chunks are allocated on first use and kept across resets)
+  VMNursery(std::size_t chunk_size = 16384, std::size_t chunk_count = 4);
+  VMNursery(const VMNursery&) = delete;
+  VMNursery& operator=(const VMNursery&) = delete;
+  ~VMNursery();
+
+  // count null values from the current (or next) chunk, or null if
+  // they don't fit
+  VMValue* allocate(std::size_t count);
+
+  // true if count values no longer fit but would after a reset
+  bool exhausted(std::size_t count) const;
+
+  // destroy every value handed out and start again at the first chunk
+  void reset();
+
+private:
+
+  std::size_t chunk_size;
+  std::size_t chunk_count;
+
+  // the chunks' (uninitialized) storage
+  std::vector<VMValue*> chunks;
+
+  // number of values handed out from each chunk in use (the last one
+  // is the current chunk)
+  std::vector<std::size_t> used;
+
+};
+
+
+#endif
@@ -0,0 +1,80 @@
+//----------------------------------------------------------------------
+// FILE: vm_object.h
+// DATE: CPSC 326, Spring 2023
+// AUTH: Cameron Chetcuti
+// DESC: The VM's object table entries and heap object pools
+//----------------------------------------------------------------------
+
+#ifndef VM_OBJECT_H
+#define VM_OBJECT_H
+
+#include <deque>
+#include <vector>
+#include "vm_list.h"
+#include "vm_struct.h"
+#include "vm_value.h"
+
+
+using VMArray = std::vector<VMValue>;
+
+
+// An entry of the VM's object table (indexed by oid): the kind of heap
+// object the oid refers to and a pointer to it
+class VMObject
+{
+public:
+
+  enum class Kind : unsigned char {FREE, STRUCT, ARRAY, LIST};
+
+  Kind kind = Kind::FREE;
+
+  // true if the object is in the VM's remembered set
+  bool remembered = false;
+
+  union {
+    VMStruct* struct_obj = nullptr;
+    VMArray* array;
+    VMList* list;
+  };
+
+};
+
+
+// Heap objects of one kind with stable addresses. Released objects are
+// emptied and handed out again, so a program that keeps allocating and
+// dropping objects doesn't keep allocating memory for them.
+template<typename T>
+class VMPool
+{
+public:
+
+  // an empty object
+  T* acquire()
+  {
+    if (free_items.empty()) {
+      items.emplace_back();
+      return &items.back();
+    }
+    T* item = free_items.back();
+    free_items.pop_back();
+    return item;
+  }
+
+  // empty the object (releasing its memory) and make it available again
+  void release(T* item)
+  {
+    *item = T();
+    free_items.push_back(item);
+  }
+
+private:
+
+  // a deque so that adding an object doesn't move existing ones
+  std::deque<T> items;
+
+  std::vector<T*> free_items;
+
+};
+
+
+#endif
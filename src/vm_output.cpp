@@ -0,0 +1,63 @@
+//----------------------------------------------------------------------
+// FILE: vm_output.cpp
+// DATE: CPSC 326, Spring 2023
+// AUTH: Cameron Chetcuti
+// DESC: Buffered output of the values written by a VM program
+//----------------------------------------------------------------------
+
+#include <iostream>
+#include "vm_output.h"
+
+using namespace std;
+
+
+VMOutput::VMOutput(size_t capacity, bool line_flush)
+  : capacity(capacity), line_flush(line_flush)
+{
+  buffer.reserve(capacity);
+}
+
+
+VMOutput::~VMOutput()
+{
+  flush();
+}
+
+
+void VMOutput::configure(size_t capacity, bool line_flush)
+{
+  flush();
+  this->capacity = capacity;
+  this->line_flush = line_flush;
+  buffer.reserve(capacity);
+}
+
+
+void VMOutput::write(const VMValue& value)
+{
+  char buffer[max_value_chars];
+  append(to_chars(value, buffer));
+}
+
+
+void VMOutput::append(string_view str)
+{
+  if (buffer.size() + str.size() > capacity)
+    flush();
+  if (str.size() > capacity)
+    cout.write(str.data(), str.size());
+  else
+    buffer.append(str);
+  if (capacity == 0 or (line_flush and str.find('\n') != string_view::npos))
+    flush();
+}
+
+
+void VMOutput::flush()
+{
+  if (!buffer.empty()) {
+    cout.write(buffer.data(), buffer.size());
+    buffer.clear();
+  }
+  cout.flush();
+}
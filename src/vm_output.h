@@ -0,0 +1,52 @@
+//----------------------------------------------------------------------
+// FILE: vm_output.h
+// DATE: CPSC 326, Spring 2023
+// AUTH: Cameron Chetcuti
+// DESC: Buffered output of the values written by a VM program
+//----------------------------------------------------------------------
+
+#ifndef VM_OUTPUT_H
+#define VM_OUTPUT_H
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include "vm_value.h"
+
+
+// Collects what a program prints and hands it to std::cout in chunks
+// instead of one stream operation per value. Values are formatted
+// without allocating (see to_chars in vm_value.h).
+class VMOutput
+{
+public:
+
+  // buffer up to capacity bytes (0 writes each value right away),
+  // flushing at the end of each line written if line_flush
+  VMOutput(std::size_t capacity = 65536, bool line_flush = false);
+  VMOutput(const VMOutput&) = delete;
+  VMOutput& operator=(const VMOutput&) = delete;
+  ~VMOutput();
+
+  // change the buffer size and flush policy (flushes first)
+  void configure(std::size_t capacity, bool line_flush);
+
+  // append the value's string representation (see to_string)
+  void write(const VMValue& value);
+
+  // hand the buffered output to std::cout and flush it
+  void flush();
+
+private:
+
+  std::string buffer;
+
+  std::size_t capacity;
+  bool line_flush;
+
+  void append(std::string_view str);
+
+};
+
+
+#endif
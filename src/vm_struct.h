@@ -0,0 +1,55 @@
+//----------------------------------------------------------------------
+// FILE: vm_struct.h
+// DATE: CPSC 326, Spring 2023
+// AUTH: Cameron Chetcuti
+// DESC: Representation of VM struct objects and their shapes
+//----------------------------------------------------------------------
+
+#ifndef VM_STRUCT_H
+#define VM_STRUCT_H
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "vm_value.h"
+
+
+// The following are plain-old-data classes
+
+
+// The layout shared by every struct object with the same fields (added
+// in the same order). Shape 0 has no fields, the others are reached
+// from it by adding one field at a time.
+class VMShape
+{
+public:
+
+  // the field names in slot order
+  std::vector<std::string> fields;
+
+  // the slot of each field
+  std::unordered_map<std::string, int> slots;
+
+  // the shape reached by adding a (new) field to this one
+  std::unordered_map<std::string, int> transitions;
+
+};
+
+
+class VMStruct
+{
+public:
+
+  // index of the object's shape in the VM
+  int shape = 0;
+
+  // the field values (in the shape's slot order), in the VM's nursery
+  // while the object is young, otherwise in storage
+  VMValue* slots = nullptr;
+  int slot_count = 0;
+  bool young = false;
+  std::vector<VMValue> storage;
+
+};
+
+#endif
@@ -0,0 +1,350 @@
+//----------------------------------------------------------------------
+// FILE: vm_value.cpp
+// DATE: CPSC 326, Spring 2023
+// AUTH: Cameron Chetcuti
+// DESC: Compact tagged representation of MyPL VM values
+//----------------------------------------------------------------------
+
+#include <cctype>
+#include <cerrno>
+#include <cfloat>
+#include <charconv>
+#include <cmath>
+#include <cstdlib>
+#include <stdexcept>
+#include "vm_value.h"
+
+using namespace std;
+
+
+namespace {
+
+  // string lengths are stored in 32 bits (see VMValue::payload)
+  void check_length(size_t length)
+  {
+    if (length > max_string_length)
+      throw length_error("string too long");
+  }
+
+}
+
+
+//----------------------------------------------------------------------
+// VMValue
+//----------------------------------------------------------------------
+
+VMValue::VMValue()
+  : tag(Type::NULL_VAL)
+{
+  payload.i = 0;
+}
+
+
+VMValue::VMValue(int val)
+  : tag(Type::INT)
+{
+  payload.i = val;
+}
+
+
+VMValue::VMValue(double val)
+  : tag(Type::DOUBLE)
+{
+  payload.d = val;
+}
+
+
+VMValue::VMValue(bool val)
+  : tag(Type::BOOL)
+{
+  payload.b = val;
+}
+
+
+VMValue::VMValue(const char* val)
+  : VMValue(string(val))
+{
+}
+
+
+VMValue::VMValue(const string& val)
+  : tag(Type::STRING)
+{
+  check_length(val.size());
+  payload.s.handle = VMStringTable::instance().add(val);
+  payload.s.length = val.size();
+}
+
+
+VMValue::VMValue(string_view val)
+  : tag(Type::STRING)
+{
+  check_length(val.size());
+  payload.s.handle = VMStringTable::instance().add(val);
+  payload.s.length = val.size();
+}
+
+
+VMValue::VMValue(nullptr_t)
+  : VMValue()
+{
+}
+
+
+VMValue VMValue::ref(int oid)
+{
+  VMValue value(oid);
+  value.tag = Type::REF;
+  return value;
+}
+
+
+VMValue VMValue::concat(const VMValue& first, const VMValue& second)
+{
+  // copy second if it shares first's entry (appending may move it)
+  bool shared = first.is_string() and second.is_string() and
+    first.payload.s.handle == second.payload.s.handle;
+  string second_str;
+  string_view more;
+  if (second.is_string() and !shared)
+    more = second.as_string();
+  else
+    more = second_str = to_string(second);
+  if (first.is_string()) {
+    check_length(size_t(first.payload.s.length) + more.size());
+    VMStringTable& table = VMStringTable::instance();
+    if (table.extend(first.payload.s.handle, first.payload.s.length, more)) {
+      VMValue value(first);
+      value.payload.s.length += more.size();
+      return value;
+    }
+  }
+  return to_string(first) + string(more);
+}
+
+
+VMValue::VMValue(const VMValue& other)
+  : tag(other.tag), payload(other.payload)
+{
+  retain();
+}
+
+
+VMValue::VMValue(VMValue&& other) noexcept
+  : tag(other.tag), payload(other.payload)
+{
+  other.tag = Type::NULL_VAL;
+}
+
+
+VMValue& VMValue::operator=(const VMValue& other)
+{
+  other.retain();
+  release();
+  tag = other.tag;
+  payload = other.payload;
+  return *this;
+}
+
+
+VMValue& VMValue::operator=(VMValue&& other) noexcept
+{
+  if (this != &other) {
+    release();
+    tag = other.tag;
+    payload = other.payload;
+    other.tag = Type::NULL_VAL;
+  }
+  return *this;
+}
+
+
+VMValue::~VMValue()
+{
+  release();
+}
+
+
+string_view VMValue::as_string() const
+{
+  const string& str = VMStringTable::instance().get(payload.s.handle);
+  return string_view(str.data(), payload.s.length);
+}
+
+
+void VMValue::retain() const
+{
+  if (tag == Type::STRING)
+    VMStringTable::instance().retain(payload.s.handle);
+}
+
+
+void VMValue::release() const
+{
+  if (tag == Type::STRING)
+    VMStringTable::instance().release(payload.s.handle);
+}
+
+
+string to_string(const VMValue& val) {
+  char buffer[max_value_chars];
+  return string(to_chars(val, buffer));
+}
+
+
+string_view to_chars(const VMValue& val, char* buffer)
+{
+  char* end = buffer + max_value_chars;
+  if (val.is_int() or val.is_ref())
+    end = std::to_chars(buffer, end, val.as_int()).ptr;
+  else if (val.is_double())
+    end = std::to_chars(buffer, end, val.as_double(), chars_format::fixed,
+                        6).ptr;
+  else if (val.is_bool() and val.as_bool())
+    return "true";
+  else if (val.is_bool() and !val.as_bool())
+    return "false";
+  else if (val.is_string())
+    return val.as_string();
+  else
+    return "null";
+  return string_view(buffer, end - buffer);
+}
+
+
+namespace {
+
+  // the number in str after any leading whitespace and a '+' sign (a
+  // '-' sign is left for from_chars)
+  string_view number_start(string_view str)
+  {
+    size_t i = str.find_first_not_of(" \t\n\v\f\r");
+    if (i == string_view::npos)
+      return string_view();
+    str.remove_prefix(i);
+    if (str.size() > 1 and str[0] == '+' and str[1] != '-')
+      str.remove_prefix(1);
+    return str;
+  }
+
+  // whether std::stod takes the number in str as in range
+  bool strtod_in_range(string_view str)
+  {
+    string copy(str);
+    errno = 0;
+    strtod(copy.c_str(), nullptr);
+    return errno != ERANGE;
+  }
+
+}
+
+
+bool parse_int(string_view str, int& result)
+{
+  str = number_start(str);
+  from_chars_result parsed = from_chars(str.data(), str.data() + str.size(),
+                                        result);
+  return parsed.ec == errc();
+}
+
+
+bool parse_double(string_view str, double& result)
+{
+  str = number_start(str);
+  // hexadecimal (0x...) numbers
+  bool negative = !str.empty() and str[0] == '-';
+  string_view digits = str.substr(negative);
+  if (digits.size() > 1 and digits[0] == '0' and
+      (digits[1] == 'x' or digits[1] == 'X')) {
+    // without hex digits the number is the 0
+    string_view hex = digits.substr(2);
+    from_chars_result parsed = from_chars(hex.data(), hex.data() + hex.size(),
+                                          result, chars_format::hex);
+    if (hex.empty() or !(isxdigit(static_cast<unsigned char>(hex[0])) or hex[0] == '.') or
+        parsed.ec == errc::invalid_argument)
+      result = 0.0;
+    else if (parsed.ec != errc())
+      return false;
+    if (negative)
+      result = -result;
+    // std::stod keeps tiny hexadecimal numbers that are exact
+    if (result != 0.0 and fabs(result) <= DBL_MIN)
+      return strtod_in_range(str);
+    return true;
+  }
+  // like std::stod, decimal numbers too small for a normal double are
+  // out of range
+  return from_chars(str.data(), str.data() + str.size(), result).ec ==
+    errc() and fpclassify(result) != FP_SUBNORMAL;
+}
+
+
+//----------------------------------------------------------------------
+// VMStringTable
+//----------------------------------------------------------------------
+
+VMStringTable& VMStringTable::instance()
+{
+  static VMStringTable table;
+  return table;
+}
+
+
+unsigned VMStringTable::add(string_view str)
+{
+  unsigned handle;
+  if (!free_handles.empty()) {
+    handle = free_handles.back();
+    free_handles.pop_back();
+  }
+  else {
+    handle = entries.size();
+    entries.emplace_back();
+  }
+  entries[handle].str = str;
+  entries[handle].refs = 1;
+  bytes += str.size();
+  ++refs;
+  return handle;
+}
+
+
+const string& VMStringTable::get(unsigned handle) const
+{
+  return entries[handle].str;
+}
+
+
+bool VMStringTable::extend(unsigned handle, size_t length, string_view more)
+{
+  string& str = entries[handle].str;
+  if (str.size() != length)
+    return false;
+  str.append(more);
+  bytes += more.size();
+  return true;
+}
+
+
+void VMStringTable::retain(unsigned handle)
+{
+  ++entries[handle].refs;
+  ++refs;
+}
+
+
+void VMStringTable::release(unsigned handle)
+{
+  --refs;
+  if (--entries[handle].refs == 0) {
+    bytes -= entries[handle].str.size();
+    entries[handle].str = string();
+    free_handles.push_back(handle);
+  }
+}
+
+
+int VMStringTable::size() const
+{
+  return entries.size() - free_handles.size();
+}
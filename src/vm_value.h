@@ -0,0 +1,174 @@
+//----------------------------------------------------------------------
+// FILE: vm_value.h
+// DATE: CPSC 326, Spring 2023
+// AUTH: Cameron Chetcuti
+// DESC: Compact tagged representation of MyPL VM values
+//----------------------------------------------------------------------
+
+#ifndef VM_VALUE_H
+#define VM_VALUE_H
+
+#include <cstddef>
+#include <deque>
+#include <string>
+#include <string_view>
+#include <vector>
+
+
+// vm values are one of int, double, bool, string, null, or a reference
+// to a heap object. Each value is a one byte type tag plus an 8 byte
+// payload (16 bytes total). Ints, doubles, bools and references (the
+// object's oid) are stored inline, strings are stored as a handle into
+// the (reference counted) string table plus the string's length. A
+// string is a prefix of its table entry, which lets concat append to
+// the entry in place instead of copying (see VMValue::concat).
+class VMValue
+{
+public:
+
+  enum class Type : unsigned char {INT, DOUBLE, BOOL, STRING, NULL_VAL, REF};
+
+  // construct a value of the corresponding type (default is null)
+  VMValue();
+  VMValue(int val);
+  VMValue(double val);
+  VMValue(bool val);
+  VMValue(const char* val);
+  VMValue(const std::string& val);
+  VMValue(std::string_view val);
+  VMValue(std::nullptr_t val);
+
+  // construct a reference to the heap object with the given oid
+  static VMValue ref(int oid);
+
+  // the string first + second (either may be a non-string value). If
+  // first is the longest string in its table entry, second is appended
+  // to the entry and the result shares it, so building a string with
+  // repeated concats takes amortized linear time. Throws
+  // std::length_error if the result is longer than max_string_length.
+  static VMValue concat(const VMValue& first, const VMValue& second);
+
+  // copying a string value only updates the string's reference count
+  VMValue(const VMValue& other);
+  VMValue(VMValue&& other) noexcept;
+  VMValue& operator=(const VMValue& other);
+  VMValue& operator=(VMValue&& other) noexcept;
+  ~VMValue();
+
+  // the type of the value
+  Type type() const { return tag; }
+
+  bool is_int() const { return tag == Type::INT; }
+  bool is_double() const { return tag == Type::DOUBLE; }
+  bool is_bool() const { return tag == Type::BOOL; }
+  bool is_string() const { return tag == Type::STRING; }
+  bool is_null() const { return tag == Type::NULL_VAL; }
+  bool is_ref() const { return tag == Type::REF; }
+
+  // the value's payload (the value must be of the corresponding type,
+  // as_int also gives the oid of a reference)
+  int as_int() const { return payload.i; }
+  double as_double() const { return payload.d; }
+  bool as_bool() const { return payload.b; }
+  std::string_view as_string() const;
+
+private:
+
+  Type tag;
+
+  union {
+    int i;
+    double d;
+    bool b;
+    struct {
+      unsigned handle;
+      unsigned length;
+    } s;
+  } payload;
+
+  // string reference count helpers
+  void retain() const;
+  void release() const;
+
+};
+
+static_assert(sizeof(VMValue) == 16);
+
+
+// Holds the characters of every live string value. Entries are
+// reference counted by the values that refer to them and are reused
+// once no value refers to them anymore. Entries only ever grow at the
+// end, so every value referring to an entry keeps seeing its prefix.
+class VMStringTable
+{
+public:
+
+  // the table shared by all values
+  static VMStringTable& instance();
+
+  // add a new string (with a reference count of one), returns handle
+  unsigned add(std::string_view str);
+
+  // the entry with the given handle
+  const std::string& get(unsigned handle) const;
+
+  // append more to the entry if its current length is length (more
+  // must not refer to the entry), returns false otherwise
+  bool extend(unsigned handle, std::size_t length, std::string_view more);
+
+  // update the reference count of the given handle
+  void retain(unsigned handle);
+  void release(unsigned handle);
+
+  // number of strings currently stored
+  int size() const;
+
+  // number of characters in the strings currently stored
+  std::size_t byte_count() const { return bytes; }
+
+  // number of values currently referring to a stored string
+  std::size_t reference_count() const { return refs; }
+
+private:
+
+  struct Entry {
+    std::string str;
+    int refs = 0;
+  };
+
+  // a deque so that adding an entry doesn't move existing strings
+  std::deque<Entry> entries;
+
+  // handles of entries available for reuse
+  std::vector<unsigned> free_handles;
+
+  std::size_t bytes = 0;
+  std::size_t refs = 0;
+
+};
+
+
+// function to get a string representation of a vm_value
+std::string to_string(const VMValue& val);
+
+// the longest string a value can hold (constructing or concatenating
+// a longer one throws std::length_error)
+const std::size_t max_string_length = 0xFFFFFFFF;
+
+// the most characters to_chars formats (a double with six decimals)
+const std::size_t max_value_chars = 320;
+
+// the string representation of a value (as given by to_string) without
+// allocating: other values are formatted into buffer (which holds
+// max_value_chars), strings are viewed in place
+std::string_view to_chars(const VMValue& val, char* buffer);
+
+// parse the int (double) at the start of str as std::stoi (std::stod)
+// does: leading whitespace and a sign are skipped and anything after
+// the number is ignored, returns false if there is no number or it is
+// out of range
+bool parse_int(std::string_view str, int& result);
+bool parse_double(std::string_view str, double& result);
+
+
+#endif
@@ -0,0 +1,590 @@
+//----------------------------------------------------------------------
+// FILE: codegen_tests.cpp
+// DATE: CPSC 326, Spring 2023
+// AUTH: Cameron Chetcuti
+// DESC: Lexer, code generator and peephole pass tests
+//----------------------------------------------------------------------
+
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <regex>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <unistd.h>
+#include <gtest/gtest.h>
+#include <lexer.h>
+#include <mypl_exception.h>
+#include <ast_parser.h>
+#include <semantic_checker.h>
+#include <vm.h>
+#include <code_generator.h>
+#include <register_code_generator.h>
+#include <peephole.h>
+
+using namespace std;
+
+
+string build_string(initializer_list<string> strs)
+{
+  string result = "";
+  for (string s : strs)
+    result += s + "\n";
+  return result;
+}
+
+// runs the vm, returning its output followed by the error it stopped
+// with (if any)
+string run_vm(VM& vm)
+{
+  stringstream out;
+  streambuf* buffer = cout.rdbuf(out.rdbuf());
+  try {
+    vm.run();
+  }
+  catch (const MyPLException& ex) {
+    out << "error: " << ex.what();
+  }
+  cout.rdbuf(buffer);
+  return out.str();
+}
+
+// compiles the program into the vm with the given code generator
+template<typename Generator>
+string compile(const string& source, VM& vm)
+{
+  stringstream in(source);
+  Program p = ASTParser(Lexer(in)).parse();
+  SemanticChecker checker;
+  p.accept(checker);
+  Generator generator(vm);
+  p.accept(generator);
+  return generator.fusion_report();
+}
+
+
+//----------------------------------------------------------------------
+// Lexer tests
+//----------------------------------------------------------------------
+
+TEST(LexerTests, Punctuation_starting_a_token) {
+  // each punctuation token is checked against the token's first
+  // character (for string literals) before any character is read
+  stringstream in(";.,(){}[]\"a;.\";");
+  Lexer lexer(in);
+  vector<TokenType> types = {
+    TokenType::SEMICOLON, TokenType::DOT, TokenType::COMMA,
+    TokenType::LPAREN, TokenType::RPAREN, TokenType::LBRACE,
+    TokenType::RBRACE, TokenType::LBRACKET, TokenType::RBRACKET
+  };
+  for (TokenType type : types)
+    EXPECT_EQ(type, lexer.next_token().type());
+  Token t = lexer.next_token();
+  EXPECT_EQ(TokenType::STRING_VAL, t.type());
+  EXPECT_EQ("a;.", t.lexeme());
+  EXPECT_EQ(TokenType::SEMICOLON, lexer.next_token().type());
+  EXPECT_EQ(TokenType::EOS, lexer.next_token().type());
+}
+
+
+//----------------------------------------------------------------------
+// Peephole tests
+//----------------------------------------------------------------------
+
+// the instructions of the function (as listed by --ir)
+vector<string> listing(const VMFrameInfo& f)
+{
+  vector<string> lines;
+  for (const VMInstr& instr : f.instructions)
+    lines.push_back(to_string(instr));
+  return lines;
+}
+
+// runs the function as main (with a struct S having field x)
+string run_frame(VMFrameInfo main)
+{
+  main.function_name = "main";
+  VM vm;
+  vm.add_struct("S", {"x"});
+  vm.add(main);
+  return run_vm(vm);
+}
+
+// the function after the peephole pass
+VMFrameInfo fused(const VMFrameInfo& f)
+{
+  VMFrameInfo out = f;
+  Peephole().optimize(out);
+  return out;
+}
+
+TEST(PeepholeTests, Compare_and_jump) {
+  // x = k; if (x op 5) write 1 else write 0
+  vector<pair<VMInstr, string>> cmps = {
+    {VMInstr::CMPLT(), "CMPLTKJF"}, {VMInstr::CMPLE(), "CMPLEKJF"},
+    {VMInstr::CMPGT(), "CMPGTKJF"}, {VMInstr::CMPGE(), "CMPGEKJF"},
+    {VMInstr::CMPEQ(), "CMPEQKJF"}, {VMInstr::CMPNE(), "CMPNEKJF"},
+    {VMInstr::CMPLTI(), "CMPLTKJF"}, {VMInstr::CMPGED(), "CMPGEKJF"}};
+  for (auto& [cmp, name] : cmps) {
+    for (VMValue k : {VMValue(3), VMValue(5), VMValue(7)}) {
+      if (cmp.opcode() == OpCode::CMPGED)
+        k = VMValue(double(k.as_int()));
+      VMFrameInfo f {"main", 0};
+      f.instructions = {
+        VMInstr::PUSH(k), VMInstr::STORE(0), VMInstr::LOAD(0),
+        VMInstr::PUSH(cmp.opcode() == OpCode::CMPGED ? VMValue(5.0) : 5),
+        cmp, VMInstr::JMPF(9), VMInstr::PUSH(1), VMInstr::WRITE(),
+        VMInstr::JMP(11), VMInstr::PUSH(0), VMInstr::WRITE()};
+      VMFrameInfo g = fused(f);
+      string five = cmp.opcode() == OpCode::CMPGED ? "5.000000" : "5";
+      vector<string> expected = {
+        "MOVK(r0, " + to_string(k) + ")",
+        name + "(r0, " + five + ", 5)", "PUSH(1)", "WRITE()", "JMP(7)",
+        "PUSH(0)", "WRITE()"};
+      EXPECT_EQ(expected, listing(g));
+      EXPECT_EQ(run_frame(f), run_frame(g));
+    }
+  }
+}
+
+TEST(PeepholeTests, Constant_arithmetic) {
+  vector<pair<VMInstr, string>> ops = {
+    {VMInstr::ADD(), "ADDK(r1, r0, 2)"}, {VMInstr::SUB(), "SUBK(r1, r0, 2)"},
+    {VMInstr::ADDI(), "ADDK(r1, r0, 2)"}, {VMInstr::SUBI(), "SUBK(r1, r0, 2)"}};
+  for (auto& [op, expected] : ops) {
+    VMFrameInfo f {"main", 0};
+    f.instructions = {
+      VMInstr::PUSH(7), VMInstr::STORE(0), VMInstr::LOAD(0),
+      VMInstr::PUSH(2), op, VMInstr::STORE(1), VMInstr::LOAD(1),
+      VMInstr::WRITE()};
+    VMFrameInfo g = fused(f);
+    EXPECT_EQ((vector<string>{"MOVK(r0, 7)", expected, "LOAD(1)",
+                              "WRITE()"}), listing(g));
+    EXPECT_EQ(run_frame(f), run_frame(g));
+  }
+}
+
+TEST(PeepholeTests, Register_arithmetic) {
+  vector<pair<VMInstr, string>> ops = {
+    {VMInstr::ADD(), "ADDR"}, {VMInstr::SUB(), "SUBR"},
+    {VMInstr::MUL(), "MULR"}, {VMInstr::DIV(), "DIVR"},
+    {VMInstr::MULD(), "MULR"}, {VMInstr::DIVI(), "DIVR"}};
+  for (auto& [op, name] : ops) {
+    bool doubles = op.opcode() == OpCode::MULD;
+    VMFrameInfo f {"main", 0};
+    f.instructions = {
+      VMInstr::PUSH(doubles ? VMValue(7.5) : 7), VMInstr::STORE(0),
+      VMInstr::PUSH(doubles ? VMValue(2.0) : 2), VMInstr::STORE(1),
+      VMInstr::LOAD(0), VMInstr::LOAD(1), op, VMInstr::STORE(2),
+      VMInstr::LOAD(2), VMInstr::WRITE()};
+    VMFrameInfo g = fused(f);
+    ASSERT_EQ(5, g.instructions.size());
+    EXPECT_EQ(name + "(r2, r0, r1)", to_string(g.instructions[2]));
+    EXPECT_EQ(run_frame(f), run_frame(g));
+  }
+  // only arithmetic has a register form
+  VMFrameInfo f {"main", 0};
+  f.instructions = {VMInstr::LOAD(0), VMInstr::LOAD(1), VMInstr::AND(),
+                    VMInstr::STORE(2)};
+  EXPECT_EQ(listing(f), listing(fused(f)));
+}
+
+TEST(PeepholeTests, Null_field_store) {
+  VMFrameInfo f {"main", 0};
+  f.instructions = {
+    VMInstr::ALLOCS("S"), VMInstr::DUP(), VMInstr::PUSH(5),
+    VMInstr::SETF("x"), VMInstr::DUP(), VMInstr::PUSH(nullptr),
+    VMInstr::SETF("x"), VMInstr::GETF("x"), VMInstr::WRITE()};
+  VMFrameInfo g = fused(f);
+  EXPECT_EQ((vector<string>{"ALLOCS(S)", "DUP()", "PUSH(5)", "SETF(x)",
+                            "SETFN(x)", "GETF(x)", "WRITE()"}), listing(g));
+  EXPECT_EQ("null", run_frame(g));
+  EXPECT_EQ(run_frame(f), run_frame(g));
+}
+
+TEST(PeepholeTests, Jump_into_pattern_not_fused) {
+  // the jump enters LOAD 0; PUSH 1; ADD; STORE 0 at the PUSH (with 10
+  // on the stack), so it must stay as is
+  VMFrameInfo f {"main", 0};
+  f.instructions = {
+    VMInstr::PUSH(5), VMInstr::STORE(0), VMInstr::PUSH(10),
+    VMInstr::JMP(5), VMInstr::LOAD(0), VMInstr::PUSH(1), VMInstr::ADD(),
+    VMInstr::STORE(0), VMInstr::LOAD(0), VMInstr::WRITE()};
+  VMFrameInfo g = fused(f);
+  EXPECT_EQ((vector<string>{"MOVK(r0, 5)", "PUSH(10)", "JMP(4)", "LOAD(0)",
+                            "PUSH(1)", "ADD()", "STORE(0)", "LOAD(0)",
+                            "WRITE()"}), listing(g));
+  EXPECT_EQ("11", run_frame(g));
+  EXPECT_EQ(run_frame(f), run_frame(g));
+}
+
+TEST(PeepholeTests, Jump_targets_renumbered) {
+  // i = 0; sum = 0; while (i < 4) {sum = sum + i; i = i + 1}, with the
+  // loop exit jumping to the instruction after the loop and the end of
+  // the function
+  VMFrameInfo f {"main", 0};
+  f.instructions = {
+    VMInstr::PUSH(0), VMInstr::STORE(0), VMInstr::PUSH(0),
+    VMInstr::STORE(1), VMInstr::LOAD(0), VMInstr::PUSH(4),
+    VMInstr::CMPLT(), VMInstr::JMPF(17), VMInstr::LOAD(1),
+    VMInstr::LOAD(0), VMInstr::ADD(), VMInstr::STORE(1), VMInstr::LOAD(0),
+    VMInstr::PUSH(1), VMInstr::ADD(), VMInstr::STORE(0), VMInstr::JMP(4),
+    VMInstr::LOAD(1), VMInstr::WRITE(), VMInstr::PUSH(true),
+    VMInstr::JMPF(22), VMInstr::JMP(22)};
+  VMFrameInfo g = fused(f);
+  EXPECT_EQ((vector<string>{"MOVK(r0, 0)", "MOVK(r1, 0)",
+                            "CMPLTKJF(r0, 4, 6)", "ADDR(r1, r1, r0)",
+                            "ADDK(r0, r0, 1)", "JMP(2)", "LOAD(1)",
+                            "WRITE()", "PUSH(true)", "JMPF(11)",
+                            "JMP(11)"}), listing(g));
+  EXPECT_EQ("6", run_frame(g));
+  EXPECT_EQ(run_frame(f), run_frame(g));
+}
+
+TEST(PeepholeTests, Null_constant_ordering_not_fused) {
+  // ordering a null is an error (which the fused handlers don't check)
+  for (VMInstr cmp : {VMInstr::CMPLT(), VMInstr::CMPLE(), VMInstr::CMPGT(),
+                      VMInstr::CMPGE()}) {
+    VMFrameInfo f {"main", 0};
+    f.instructions = {
+      VMInstr::LOAD(0), VMInstr::PUSH(nullptr), cmp, VMInstr::JMPF(4),
+      VMInstr::PUSH(1), VMInstr::WRITE()};
+    VMFrameInfo g = fused(f);
+    EXPECT_EQ(listing(f), listing(g));
+    EXPECT_NE(string::npos, run_frame(g).find("error: "));
+  }
+  // nor is a null added
+  VMFrameInfo f {"main", 0};
+  f.instructions = {
+    VMInstr::LOAD(0), VMInstr::PUSH(nullptr), VMInstr::ADD(),
+    VMInstr::STORE(1)};
+  EXPECT_EQ(listing(f), listing(fused(f)));
+  // but == and != null are
+  for (VMInstr cmp : {VMInstr::CMPEQ(), VMInstr::CMPNE()}) {
+    VMFrameInfo f {"main", 0};
+    f.instructions = {
+      VMInstr::LOAD(0), VMInstr::PUSH(nullptr), cmp, VMInstr::JMPF(6),
+      VMInstr::PUSH(1), VMInstr::WRITE()};
+    VMFrameInfo g = fused(f);
+    ASSERT_EQ(3, g.instructions.size());
+    EXPECT_EQ(cmp.opcode() == OpCode::CMPEQ ? "CMPEQKJF(r0, null, 3)"
+              : "CMPNEKJF(r0, null, 3)", to_string(g.instructions[0]));
+    EXPECT_EQ(run_frame(f), run_frame(g));
+  }
+}
+
+TEST(PeepholeTests, Generated_loop_fused) {
+  string source = build_string({
+      "void main() {",
+      "  int i = 0",
+      "  int s = 0",
+      "  while (i < 10) {",
+      "    s = s + i",
+      "    i = i + 1",
+      "  }",
+      "  print(s)",
+      "}"});
+  VM vm;
+  string report = compile<CodeGenerator>(source, vm);
+  EXPECT_EQ(build_string({
+        "Fusions:",
+        "  PUSH STORE: 2",
+        "  LOAD PUSH CMPLTI JMPF: 1",
+        "  LOAD LOAD ADDI STORE: 1",
+        "  LOAD PUSH ADDI STORE: 1"}), report);
+  EXPECT_EQ("45", run_vm(vm));
+}
+
+
+//----------------------------------------------------------------------
+// Backend tests
+//----------------------------------------------------------------------
+
+// compiles and runs the program with the stack or register backend (and
+// the given jit threshold), returning its output followed by the error it
+// stopped with (if any)
+string run_program(const string& source, bool registers,
+                   int jit_threshold = -1)
+{
+  VM vm;
+  vm.set_jit_threshold(jit_threshold);
+  try {
+    if (registers)
+      compile<RegisterCodeGenerator>(source, vm);
+    else
+      compile<CodeGenerator>(source, vm);
+  }
+  catch (const MyPLException& ex) {
+    return string("error: ") + ex.what();
+  }
+  return run_vm(vm);
+}
+
+// runs the program with both backends, expecting the same output
+string run_both(const string& source)
+{
+  string stack = run_program(source, false);
+  EXPECT_EQ(stack, run_program(source, true));
+  return stack;
+}
+
+// the program's listing with the register backend
+string register_listing(const string& source)
+{
+  VM vm;
+  compile<RegisterCodeGenerator>(source, vm);
+  return to_string(vm);
+}
+
+// the largest register named in a listing (-1 if none)
+int max_register(const string& listing)
+{
+  int max_reg = -1;
+  regex reg("r([0-9]+)[,)]");
+  for (sregex_iterator m(listing.begin(), listing.end(), reg);
+       m != sregex_iterator(); ++m)
+    max_reg = max(max_reg, stoi((*m)[1]));
+  return max_reg;
+}
+
+TEST(BackendTests, Arithmetic_and_comparisons) {
+  // (operators are right associative, so x * 2.0 - 1.0 is 2.5)
+  string source = build_string({
+      "void main() {",
+      "  int a = 7",
+      "  int b = 3",
+      "  double x = 2.5",
+      "  print(a + b * 2) print(\" \")",
+      "  print((a - b) / 2) print(\" \")",
+      "  print(x * 2.0 - 1.0) print(\" \")",
+      "  bool t = (a > b) and not (b >= a) or false",
+      "  print(t) print(\" \")",
+      "  print(a < b) print(a <= 7) print(a == 7) print(a != b)",
+      "  print(\" \")",
+      "  int c = a",
+      "  c = c + (a - (b - 1)) * c",
+      "  print(c)",
+      "}"});
+  EXPECT_EQ("13 2 2.500000 true falsetruetruetrue 42", run_both(source));
+}
+
+TEST(BackendTests, Loops_and_branches) {
+  string source = build_string({
+      "void main() {",
+      "  int s = 0",
+      "  for (int i = 0; i < 10; i = i + 1) {",
+      "    if (i == 3) {s = s + 100}",
+      "    elseif (not (i < 8)) {s = s - i}",
+      "    else {s = s + i}",
+      "  }",
+      "  int j = 5",
+      "  while ((j > 0) and (s > 0)) {",
+      "    j = j - 2",
+      "  }",
+      "  print(s) print(\" \") print(j)",
+      "}"});
+  EXPECT_EQ("108 -1", run_both(source));
+}
+
+TEST(BackendTests, Calls_on_the_stack) {
+  // call results (and arguments with operators) go through the stack
+  string source = build_string({
+      "int twice(int x) {",
+      "  return x * 2",
+      "}",
+      "void main() {",
+      "  int a = 4",
+      "  int b = twice(a) + twice(a + 1)",
+      "  print(b) print(\" \")",
+      "  print(twice(twice(b) - 1))",
+      "}"});
+  EXPECT_EQ("18 70", run_both(source));
+  string listing = register_listing(source);
+  EXPECT_NE(string::npos, listing.find("CALL(0)  // twice\n"));
+  EXPECT_NE(string::npos, listing.find("ADDR("));
+}
+
+TEST(BackendTests, Paths_on_the_stack) {
+  string source = build_string({
+      "struct Node {",
+      "  int val,",
+      "  Node next",
+      "}",
+      "void main() {",
+      "  Node n = new Node",
+      "  n.next = new Node",
+      "  n.val = 1",
+      "  n.next.val = n.val + 2",
+      "  array int xs = new int[3]",
+      "  xs[0] = 5",
+      "  xs[1] = xs[0] * n.next.val",
+      "  int i = 1",
+      "  int v = xs[i] + n.next.val - xs[i - 1]",
+      "  print(v) print(\" \") print(xs[1])",
+      "}"});
+  EXPECT_EQ("13 15", run_both(source));
+  string listing = register_listing(source);
+  EXPECT_NE(string::npos, listing.find("GETF("));
+  EXPECT_NE(string::npos, listing.find("GETI()"));
+}
+
+TEST(BackendTests, New_on_the_stack) {
+  string source = build_string({
+      "struct P {",
+      "  int x",
+      "}",
+      "void main() {",
+      "  P p = new P",
+      "  array double ds = new double[2 + 1]",
+      "  p.x = length(ds)",
+      "  ds[2] = 1.5",
+      "  print(p.x) print(\" \") print(ds[2]) print(\" \") print(ds[0])",
+      "}"});
+  EXPECT_EQ("3 1.500000 null", run_both(source));
+  string listing = register_listing(source);
+  EXPECT_NE(string::npos, listing.find("ALLOCS("));
+  EXPECT_NE(string::npos, listing.find("ALLOCA()"));
+}
+
+TEST(BackendTests, Temporaries_reused) {
+  // a, b, and c are r0 to r2, and each statement's temporaries start
+  // again at r3 (the last statement needs the most, r3 to r7)
+  vector<string> lines = {"void main() {", "  int a = 5", "  int b = 2",
+                          "  int c = 0"};
+  for (int i = 0; i < 20; ++i)
+    lines.push_back("  c = c + (a + b) * (a - b)");
+  lines.push_back("  c = (a + b) * ((a - b) * (c - (a * b)))");
+  lines.push_back("  print(c)");
+  lines.push_back("}");
+  string source;
+  for (const string& line : lines)
+    source += line + "\n";
+  EXPECT_EQ("8610", run_both(source));
+  EXPECT_EQ(7, max_register(register_listing(source)));
+}
+
+TEST(BackendTests, Return_in_trailing_if) {
+  // a false condition jumps past the if's RET to the end of f, so f
+  // always ends with PUSH null; RET
+  string source = build_string({
+      "void f(int x) {",
+      "  if (x > 0) {",
+      "    print(\"p\")",
+      "    return null",
+      "  }",
+      "}",
+      "void main() {",
+      "  f(1)",
+      "  f(0)",
+      "  print(\".\")",
+      "}"});
+  EXPECT_EQ("p.", run_both(source));
+  VM vm;
+  compile<CodeGenerator>(source, vm);
+  string listing = to_string(vm);
+  string f = listing.substr(0, listing.find("\nFrame 'main'"));
+  regex end("PUSH\\(null\\)\n  [0-9]+: RET\\(\\)\n$");
+  EXPECT_TRUE(regex_search(f, end));
+}
+
+
+//----------------------------------------------------------------------
+// Example tests
+//----------------------------------------------------------------------
+
+// Temporarily replaces the standard input with a file holding text
+class StdinText
+{
+public:
+
+  StdinText(const string& text)
+  {
+    saved = dup(STDIN_FILENO);
+    FILE* file = tmpfile();
+    fwrite(text.data(), 1, text.size(), file);
+    fflush(file);
+    dup2(fileno(file), STDIN_FILENO);
+    fclose(file);
+    lseek(STDIN_FILENO, 0, SEEK_SET);
+  }
+
+  ~StdinText()
+  {
+    dup2(saved, STDIN_FILENO);
+    close(saved);
+  }
+
+private:
+
+  int saved;
+
+};
+
+// the source of each examples/ program, by file name
+vector<pair<string, string>> examples()
+{
+  vector<pair<string, string>> programs;
+  for (const auto& entry : filesystem::directory_iterator(EXAMPLES_DIR)) {
+    if (entry.path().extension() != ".mypl")
+      continue;
+    ifstream file(entry.path());
+    stringstream source;
+    source << file.rdbuf();
+    programs.push_back({entry.path().filename().string(), source.str()});
+  }
+  sort(programs.begin(), programs.end());
+  return programs;
+}
+
+// the input given to the examples that read some
+const string example_input = "4\n6\n7\n";
+
+TEST(ExampleTests, Backends_match) {
+  auto programs = examples();
+  ASSERT_FALSE(programs.empty());
+  for (const auto& [name, source] : programs) {
+    SCOPED_TRACE(name);
+    string stack, registers;
+    {
+      StdinText in(example_input);
+      stack = run_program(source, false);
+    }
+    {
+      StdinText in(example_input);
+      registers = run_program(source, true);
+    }
+    EXPECT_EQ(stack, registers);
+  }
+}
+
+TEST(ExampleTests, Jit_matches_interpreter) {
+  // every function compiled before its first call
+  for (const auto& [name, source] : examples()) {
+    for (bool registers : {false, true}) {
+      SCOPED_TRACE(name + (registers ? " (registers)" : " (stack)"));
+      string interpreted, jit;
+      {
+        StdinText in(example_input);
+        interpreted = run_program(source, registers, -1);
+      }
+      {
+        StdinText in(example_input);
+        jit = run_program(source, registers, 0);
+      }
+      EXPECT_EQ(interpreted, jit);
+    }
+  }
+}
+
+
+//----------------------------------------------------------------------
+// main
+//----------------------------------------------------------------------
+
+int main(int argc, char** argv)
+{
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
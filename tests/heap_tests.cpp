@@ -0,0 +1,207 @@
+//----------------------------------------------------------------------
+// FILE: heap_tests.cpp
+// DATE: CPSC 326, Spring 2023
+// AUTH: Cameron Chetcuti
+// DESC: Heap snapshot and mypl-heap analysis tests
+//----------------------------------------------------------------------
+
+#include <cstdio>
+#include <map>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <gtest/gtest.h>
+#include <heap_analysis.h>
+#include <heap_snapshot.h>
+
+using namespace std;
+
+
+// a snapshot file (removed at the end of the test)
+class HeapTests : public testing::Test
+{
+protected:
+
+  string path = testing::TempDir() + "heap_tests.snap";
+
+  void TearDown() override
+  {
+    remove(path.c_str());
+  }
+
+};
+
+
+//----------------------------------------------------------------------
+// Snapshot tests
+//----------------------------------------------------------------------
+
+TEST_F(HeapTests, Snapshot_round_trip) {
+  HeapSnapshotWriter out(path);
+  out.type(1, "Node");
+  out.type(2, "array");
+  out.root(7);
+  out.object(7, 1, 48, {9, 7});
+  out.object(9, 2, 1ull << 40, {});
+  out.root(9);
+  ASSERT_TRUE(out.finish());
+
+  HeapSnapshotReader in(path);
+  size_t offset = in.begin();
+  ASSERT_EQ(heap_snapshot::type_tag, in.tag(offset));
+  EXPECT_EQ(1, in.type_id(offset));
+  EXPECT_EQ("Node", in.type_name(offset));
+  offset = in.next(offset);
+  ASSERT_EQ(heap_snapshot::type_tag, in.tag(offset));
+  EXPECT_EQ(2, in.type_id(offset));
+  EXPECT_EQ("array", in.type_name(offset));
+  offset = in.next(offset);
+  ASSERT_EQ(heap_snapshot::root_tag, in.tag(offset));
+  EXPECT_EQ(7, in.root_oid(offset));
+  offset = in.next(offset);
+  ASSERT_EQ(heap_snapshot::object_tag, in.tag(offset));
+  EXPECT_EQ(7, in.object_oid(offset));
+  EXPECT_EQ(1, in.object_type(offset));
+  EXPECT_EQ(48, in.object_bytes(offset));
+  ASSERT_EQ(2, in.ref_count(offset));
+  EXPECT_EQ(9, in.ref(offset, 0));
+  EXPECT_EQ(7, in.ref(offset, 1));
+  offset = in.next(offset);
+  ASSERT_EQ(heap_snapshot::object_tag, in.tag(offset));
+  EXPECT_EQ(9, in.object_oid(offset));
+  EXPECT_EQ(2, in.object_type(offset));
+  EXPECT_EQ(1ull << 40, in.object_bytes(offset));
+  EXPECT_EQ(0, in.ref_count(offset));
+  offset = in.next(offset);
+  ASSERT_EQ(heap_snapshot::root_tag, in.tag(offset));
+  EXPECT_EQ(9, in.root_oid(offset));
+  offset = in.next(offset);
+  EXPECT_EQ(heap_snapshot::end_tag, in.tag(offset));
+  EXPECT_EQ(offset + 1, in.file_size());
+}
+
+TEST_F(HeapTests, Snapshot_empty) {
+  HeapSnapshotWriter out(path);
+  ASSERT_TRUE(out.finish());
+  HeapSnapshotReader in(path);
+  EXPECT_EQ(heap_snapshot::end_tag, in.tag(in.begin()));
+  HeapIndex heap(in);
+  EXPECT_EQ(0, heap.size());
+  Dominators doms(heap);
+  EXPECT_EQ(0, doms.retained[0]);
+}
+
+TEST_F(HeapTests, Snapshot_not_a_snapshot) {
+  FILE* file = fopen(path.c_str(), "w");
+  fputs("MYPLHEAX and more", file);
+  fclose(file);
+  EXPECT_THROW(HeapSnapshotReader in(path), runtime_error);
+}
+
+
+//----------------------------------------------------------------------
+// Analysis tests
+//----------------------------------------------------------------------
+
+// Objects 1 to 9 (of 10 * oid bytes, type A if odd, B if even) with
+// root 1 and the references
+//
+//   1 -> 2, 3    2 -> 4, 6    3 -> 4    4 -> 5    6 -> 7    7 -> 6
+//   8 -> 9
+//
+// so 4 is dominated by 1 (through either 2 or 3), the cycle 6, 7 by 2,
+// and the garbage 9 by 8 (which nothing refers to)
+void write_graph(const string& path)
+{
+  map<uint32_t, vector<uint32_t>> refs = {
+    {1, {2, 3}}, {2, {4, 6}}, {3, {4}}, {4, {5}}, {5, {}}, {6, {7}},
+    {7, {6}}, {8, {9}}, {9, {}}};
+  HeapSnapshotWriter out(path);
+  out.type(1, "A");
+  out.type(2, "B");
+  out.root(1);
+  for (const auto& [oid, to] : refs)
+    out.object(oid, oid % 2 ? 1 : 2, 10 * oid, to);
+  ASSERT_TRUE(out.finish());
+}
+
+TEST_F(HeapTests, Known_dominators) {
+  write_graph(path);
+  HeapSnapshotReader in(path);
+  HeapIndex heap(in);
+  ASSERT_EQ(9, heap.size());
+  ASSERT_EQ(vector<uint32_t>{0}, heap.roots);
+  Dominators doms(heap);
+
+  // the immediate dominator (oid, 0 for the virtual root) and retained
+  // bytes of each object, by oid (objects are numbered oid - 1)
+  map<uint32_t, uint32_t> idom;
+  map<uint32_t, uint64_t> retained;
+  for (uint32_t p = 0; p < heap.size(); ++p) {
+    uint32_t oid = doms.order[p] + 1;
+    uint32_t dom = doms.idom[p];
+    idom[oid] = dom == heap.size() ? 0 : doms.order[dom] + 1;
+    retained[oid] = doms.retained[p];
+  }
+  map<uint32_t, uint32_t> expected_idom = {
+    {1, 0}, {2, 1}, {3, 1}, {4, 1}, {5, 4}, {6, 2}, {7, 6}, {8, 0},
+    {9, 8}};
+  map<uint32_t, uint64_t> expected_retained = {
+    {1, 280}, {2, 150}, {3, 30}, {4, 90}, {5, 50}, {6, 130}, {7, 70},
+    {8, 170}, {9, 90}};
+  EXPECT_EQ(expected_idom, idom);
+  EXPECT_EQ(expected_retained, retained);
+  EXPECT_EQ(450, doms.retained[heap.size()]);
+  EXPECT_TRUE(doms.root[0]);
+  EXPECT_TRUE(doms.root[7]);
+  EXPECT_FALSE(doms.root[8]);
+}
+
+TEST_F(HeapTests, Type_summaries) {
+  write_graph(path);
+  HeapSnapshotReader in(path);
+  HeapIndex heap(in);
+  Dominators doms(heap);
+  vector<TypeSummary> types = summarize_types(heap, doms);
+  ASSERT_EQ(2, types.size());
+  // B retains 2 (with 6 under it), 4 and 8, A retains 1 and 9
+  EXPECT_EQ("B", heap.type_name(types[0].type));
+  EXPECT_EQ(4, types[0].objects);
+  EXPECT_EQ(200, types[0].bytes);
+  EXPECT_EQ(410, types[0].retained);
+  EXPECT_EQ("A", heap.type_name(types[1].type));
+  EXPECT_EQ(5, types[1].objects);
+  EXPECT_EQ(250, types[1].bytes);
+  EXPECT_EQ(370, types[1].retained);
+}
+
+TEST_F(HeapTests, Longest_chains) {
+  write_graph(path);
+  HeapSnapshotReader in(path);
+  HeapIndex heap(in);
+  Dominators doms(heap);
+  // 1 -> 2 -> 6 -> 7 then 1 -> 2 -> 4 -> 5 (both A, B x2, A)
+  auto chains = longest_chains(heap, doms, 5);
+  vector<pair<uint32_t, uint64_t>> runs = {{1, 1}, {2, 2}, {1, 1}};
+  ASSERT_EQ(4, chains.size());
+  EXPECT_EQ(runs, chains[0]);
+  EXPECT_EQ(runs, chains[1]);
+  // then 8 -> 9 (B, A) and 1 -> 3 (A x2), everything else is on a
+  // reported chain
+  vector<pair<uint32_t, uint64_t>> garbage = {{2, 1}, {1, 1}};
+  EXPECT_EQ(garbage, chains[2]);
+  vector<pair<uint32_t, uint64_t>> last = {{1, 2}};
+  EXPECT_EQ(last, chains[3]);
+  EXPECT_EQ(2, longest_chains(heap, doms, 2).size());
+}
+
+
+//----------------------------------------------------------------------
+// main
+//----------------------------------------------------------------------
+
+int main(int argc, char** argv)
+{
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
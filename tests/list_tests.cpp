@@ -270,8 +270,26 @@ TEST(ListSemanticTests, List_retrieve_Type) {
 //----------------------------------------------------------------------
 // VM tests
 //----------------------------------------------------------------------
- 
-TEST(ListVMTests, List_creation) {
+
+// Each VM test runs its program interpreted and then with the JIT
+// compiling every function before its first call, and expects the same
+// results both ways
+class ListVMTests : public testing::TestWithParam<int>
+{
+protected:
+
+  // runs the program (checking that the JIT compiled it)
+  void run(VM& vm)
+  {
+    vm.set_jit_threshold(GetParam());
+    vm.run();
+    if (GetParam() >= 0 and VMJit::supported())
+      EXPECT_EQ(1, vm.jit_compiled_count());
+  }
+
+};
+
+TEST_P(ListVMTests, List_creation) {
   VMFrameInfo main {"main", 0};
   main.instructions.push_back(VMInstr::ALLOCL());
   main.instructions.push_back(VMInstr::WRITE());
@@ -279,12 +297,12 @@ TEST(ListVMTests, List_creation) {
   vm.add(main);
   stringstream out;
   change_cout(out);
-  vm.run();
+  run(vm);
   EXPECT_EQ("2023", out.str());
   restore_cout();
 }
 
-TEST(ListVMTests, List_add_element) {
+TEST_P(ListVMTests, List_add_element) {
   VMFrameInfo main {"main", 0};
   main.instructions.push_back(VMInstr::PUSH(2));
   main.instructions.push_back(VMInstr::ALLOCL());
@@ -295,12 +313,12 @@ TEST(ListVMTests, List_add_element) {
   vm.add(main);
   stringstream out;
   change_cout(out);
-  vm.run();
+  run(vm);
   EXPECT_EQ("2023", out.str());
   restore_cout();
 }
 
-TEST(ListVMTests, List_get_set_element) {
+TEST_P(ListVMTests, List_get_set_element) {
   VMFrameInfo main {"main", 0};
   main.instructions.push_back(VMInstr::ALLOCL());
   main.instructions.push_back(VMInstr::DUP());
@@ -352,12 +370,12 @@ TEST(ListVMTests, List_get_set_element) {
   vm.add(main);
   stringstream out;
   change_cout(out);
-  vm.run();
+  run(vm);
   EXPECT_EQ("202322.200000truehello", out.str());
   restore_cout();
 }
 
-TEST(ListVMTests, List_size) {
+TEST_P(ListVMTests, List_size) {
   VMFrameInfo main {"main", 0};
   main.instructions.push_back(VMInstr::ALLOCL());
   main.instructions.push_back(VMInstr::DUP());
@@ -374,12 +392,12 @@ TEST(ListVMTests, List_size) {
   vm.add(main);
   stringstream out;
   change_cout(out);
-  vm.run();
+  run(vm);
   EXPECT_EQ("20231", out.str());
   restore_cout();
 }
 
-TEST(ListVMTests, List_numi) {
+TEST_P(ListVMTests, List_numi) {
   VMFrameInfo main {"main", 0};
   main.instructions.push_back(VMInstr::ALLOCL());
   main.instructions.push_back(VMInstr::DUP());
@@ -417,12 +435,12 @@ TEST(ListVMTests, List_numi) {
   vm.add(main);
   stringstream out;
   change_cout(out);
-  vm.run();
+  run(vm);
   EXPECT_EQ("2023112", out.str());
   restore_cout();
 }
 
-TEST(ListVMTests, List_numd) {
+TEST_P(ListVMTests, List_numd) {
   VMFrameInfo main {"main", 0};
   main.instructions.push_back(VMInstr::ALLOCL());
   main.instructions.push_back(VMInstr::DUP());
@@ -460,12 +478,12 @@ TEST(ListVMTests, List_numd) {
   vm.add(main);
   stringstream out;
   change_cout(out);
-  vm.run();
+  run(vm);
   EXPECT_EQ("2023112", out.str());
   restore_cout();
 }
 
-TEST(ListVMTests, List_nums) {
+TEST_P(ListVMTests, List_nums) {
   VMFrameInfo main {"main", 0};
   main.instructions.push_back(VMInstr::ALLOCL());
   main.instructions.push_back(VMInstr::DUP());
@@ -503,12 +521,12 @@ TEST(ListVMTests, List_nums) {
   vm.add(main);
   stringstream out;
   change_cout(out);
-  vm.run();
+  run(vm);
   EXPECT_EQ("2023112", out.str());
   restore_cout();
 }
 
-TEST(ListVMTests, List_numb) {
+TEST_P(ListVMTests, List_numb) {
   VMFrameInfo main {"main", 0};
   main.instructions.push_back(VMInstr::ALLOCL());
   main.instructions.push_back(VMInstr::DUP());
@@ -546,12 +564,12 @@ TEST(ListVMTests, List_numb) {
   vm.add(main);
   stringstream out;
   change_cout(out);
-  vm.run();
+  run(vm);
   EXPECT_EQ("2023112", out.str());
   restore_cout();
 }
 
-TEST(ListVMTests, List_avgi) {
+TEST_P(ListVMTests, List_avgi) {
   VMFrameInfo main {"main", 0};
   main.instructions.push_back(VMInstr::ALLOCL());
   main.instructions.push_back(VMInstr::DUP());
@@ -589,12 +607,12 @@ TEST(ListVMTests, List_avgi) {
   vm.add(main);
   stringstream out;
   change_cout(out);
-  vm.run();
+  run(vm);
   EXPECT_EQ("2023112", out.str());
   restore_cout();
 }
 
-TEST(ListVMTests, List_avgd) {
+TEST_P(ListVMTests, List_avgd) {
   VMFrameInfo main {"main", 0};
   main.instructions.push_back(VMInstr::ALLOCL());
   main.instructions.push_back(VMInstr::DUP());
@@ -629,12 +647,12 @@ TEST(ListVMTests, List_avgd) {
   vm.add(main);
   stringstream out;
   change_cout(out);
-  vm.run();
+  run(vm);
   EXPECT_EQ("20231.5000002.900000", out.str());
   restore_cout();
 }
 
-TEST(ListVMTests, List_rmb) {
+TEST_P(ListVMTests, List_rmb) {
   VMFrameInfo main {"main", 0};
   main.instructions.push_back(VMInstr::ALLOCL());
   main.instructions.push_back(VMInstr::DUP());
@@ -676,12 +694,12 @@ TEST(ListVMTests, List_rmb) {
   vm.add(main);
   stringstream out;
   change_cout(out);
-  vm.run();
+  run(vm);
   EXPECT_EQ("20231212", out.str());
   restore_cout();
 }
 
-TEST(ListVMTests, List_retrieve) {
+TEST_P(ListVMTests, List_retrieve) {
   VMFrameInfo main {"main", 0};
   main.instructions.push_back(VMInstr::ALLOCL());
   main.instructions.push_back(VMInstr::DUP());
@@ -723,11 +741,221 @@ TEST(ListVMTests, List_retrieve) {
   vm.add(main);
   stringstream out;
   change_cout(out);
-  vm.run();
+  run(vm);
   EXPECT_EQ("20231.500000abc4.300000", out.str());
   restore_cout();
 }
 
+TEST_P(ListVMTests, List_stats_after_each_add) {
+  VMFrameInfo main {"main", 0};
+  main.instructions.push_back(VMInstr::ALLOCL());
+  main.instructions.push_back(VMInstr::POP());
+  for (int i = 1; i <= 5; ++i) {
+    main.instructions.push_back(VMInstr::PUSH(i));
+    main.instructions.push_back(VMInstr::PUSH(2023));
+    main.instructions.push_back(VMInstr::ADDLE());
+    main.instructions.push_back(VMInstr::PUSH(2023));
+    main.instructions.push_back(VMInstr::LAVGI());
+    main.instructions.push_back(VMInstr::WRITE());
+  }
+  main.instructions.push_back(VMInstr::PUSH(2.5));
+  main.instructions.push_back(VMInstr::PUSH(2023));
+  main.instructions.push_back(VMInstr::ADDLE());
+  main.instructions.push_back(VMInstr::PUSH(2023));
+  main.instructions.push_back(VMInstr::LAVGD());
+  main.instructions.push_back(VMInstr::WRITE());
+  main.instructions.push_back(VMInstr::PUSH(2023));
+  main.instructions.push_back(VMInstr::LRMB());
+  main.instructions.push_back(VMInstr::PUSH(2023));
+  main.instructions.push_back(VMInstr::LNUMD());
+  main.instructions.push_back(VMInstr::WRITE());
+  main.instructions.push_back(VMInstr::PUSH(2023));
+  main.instructions.push_back(VMInstr::LRMB());
+  main.instructions.push_back(VMInstr::PUSH(2023));
+  main.instructions.push_back(VMInstr::LAVGI());
+  main.instructions.push_back(VMInstr::WRITE());
+  VM vm;
+  vm.add(main);
+  stringstream out;
+  change_cout(out);
+  run(vm);
+  EXPECT_EQ("112232.50000002", out.str());
+  restore_cout();
+}
+
+TEST(ListValueTests, List_stats_match_scan) {
+  // a mix of adds, changes, and removals (doubles are multiples of
+  // 0.5 so their sums don't depend on the order they're added in)
+  VMList list;
+  unsigned seed = 326;
+  for (int step = 0; step < 2000; ++step) {
+    seed = seed * 1103515245 + 12345;
+    int r = (seed >> 16) % 100;
+    VMValue value;
+    switch (r % 4) {
+      case 0: value = VMValue(r - 50); break;
+      case 1: value = VMValue((r - 50) * 0.5); break;
+      case 2: value = VMValue(to_string(r)); break;
+      default: value = VMValue(r % 2 == 0); break;
+    }
+    // only ints and then only doubles early on (packed lists)
+    if (step == 400)
+      while (!list.empty())
+        list.pop_back();
+    if (step < 400)
+      value = VMValue(r - 50);
+    else if (step < 800)
+      value = VMValue((r - 50) * 0.5);
+    if (r < 55 or list.empty())
+      list.push_back(value);
+    else if (r < 80)
+      list.set(seed % list.size(), value);
+    else
+      list.pop_back();
+    int ints = 0, doubles = 0, strings = 0, bools = 0;
+    long long int_sum = 0;
+    double double_sum = 0.0;
+    for (int i = 0; i < list.size(); ++i) {
+      VMValue x = list.get(i);
+      if (x.is_int()) {
+        ints++;
+        int_sum += x.as_int();
+      }
+      else if (x.is_double()) {
+        doubles++;
+        double_sum += x.as_double();
+      }
+      else if (x.is_string())
+        strings++;
+      else if (x.is_bool())
+        bools++;
+    }
+    ASSERT_EQ(ints, list.count_ints());
+    ASSERT_EQ(doubles, list.count_doubles());
+    ASSERT_EQ(strings, list.count_strings());
+    ASSERT_EQ(bools, list.count_bools());
+    ASSERT_EQ(int_sum, list.sum_ints());
+    ASSERT_EQ(double_sum, list.sum_doubles());
+  }
+}
+
+
+// the way the program is run (for the test names)
+string dispatch_name(const testing::TestParamInfo<int>& info)
+{
+  return info.param < 0 ? "Interpreted" : "Jit";
+}
+
+INSTANTIATE_TEST_SUITE_P(Dispatch, ListVMTests, testing::Values(-1, 0),
+                         dispatch_name);
+
+
+// runs the program with the given jit threshold, returning its output
+// followed by the error it stopped with (if any)
+string run_with_jit(const VMFrameInfo& main, const VMFrameInfo& step,
+                    int threshold, int& compiled)
+{
+  VM vm;
+  vm.set_gc_threshold(50);
+  vm.set_jit_threshold(threshold);
+  vm.add(main);
+  vm.add(step);
+  stringstream out;
+  change_cout(out);
+  try {
+    vm.run();
+  } catch (const MyPLException& ex) {
+    out << "error: " << ex.what();
+  }
+  restore_cout();
+  compiled = vm.jit_compiled_count();
+  return out.str();
+}
+
+TEST(ListJitTests, Jit_matches_interpreter) {
+  // main calls step(xs, i) for i = 0 to 99 and then reads past the end
+  // of xs, step adds i, i * 0.5 and "s" + i to xs and writes the list's
+  // stats (collecting garbage along the way)
+  VMFrameInfo main {"main", 0};
+  vector<VMInstr>& m = main.instructions;
+  m.push_back(VMInstr::ALLOCL());
+  m.push_back(VMInstr::STORE(0));
+  m.push_back(VMInstr::PUSH(0));
+  m.push_back(VMInstr::STORE(1));
+  int loop = m.size();
+  m.push_back(VMInstr::LOAD(1));
+  m.push_back(VMInstr::PUSH(100));
+  m.push_back(VMInstr::CMPLT());
+  int exit = m.size();
+  m.push_back(VMInstr::JMPF(-1));
+  m.push_back(VMInstr::LOAD(0));
+  m.push_back(VMInstr::LOAD(1));
+  m.push_back(VMInstr::CALL("step"));
+  m.push_back(VMInstr::POP());
+  m.push_back(VMInstr::LOAD(1));
+  m.push_back(VMInstr::PUSH(1));
+  m.push_back(VMInstr::ADD());
+  m.push_back(VMInstr::STORE(1));
+  m.push_back(VMInstr::JMP(loop));
+  m[exit].set_operand(int(m.size()));
+  m.push_back(VMInstr::LOAD(0));
+  m.push_back(VMInstr::PUSH(300));
+  m.push_back(VMInstr::GETLI());
+  m.push_back(VMInstr::WRITE());
+
+  VMFrameInfo step {"step", 2};
+  vector<VMInstr>& s = step.instructions;
+  s.push_back(VMInstr::STORE(0));
+  s.push_back(VMInstr::STORE(1));
+  s.push_back(VMInstr::LOAD(1));
+  s.push_back(VMInstr::LOAD(0));
+  s.push_back(VMInstr::ADDLE());
+  s.push_back(VMInstr::LOAD(1));
+  s.push_back(VMInstr::TODBL());
+  s.push_back(VMInstr::PUSH(0.5));
+  s.push_back(VMInstr::MUL());
+  s.push_back(VMInstr::LOAD(0));
+  s.push_back(VMInstr::ADDLE());
+  s.push_back(VMInstr::PUSH("s"));
+  s.push_back(VMInstr::LOAD(1));
+  s.push_back(VMInstr::TOSTR());
+  s.push_back(VMInstr::CONCAT());
+  s.push_back(VMInstr::LOAD(0));
+  s.push_back(VMInstr::ADDLE());
+  s.push_back(VMInstr::LOAD(0));
+  s.push_back(VMInstr::LOAD(1));
+  s.push_back(VMInstr::PUSH(3));
+  s.push_back(VMInstr::MUL());
+  s.push_back(VMInstr::PUSH(2));
+  s.push_back(VMInstr::ADD());
+  s.push_back(VMInstr::GETLI());
+  s.push_back(VMInstr::WRITE());
+  for (auto stat : {VMInstr::LAVGI(), VMInstr::LAVGD(), VMInstr::LNUMS(),
+                    VMInstr::LSIZE()}) {
+    s.push_back(VMInstr::PUSH(" "));
+    s.push_back(VMInstr::WRITE());
+    s.push_back(VMInstr::LOAD(0));
+    s.push_back(stat);
+    s.push_back(VMInstr::WRITE());
+  }
+  s.push_back(VMInstr::PUSH("\n"));
+  s.push_back(VMInstr::WRITE());
+  s.push_back(VMInstr::PUSH(nullptr));
+  s.push_back(VMInstr::RET());
+
+  int compiled = 0;
+  string interpreted = run_with_jit(main, step, -1, compiled);
+  EXPECT_EQ(0, compiled);
+  string jit = run_with_jit(main, step, 0, compiled);
+  if (VMJit::supported())
+    EXPECT_EQ(2, compiled);
+  EXPECT_EQ(interpreted, jit);
+  EXPECT_NE(string::npos, interpreted.find("s99 49 24.750000 100 300\n"));
+  EXPECT_NE(string::npos, interpreted.find("error: "));
+  EXPECT_NE(string::npos, interpreted.find("out-of-bounds list index"));
+}
+
+
 
 //----------------------------------------------------------------------
 // main
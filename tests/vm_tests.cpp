@@ -0,0 +1,858 @@
+//----------------------------------------------------------------------
+// FILE: vm_tests.cpp
+// DATE: CPSC 326, Spring 2023
+// AUTH: Cameron Chetcuti
+// DESC: Basic VM runtime tests
+//----------------------------------------------------------------------
+
+#include <cmath>
+#include <cstdio>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+#include <unistd.h>
+#include <gtest/gtest.h>
+#include <mypl_exception.h>
+#include <vm.h>
+#include <vm_input.h>
+
+using namespace std;
+
+
+//----------------------------------------------------------------------
+// Conversion tests
+//----------------------------------------------------------------------
+
+TEST(VMConversionTests, Parse_int_edge_cases) {
+  int result = 0;
+  EXPECT_FALSE(parse_int("", result));
+  EXPECT_FALSE(parse_int("+", result));
+  EXPECT_FALSE(parse_int("+-1", result));
+  EXPECT_FALSE(parse_int("x12", result));
+  EXPECT_FALSE(parse_int("2147483648", result));
+  EXPECT_FALSE(parse_int("-2147483649", result));
+  EXPECT_TRUE(parse_int("2147483647", result));
+  EXPECT_EQ(2147483647, result);
+  EXPECT_TRUE(parse_int("-2147483648", result));
+  EXPECT_EQ(-2147483648, result);
+  EXPECT_TRUE(parse_int("+7", result));
+  EXPECT_EQ(7, result);
+  // like std::stoi, leading whitespace and trailing text are skipped
+  EXPECT_TRUE(parse_int(" \t\n42", result));
+  EXPECT_EQ(42, result);
+  EXPECT_TRUE(parse_int("12abc", result));
+  EXPECT_EQ(12, result);
+}
+
+TEST(VMConversionTests, Parse_double_edge_cases) {
+  double result = 0;
+  EXPECT_FALSE(parse_double("", result));
+  EXPECT_FALSE(parse_double("+", result));
+  EXPECT_FALSE(parse_double("+-1", result));
+  EXPECT_FALSE(parse_double("1e400", result));
+  EXPECT_FALSE(parse_double("4.9e-324", result));
+  EXPECT_TRUE(parse_double("2147483648", result));
+  EXPECT_EQ(2147483648.0, result);
+  EXPECT_TRUE(parse_double("  \t3.5", result));
+  EXPECT_EQ(3.5, result);
+  EXPECT_TRUE(parse_double("inf", result));
+  EXPECT_TRUE(isinf(result));
+  EXPECT_TRUE(parse_double("nan", result));
+  EXPECT_TRUE(isnan(result));
+}
+
+TEST(VMConversionTests, Parse_double_hex) {
+  double result = 1;
+  // like std::stod, "0x" without digits is the 0 before the x
+  EXPECT_TRUE(parse_double("0x", result));
+  EXPECT_EQ(0.0, result);
+  EXPECT_TRUE(parse_double("-0x", result));
+  EXPECT_EQ(0.0, result);
+  EXPECT_TRUE(signbit(result));
+  EXPECT_TRUE(parse_double("0x1.8p1", result));
+  EXPECT_EQ(3.0, result);
+  // exact hexadecimal subnormals are in range, rounded ones aren't
+  EXPECT_TRUE(parse_double("0x1p-1074", result));
+  EXPECT_EQ(ldexp(1.0, -1074), result);
+  EXPECT_TRUE(parse_double("-0x1p-1074", result));
+  EXPECT_EQ(-ldexp(1.0, -1074), result);
+  EXPECT_FALSE(parse_double("0x1.0000000000001p-1070", result));
+  EXPECT_FALSE(parse_double("0x1p-1080", result));
+}
+
+TEST(VMConversionTests, Parse_double_matches_stod) {
+  for (string str : {"", "+", "+-1", "0x", "-0x", "1e400", "4.9e-324",
+                     "2147483648", "inf", "-inf", "nan", " 1.5", "\n-2",
+                     "0x1p-1074", "1e-310", "0x1.fffffffffffffp-1023",
+                     "12abc", ".5", "5.", "-.e1"}) {
+    double result = 0;
+    bool parsed = parse_double(str, result);
+    double expected = 0;
+    bool converted = true;
+    try {
+      expected = stod(str);
+    }
+    catch (const exception&) {
+      converted = false;
+    }
+    EXPECT_EQ(converted, parsed) << "'" << str << "'";
+    if (parsed and converted and !isnan(expected))
+      EXPECT_EQ(expected, result) << "'" << str << "'";
+  }
+}
+
+
+//----------------------------------------------------------------------
+// Input tests
+//----------------------------------------------------------------------
+
+// Temporarily replaces the standard input (file descriptor 0) with a
+// file holding text (read from offset on), or with a pipe that text is
+// written to
+class StdinFrom
+{
+public:
+
+  StdinFrom(const string& text, bool use_pipe, off_t offset = 0)
+  {
+    saved = dup(STDIN_FILENO);
+    if (use_pipe) {
+      int fds[2];
+      if (pipe(fds) != 0)
+        throw runtime_error("pipe failed");
+      dup2(fds[0], STDIN_FILENO);
+      close(fds[0]);
+      writer = thread([text, fd = fds[1]]() {
+        size_t written = 0;
+        while (written < text.size()) {
+          ssize_t count = write(fd, text.data() + written,
+                                text.size() - written);
+          if (count <= 0)
+            break;
+          written += count;
+        }
+        close(fd);
+      });
+    }
+    else {
+      FILE* file = tmpfile();
+      fwrite(text.data(), 1, text.size(), file);
+      fflush(file);
+      dup2(fileno(file), STDIN_FILENO);
+      fclose(file);
+      lseek(STDIN_FILENO, offset, SEEK_SET);
+    }
+  }
+
+  ~StdinFrom()
+  {
+    if (writer.joinable())
+      writer.join();
+    dup2(saved, STDIN_FILENO);
+    close(saved);
+  }
+
+private:
+
+  int saved;
+  thread writer;
+
+};
+
+// every line read_line gives for the standard input
+vector<string> read_all(VMInput& input)
+{
+  vector<string> lines;
+  string_view line;
+  while (input.read_line(line))
+    lines.push_back(string(line));
+  return lines;
+}
+
+// the lines read_line gives for text, from a file and from a pipe
+void expect_lines(const string& text, const vector<string>& expected)
+{
+  for (bool use_pipe : {false, true}) {
+    StdinFrom redirect(text, use_pipe);
+    VMInput input;
+    EXPECT_EQ(expected, read_all(input)) << (use_pipe ? "pipe" : "file");
+  }
+}
+
+TEST(VMInputTests, Lines) {
+  expect_lines("one\ntwo\n\nfour\n", {"one", "two", "", "four"});
+}
+
+TEST(VMInputTests, Carriage_return_kept) {
+  expect_lines("one\r\ntwo\r\n", {"one\r", "two\r"});
+}
+
+TEST(VMInputTests, Last_line_without_newline) {
+  expect_lines("one\ntwo", {"one", "two"});
+  expect_lines("\n", {""});
+}
+
+TEST(VMInputTests, Empty_input) {
+  expect_lines("", {});
+  for (bool use_pipe : {false, true}) {
+    StdinFrom redirect("", use_pipe);
+    VMInput input;
+    string_view line = "unchanged";
+    EXPECT_FALSE(input.read_line(line));
+    EXPECT_FALSE(input.read_line(line));
+  }
+}
+
+TEST(VMInputTests, Line_longer_than_a_block) {
+  // longer than the 1 MB read block, so the buffer has to grow twice
+  string long_line(3 * (1 << 20) + 17, 'x');
+  long_line[12345] = 'y';
+  expect_lines("a\n" + long_line + "\nb\n" + long_line,
+               {"a", long_line, "b", long_line});
+}
+
+TEST(VMInputTests, Pages_given_back) {
+  // past 16 MB read, the mapped pages already read are given back
+  string line(999, 'z');
+  string text;
+  for (int i = 0; i < 20000; ++i)
+    text += line + "\n";
+  StdinFrom redirect(text, false);
+  VMInput input;
+  vector<string> lines = read_all(input);
+  ASSERT_EQ(20000, lines.size());
+  EXPECT_EQ(line, lines.front());
+  EXPECT_EQ(line, lines.back());
+}
+
+TEST(VMInputTests, Mapped_file_from_offset) {
+  // a file already read partly starts at its current offset, and is
+  // left just after the lines read
+  string text = "skipped\none\ntwo\nthree\n";
+  StdinFrom redirect(text, false, 8);
+  {
+    VMInput input;
+    string_view line;
+    ASSERT_TRUE(input.read_line(line));
+    EXPECT_EQ("one", line);
+    ASSERT_TRUE(input.read_line(line));
+    EXPECT_EQ("two", line);
+  }
+  EXPECT_EQ(16, lseek(STDIN_FILENO, 0, SEEK_CUR));
+  VMInput rest;
+  EXPECT_EQ(vector<string>{"three"}, read_all(rest));
+}
+
+TEST(VMInputTests, File_offset_at_end) {
+  StdinFrom redirect("one\n", false, 4);
+  VMInput input;
+  EXPECT_EQ(vector<string>{}, read_all(input));
+}
+
+TEST(VMInputTests, Read_instruction) {
+  StdinFrom redirect("first\nsecond", true);
+  VMFrameInfo main {"main", 0};
+  main.instructions.push_back(VMInstr::READ());
+  main.instructions.push_back(VMInstr::READ());
+  main.instructions.push_back(VMInstr::CONCAT());
+  main.instructions.push_back(VMInstr::READ());
+  main.instructions.push_back(VMInstr::CONCAT());
+  main.instructions.push_back(VMInstr::WRITE());
+  VM vm;
+  vm.add(main);
+  stringstream out;
+  streambuf* buffer = cout.rdbuf(out.rdbuf());
+  vm.run();
+  cout.rdbuf(buffer);
+  EXPECT_EQ("firstsecond", out.str());
+}
+
+
+//----------------------------------------------------------------------
+// Garbage collection tests
+//----------------------------------------------------------------------
+
+// appends a loop running body count times (using local variable var)
+void add_loop(VMFrameInfo& f, int var, int count,
+              const vector<VMInstr>& body)
+{
+  f.instructions.push_back(VMInstr::PUSH(0));
+  f.instructions.push_back(VMInstr::STORE(var));
+  int loop = f.instructions.size();
+  f.instructions.push_back(VMInstr::LOAD(var));
+  f.instructions.push_back(VMInstr::PUSH(count));
+  f.instructions.push_back(VMInstr::CMPLT());
+  int exit = f.instructions.size();
+  f.instructions.push_back(VMInstr::JMPF(-1));
+  for (const VMInstr& instr : body)
+    f.instructions.push_back(instr);
+  f.instructions.push_back(VMInstr::LOAD(var));
+  f.instructions.push_back(VMInstr::PUSH(1));
+  f.instructions.push_back(VMInstr::ADD());
+  f.instructions.push_back(VMInstr::STORE(var));
+  f.instructions.push_back(VMInstr::JMP(loop));
+  f.instructions[exit].set_operand(int(f.instructions.size()));
+}
+
+// appends loops making count young garbage structs (of type Big, with
+// 8 fields) and count old garbage arrays
+void add_garbage(VMFrameInfo& f, int var, int count)
+{
+  add_loop(f, var, count, {VMInstr::ALLOCS("Big"), VMInstr::POP()});
+  add_loop(f, var, count, {VMInstr::PUSH(1), VMInstr::PUSH(nullptr),
+                           VMInstr::ALLOCA(), VMInstr::POP()});
+}
+
+// the named count in the vm's gc_stats
+long gc_stat(const VM& vm, const string& name)
+{
+  string stats = vm.gc_stats();
+  size_t at = stats.find("  " + name + ": ");
+  if (at == string::npos)
+    return -1;
+  return stol(stats.substr(at + name.size() + 4));
+}
+
+// runs the program (with Big and Node structs), returning its output
+string run_gc(VM& vm, const VMFrameInfo& main)
+{
+  vm.add_struct("Big", {"a", "b", "c", "d", "e", "f", "g", "h"});
+  vm.add_struct("Node", {"v", "next"});
+  vm.add(main);
+  stringstream out;
+  streambuf* buffer = cout.rdbuf(out.rdbuf());
+  try {
+    vm.run();
+  }
+  catch (...) {
+    cout.rdbuf(buffer);
+    throw;
+  }
+  cout.rdbuf(buffer);
+  return out.str();
+}
+
+TEST(VMGCTests, Minor_collection_frees_young_garbage) {
+  // the nursery (65536 values) holds 8192 Big structs
+  VMFrameInfo main {"main", 0};
+  add_loop(main, 0, 10000, {VMInstr::ALLOCS("Big"), VMInstr::POP()});
+  VM vm;
+  run_gc(vm, main);
+  EXPECT_EQ(1, gc_stat(vm, "minor collections"));
+  EXPECT_EQ(0, gc_stat(vm, "collections"));
+  EXPECT_EQ(8192, gc_stat(vm, "objects freed"));
+  EXPECT_EQ(10000 - 8192, gc_stat(vm, "live objects"));
+}
+
+TEST(VMGCTests, Collection_frees_old_garbage) {
+  // a collection each time 100 arrays are live
+  VMFrameInfo main {"main", 0};
+  add_loop(main, 0, 1000, {VMInstr::PUSH(1), VMInstr::PUSH(nullptr),
+                           VMInstr::ALLOCA(), VMInstr::POP()});
+  VM vm;
+  vm.set_gc_threshold(100);
+  run_gc(vm, main);
+  EXPECT_EQ(9, gc_stat(vm, "collections"));
+  EXPECT_EQ(0, gc_stat(vm, "minor collections"));
+  EXPECT_EQ(900, gc_stat(vm, "objects freed"));
+  EXPECT_EQ(100, gc_stat(vm, "live objects"));
+  EXPECT_EQ(100, gc_stat(vm, "peak objects"));
+}
+
+TEST(VMGCTests, Collection_keeps_reachable_objects) {
+  // a list of 50 structs (from local 0) survives, the rest is garbage
+  VMFrameInfo main {"main", 0};
+  main.instructions.push_back(VMInstr::ALLOCL());
+  main.instructions.push_back(VMInstr::STORE(0));
+  add_loop(main, 1, 50, {VMInstr::ALLOCS("Node"), VMInstr::LOAD(0),
+                         VMInstr::ADDLE()});
+  add_garbage(main, 1, 10000);
+  main.instructions.push_back(VMInstr::LOAD(0));
+  main.instructions.push_back(VMInstr::LSIZE());
+  main.instructions.push_back(VMInstr::WRITE());
+  VM vm;
+  vm.set_gc_threshold(100);
+  EXPECT_EQ("50", run_gc(vm, main));
+  EXPECT_EQ(51 + 10000 + 10000, gc_stat(vm, "objects freed") +
+            gc_stat(vm, "live objects"));
+  EXPECT_GT(gc_stat(vm, "collections"), 0);
+  EXPECT_GT(gc_stat(vm, "minor collections"), 0);
+  EXPECT_LT(gc_stat(vm, "live objects"), 51 + 200);
+}
+
+TEST(VMGCTests, Disabled_collection_frees_nothing) {
+  VMFrameInfo main {"main", 0};
+  add_garbage(main, 0, 10000);
+  VM vm;
+  vm.set_gc_threshold(-1);
+  run_gc(vm, main);
+  EXPECT_EQ(0, gc_stat(vm, "collections"));
+  EXPECT_EQ(0, gc_stat(vm, "minor collections"));
+  EXPECT_EQ(0, gc_stat(vm, "objects freed"));
+  EXPECT_EQ(20000, gc_stat(vm, "live objects"));
+}
+
+TEST(VMGCTests, Promoted_struct_add_field) {
+  // an empty struct promoted by a minor collection (held only by an
+  // old array) gets a field: its slots must not go back to the nursery
+  // where the next minor collection would free it
+  VMFrameInfo main {"main", 0};
+  vector<VMInstr> garbage = {VMInstr::ALLOCS("Big"), VMInstr::POP()};
+  vector<VMInstr>& code = main.instructions;
+  code.push_back(VMInstr::PUSH(1));
+  code.push_back(VMInstr::PUSH(nullptr));
+  code.push_back(VMInstr::ALLOCA());
+  code.push_back(VMInstr::STORE(0));
+  code.push_back(VMInstr::LOAD(0));
+  code.push_back(VMInstr::PUSH(0));
+  code.push_back(VMInstr::ALLOCS());
+  code.push_back(VMInstr::SETI());
+  add_loop(main, 1, 10000, garbage);
+  code.push_back(VMInstr::LOAD(0));
+  code.push_back(VMInstr::PUSH(0));
+  code.push_back(VMInstr::GETI());
+  code.push_back(VMInstr::ADDF("x"));
+  add_loop(main, 1, 10000, garbage);
+  code.push_back(VMInstr::LOAD(0));
+  code.push_back(VMInstr::PUSH(0));
+  code.push_back(VMInstr::GETI());
+  code.push_back(VMInstr::PUSH(5));
+  code.push_back(VMInstr::SETF("x"));
+  code.push_back(VMInstr::LOAD(0));
+  code.push_back(VMInstr::PUSH(0));
+  code.push_back(VMInstr::GETI());
+  code.push_back(VMInstr::GETF("x"));
+  code.push_back(VMInstr::WRITE());
+  VM vm;
+  EXPECT_EQ("5", run_gc(vm, main));
+  EXPECT_EQ(2, gc_stat(vm, "minor collections"));
+}
+
+// A young struct (with v = 42) stored into an old object by the given
+// write instruction, and only reachable through it, survives minor and
+// full collections
+class VMWriteBarrierTests : public testing::TestWithParam<OpCode> {};
+
+TEST_P(VMWriteBarrierTests, Young_object_survives) {
+  VMFrameInfo main {"main", 0};
+  vector<VMInstr>& code = main.instructions;
+  vector<VMInstr> young = {VMInstr::ALLOCS("Node"), VMInstr::DUP(),
+                           VMInstr::PUSH(42), VMInstr::SETF("v")};
+  vector<VMInstr> store;
+  vector<VMInstr> load;
+  OpCode op = GetParam();
+  if (op == OpCode::SETF) {
+    // the struct is promoted by the first garbage
+    code.push_back(VMInstr::ALLOCS("Node"));
+    code.push_back(VMInstr::STORE(0));
+    add_garbage(main, 1, 10000);
+    store = {VMInstr::LOAD(0)};
+    store.insert(store.end(), young.begin(), young.end());
+    store.push_back(VMInstr::SETF("next"));
+    load = {VMInstr::LOAD(0), VMInstr::GETF("next")};
+  }
+  else if (op == OpCode::SETI) {
+    code.push_back(VMInstr::PUSH(1));
+    code.push_back(VMInstr::PUSH(nullptr));
+    code.push_back(VMInstr::ALLOCA());
+    code.push_back(VMInstr::STORE(0));
+    store = {VMInstr::LOAD(0), VMInstr::PUSH(0)};
+    store.insert(store.end(), young.begin(), young.end());
+    store.push_back(VMInstr::SETI());
+    load = {VMInstr::LOAD(0), VMInstr::PUSH(0), VMInstr::GETI()};
+  }
+  else if (op == OpCode::SETLI) {
+    code.push_back(VMInstr::ALLOCL());
+    code.push_back(VMInstr::STORE(0));
+    code.push_back(VMInstr::LOAD(0));
+    code.push_back(VMInstr::ADDLI());
+    store = {VMInstr::LOAD(0), VMInstr::PUSH(0)};
+    store.insert(store.end(), young.begin(), young.end());
+    store.push_back(VMInstr::SETLI());
+    load = {VMInstr::LOAD(0), VMInstr::PUSH(0), VMInstr::GETLI()};
+  }
+  else {
+    code.push_back(VMInstr::ALLOCL());
+    code.push_back(VMInstr::STORE(0));
+    store = young;
+    store.push_back(VMInstr::LOAD(0));
+    store.push_back(VMInstr::ADDLE());
+    load = {VMInstr::LOAD(0), VMInstr::PUSH(0), VMInstr::GETLI()};
+  }
+  code.insert(code.end(), store.begin(), store.end());
+  // a minor collection (before any full one), then full collections
+  add_loop(main, 1, 10000, {VMInstr::ALLOCS("Big"), VMInstr::POP()});
+  code.insert(code.end(), load.begin(), load.end());
+  code.push_back(VMInstr::GETF("v"));
+  code.push_back(VMInstr::WRITE());
+  add_garbage(main, 1, 10000);
+  code.insert(code.end(), load.begin(), load.end());
+  code.push_back(VMInstr::GETF("v"));
+  code.push_back(VMInstr::WRITE());
+  VM vm;
+  vm.set_gc_threshold(100);
+  EXPECT_EQ("4242", run_gc(vm, main));
+  EXPECT_GT(gc_stat(vm, "minor collections"), 1);
+  EXPECT_GT(gc_stat(vm, "collections"), 0);
+}
+
+// the write instruction's name (for the test names)
+string barrier_name(const testing::TestParamInfo<OpCode>& info)
+{
+  const char* names[] = {"SETF", "SETI", "SETLI", "ADDLE"};
+  return names[info.index];
+}
+
+INSTANTIATE_TEST_SUITE_P(Barriers, VMWriteBarrierTests,
+                         testing::Values(OpCode::SETF, OpCode::SETI,
+                                         OpCode::SETLI, OpCode::ADDLE),
+                         barrier_name);
+
+
+//----------------------------------------------------------------------
+// Listing tests
+//----------------------------------------------------------------------
+
+TEST(VMLinkTests, String_constant_comment_escaped) {
+  // the literal kept as the PUSHK's comment stays on one line
+  VMFrameInfo main {"main", 0};
+  main.instructions.push_back(VMInstr::PUSH("a\n\t\"b\\"));
+  main.instructions.push_back(VMInstr::POP());
+  VM vm;
+  vm.add(main);
+  vm.run();
+  EXPECT_EQ("\nFrame 'main'\n"
+            "  0: PUSHK(0)  // \"a\\n\\t\\\"b\\\\\"\n"
+            "  1: POP()\n", to_string(vm));
+}
+
+TEST(VMInstrTests, Compare_and_jump_listing) {
+  // the jump target is listed last, not as a register
+  VMInstr instr = VMInstr::CMPKJF(OpCode::CMPLEKJF, 0, 1, 5);
+  EXPECT_EQ("CMPLEKJF(r0, 1, 5)", to_string(instr));
+  EXPECT_EQ("JMPFR(r2, 5)", to_string(VMInstr::JMPFR(2, 5)));
+}
+
+
+//----------------------------------------------------------------------
+// Register instruction tests
+//----------------------------------------------------------------------
+
+// runs the program, returning its output
+string run_main(VM& vm, const VMFrameInfo& main)
+{
+  vm.add(main);
+  stringstream out;
+  streambuf* buffer = cout.rdbuf(out.rdbuf());
+  try {
+    vm.run();
+  }
+  catch (...) {
+    cout.rdbuf(buffer);
+    throw;
+  }
+  cout.rdbuf(buffer);
+  return out.str();
+}
+
+TEST(VMRegisterTests, Register_only_frame) {
+  // no LOAD or STORE, so only the registers size the frame's locals
+  VMFrameInfo main {"main", 0};
+  main.instructions.push_back(VMInstr::MOVK(3, 7));
+  main.instructions.push_back(VMInstr::MOVK(4, 8));
+  main.instructions.push_back(VMInstr::ADDR(5, 3, 4));
+  main.instructions.push_back(VMInstr::PUSH(1));
+  main.instructions.push_back(VMInstr::WRITE());
+  VM vm;
+  EXPECT_EQ("1", run_main(vm, main));
+}
+
+TEST(VMRegisterTests, Register_results) {
+  // r0 counts down from 3 writing r0 * r1 (the jump target in the
+  // compare and jump isn't a register), then writes r1 + 1
+  VMFrameInfo main {"main", 0};
+  vector<VMInstr>& code = main.instructions;
+  code.push_back(VMInstr::MOVK(0, 3));
+  code.push_back(VMInstr::MOVK(1, 10));
+  code.push_back(VMInstr::CMPKJF(OpCode::CMPGTKJF, 0, 0, 9));
+  code.push_back(VMInstr::MULR(2, 0, 1));
+  code.push_back(VMInstr::ADDK(3, 1, 1));
+  code.push_back(VMInstr::LOAD(2));
+  code.push_back(VMInstr::WRITE());
+  code.push_back(VMInstr::SUBK(0, 0, 1));
+  code.push_back(VMInstr::JMP(2));
+  code.push_back(VMInstr::LOAD(3));
+  code.push_back(VMInstr::WRITE());
+  VM vm;
+  EXPECT_EQ("30201011", run_main(vm, main));
+}
+
+
+//----------------------------------------------------------------------
+// Typed instruction tests
+//----------------------------------------------------------------------
+
+// a typed operation, its generic version, operands, and expected result
+struct TypedCase {
+  VMInstr typed;
+  VMInstr generic;
+  VMValue y;
+  VMValue x;
+  string result;
+};
+
+vector<TypedCase> typed_cases()
+{
+  return {
+    {VMInstr::ADDI(), VMInstr::ADD(), 7, 2, "9"},
+    {VMInstr::ADDD(), VMInstr::ADD(), 7.5, 2.0, "9.500000"},
+    {VMInstr::SUBI(), VMInstr::SUB(), 7, 2, "5"},
+    {VMInstr::SUBD(), VMInstr::SUB(), 7.5, 2.0, "5.500000"},
+    {VMInstr::MULI(), VMInstr::MUL(), 7, 2, "14"},
+    {VMInstr::MULD(), VMInstr::MUL(), 7.5, 2.0, "15.000000"},
+    {VMInstr::DIVI(), VMInstr::DIV(), 7, 2, "3"},
+    {VMInstr::DIVD(), VMInstr::DIV(), 7.5, 2.0, "3.750000"},
+    {VMInstr::CMPLTI(), VMInstr::CMPLT(), 7, 2, "false"},
+    {VMInstr::CMPLTD(), VMInstr::CMPLT(), 2.0, 7.5, "true"},
+    {VMInstr::CMPLEI(), VMInstr::CMPLE(), 2, 2, "true"},
+    {VMInstr::CMPLED(), VMInstr::CMPLE(), 7.5, 2.0, "false"},
+    {VMInstr::CMPGTI(), VMInstr::CMPGT(), 7, 2, "true"},
+    {VMInstr::CMPGTD(), VMInstr::CMPGT(), 2.0, 2.0, "false"},
+    {VMInstr::CMPGEI(), VMInstr::CMPGE(), 2, 7, "false"},
+    {VMInstr::CMPGED(), VMInstr::CMPGE(), 2.0, 2.0, "true"},
+  };
+}
+
+// runs y op x, returning the output (or the error message without its
+// location, which names the instruction)
+string run_binary(const VMInstr& op, const VMValue& y, const VMValue& x)
+{
+  VMFrameInfo main {"main", 0};
+  main.instructions.push_back(VMInstr::PUSH(y));
+  main.instructions.push_back(VMInstr::PUSH(x));
+  main.instructions.push_back(op);
+  main.instructions.push_back(VMInstr::WRITE());
+  VM vm;
+  try {
+    return run_main(vm, main);
+  }
+  catch (MyPLException& ex) {
+    string msg = ex.what();
+    return "error: " + msg.substr(0, msg.find(" (in "));
+  }
+}
+
+TEST(VMTypedTests, Typed_results) {
+  for (const TypedCase& c : typed_cases()) {
+    SCOPED_TRACE(to_string(c.typed));
+    EXPECT_EQ(c.result, run_binary(c.typed, c.y, c.x));
+    EXPECT_EQ(c.result, run_binary(c.generic, c.y, c.x));
+  }
+}
+
+TEST(VMTypedTests, Null_operands_fall_back) {
+  // a null operand takes the generic path, giving the same error
+  for (const TypedCase& c : typed_cases()) {
+    SCOPED_TRACE(to_string(c.typed));
+    string error = run_binary(c.generic, nullptr, c.x);
+    EXPECT_EQ(0, error.find("error: "));
+    EXPECT_EQ(error, run_binary(c.typed, nullptr, c.x));
+    error = run_binary(c.generic, c.y, nullptr);
+    EXPECT_EQ(0, error.find("error: "));
+    EXPECT_EQ(error, run_binary(c.typed, c.y, nullptr));
+  }
+}
+
+
+//----------------------------------------------------------------------
+// JIT tests
+//----------------------------------------------------------------------
+
+// Each JIT test runs its program interpreted and then with main compiled
+// before it starts, and expects the same output both ways (the machine
+// code falls back to the shared handlers for operands it doesn't cover)
+
+// runs the instructions as main with the given jit threshold, returning
+// the output followed by the error it stopped with (if any)
+string run_jit(const vector<VMInstr>& code, int threshold)
+{
+  VMFrameInfo main {"main", 0};
+  main.instructions = code;
+  VM vm;
+  vm.set_jit_threshold(threshold);
+  vm.add(main);
+  stringstream out;
+  streambuf* buffer = cout.rdbuf(out.rdbuf());
+  try {
+    vm.run();
+  }
+  catch (const MyPLException& ex) {
+    out << "error: " << ex.what();
+  }
+  cout.rdbuf(buffer);
+  if (threshold >= 0 and VMJit::supported())
+    EXPECT_EQ(1, vm.jit_compiled_count());
+  return out.str();
+}
+
+// runs the instructions both ways, returning the (matching) output
+string run_jit_both(const vector<VMInstr>& code)
+{
+  string interpreted = run_jit(code, -1);
+  EXPECT_EQ(interpreted, run_jit(code, 0));
+  return interpreted;
+}
+
+// appends instructions writing register r followed by a space
+void write_reg(vector<VMInstr>& code, int r)
+{
+  code.push_back(VMInstr::LOAD(r));
+  code.push_back(VMInstr::WRITE());
+  code.push_back(VMInstr::PUSH(" "));
+  code.push_back(VMInstr::WRITE());
+}
+
+TEST(VMJitTests, Typed_operations) {
+  // the int and double fast paths, and null operands falling back
+  for (const TypedCase& c : typed_cases()) {
+    SCOPED_TRACE(to_string(c.typed));
+    vector<vector<VMValue>> operands = {{c.y, c.x}, {nullptr, c.x},
+                                        {c.y, nullptr}};
+    for (const vector<VMValue>& yx : operands) {
+      vector<VMInstr> code = {VMInstr::PUSH(yx[0]), VMInstr::PUSH(yx[1]),
+                              c.typed, VMInstr::WRITE()};
+      string out = run_jit_both(code);
+      if (yx[0].is_null() or yx[1].is_null())
+        EXPECT_EQ(0, out.find("error: "));
+      else
+        EXPECT_EQ(c.result, out);
+    }
+  }
+}
+
+TEST(VMJitTests, Register_moves) {
+  // int, double, bool and null constants are stored directly, strings
+  // fall back
+  vector<VMInstr> code = {VMInstr::MOVK(0, 7), VMInstr::MOVK(1, 2.5),
+                          VMInstr::MOVK(2, true), VMInstr::MOVK(3, nullptr),
+                          VMInstr::MOVK(4, "s")};
+  for (int r = 0; r <= 4; ++r)
+    write_reg(code, r);
+  code.push_back(VMInstr::MOVR(5, 0));
+  code.push_back(VMInstr::MOVR(6, 1));
+  code.push_back(VMInstr::MOVR(0, 3));
+  code.push_back(VMInstr::MOVR(1, 4));
+  for (int r : {5, 6, 0, 1})
+    write_reg(code, r);
+  EXPECT_EQ("7 2.500000 true null s 7 2.500000 null s ", run_jit_both(code));
+}
+
+TEST(VMJitTests, Register_arithmetic) {
+  // ints take the fast paths, doubles and double constants fall back
+  vector<VMInstr> code = {VMInstr::MOVK(0, 7), VMInstr::MOVK(1, 2),
+                          VMInstr::MOVK(2, 2.5), VMInstr::MOVK(3, 1.5)};
+  code.push_back(VMInstr::ADDK(4, 0, 2));
+  code.push_back(VMInstr::SUBK(5, 0, 10));
+  code.push_back(VMInstr::ADDK(6, 2, 0.5));
+  code.push_back(VMInstr::SUBK(7, 3, 0.5));
+  for (int r = 4; r <= 7; ++r)
+    write_reg(code, r);
+  code.push_back(VMInstr::ADDR(4, 0, 1));
+  code.push_back(VMInstr::SUBR(5, 0, 1));
+  code.push_back(VMInstr::MULR(6, 0, 1));
+  code.push_back(VMInstr::ADDR(7, 2, 3));
+  code.push_back(VMInstr::SUBR(8, 2, 3));
+  code.push_back(VMInstr::MULR(9, 2, 3));
+  for (int r = 4; r <= 9; ++r)
+    write_reg(code, r);
+  EXPECT_EQ("9 -3 3.000000 1.000000 9 5 14 4.000000 1.000000 3.750000 ",
+            run_jit_both(code));
+}
+
+TEST(VMJitTests, Register_comparisons) {
+  // ints take the fast path, doubles, bools and nulls fall back
+  vector<VMInstr> code = {VMInstr::MOVK(0, 7), VMInstr::MOVK(1, 2),
+                          VMInstr::MOVK(2, 2.5), VMInstr::MOVK(3, true),
+                          VMInstr::MOVK(4, nullptr)};
+  code.push_back(VMInstr::CMPLTR(5, 0, 1));
+  code.push_back(VMInstr::CMPLER(6, 1, 0));
+  code.push_back(VMInstr::CMPGTR(7, 0, 1));
+  code.push_back(VMInstr::CMPGER(8, 1, 1));
+  code.push_back(VMInstr::CMPEQR(9, 0, 1));
+  code.push_back(VMInstr::CMPNER(10, 0, 1));
+  for (int r = 5; r <= 10; ++r)
+    write_reg(code, r);
+  code.push_back(VMInstr::CMPLTR(5, 2, 2));
+  code.push_back(VMInstr::CMPGER(6, 2, 2));
+  code.push_back(VMInstr::CMPEQR(7, 3, 3));
+  code.push_back(VMInstr::CMPNER(8, 3, 3));
+  code.push_back(VMInstr::CMPEQR(9, 4, 0));
+  code.push_back(VMInstr::CMPEQR(10, 4, 4));
+  for (int r = 5; r <= 10; ++r)
+    write_reg(code, r);
+  EXPECT_EQ("false true true true false true "
+            "false true true false false true ", run_jit_both(code));
+}
+
+TEST(VMJitTests, Register_jumps) {
+  // r0 counts down from 3 (compare and jump on an int), a false JMPFR
+  // skips writing x, and a double and a null constant compare and jump
+  // fall back
+  vector<VMInstr> code = {
+    VMInstr::MOVK(0, 3),
+    VMInstr::CMPKJF(OpCode::CMPGTKJF, 0, 0, 4),
+    VMInstr::SUBK(0, 0, 1),
+    VMInstr::JMP(1),
+    VMInstr::LOAD(0),                                        // 4
+    VMInstr::WRITE(),
+    VMInstr::CMPLTR(1, 0, 0),
+    VMInstr::JMPFR(1, 10),
+    VMInstr::PUSH("x"),
+    VMInstr::WRITE(),
+    VMInstr::MOVK(2, 1.5),                                   // 10
+    VMInstr::CMPKJF(OpCode::CMPLTKJF, 2, 2.5, 14),
+    VMInstr::LOAD(2),
+    VMInstr::WRITE(),
+    VMInstr::MOVK(3, nullptr),                               // 14
+    VMInstr::CMPKJF(OpCode::CMPEQKJF, 3, nullptr, 18),
+    VMInstr::LOAD(3),
+    VMInstr::WRITE(),
+    VMInstr::PUSH("."),                                      // 18
+    VMInstr::WRITE()
+  };
+  EXPECT_EQ("01.500000null.", run_jit_both(code));
+}
+
+TEST(VMJitTests, Null_register_operands) {
+  // each register fast path falls back on a null, giving the same error
+  vector<VMInstr> ops = {
+    VMInstr::ADDK(1, 0, 1), VMInstr::SUBK(1, 0, 1), VMInstr::ADDR(1, 0, 0),
+    VMInstr::SUBR(1, 0, 0), VMInstr::MULR(1, 0, 0), VMInstr::CMPLTR(1, 0, 0),
+    VMInstr::CMPGER(1, 0, 0), VMInstr::JMPFR(0, 0),
+    VMInstr::CMPKJF(OpCode::CMPLTKJF, 0, 1, 0),
+    VMInstr::CMPKJF(OpCode::CMPNEKJF, 0, 1, 0)
+  };
+  for (const VMInstr& op : ops) {
+    SCOPED_TRACE(to_string(op));
+    vector<VMInstr> code = {VMInstr::MOVK(0, nullptr), op};
+    string out = run_jit_both(code);
+    if (op.opcode() == OpCode::CMPNEKJF)
+      EXPECT_EQ("", out);
+    else
+      EXPECT_NE(string::npos, out.find("null reference"));
+  }
+}
+
+
+//----------------------------------------------------------------------
+// main
+//----------------------------------------------------------------------
+
+int main(int argc, char** argv)
+{
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}